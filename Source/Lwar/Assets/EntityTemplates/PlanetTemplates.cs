@@ -17,7 +17,7 @@
 			Radius = 700,
 			CubeMap = "Earth",
 			Model = t => String.Format("Model.CreateSphere(renderContext.GraphicsDevice, {0}, {1})", (int)t.Radius, 16),
-			Format = "format_pos"
+			Format = "format_body"
 		};
 
 		public static readonly EntityTemplate Mars = new EntityTemplate
@@ -29,7 +29,7 @@
 			Radius = 350,
 			CubeMap = "Mars",
 			Model = t => String.Format("Model.CreateSphere(renderContext.GraphicsDevice, {0}, {1})", (int)t.Radius, 16),
-			Format = "format_pos"
+			Format = "format_body"
 		};
 
 		public static readonly EntityTemplate Moon = new EntityTemplate
@@ -41,7 +41,7 @@
 			Radius = 250,
 			CubeMap = "Moon",
 			Model = t => String.Format("Model.CreateSphere(renderContext.GraphicsDevice, {0}, {1})", (int)t.Radius, 16),
-			Format = "format_pos"
+			Format = "format_body"
 		};
 
 		public static readonly EntityTemplate Jupiter = new EntityTemplate
@@ -53,7 +53,7 @@
 			Radius = 1000,
 			CubeMap = "Jupiter",
 			Model = t => String.Format("Model.CreateSphere(renderContext.GraphicsDevice, {0}, {1})", (int)t.Radius, 16),
-			Format = "format_pos"
+			Format = "format_body"
 		};
 	}
 }
\ No newline at end of file
@@ -15,7 +15,7 @@
 			Health = 1,
 			Mass = 500000,
 			Radius = 4000,
-			Format = "format_pos"
+			Format = "format_body"
 		};
 	}
 }
\ No newline at end of file
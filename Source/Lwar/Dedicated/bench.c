@@ -0,0 +1,502 @@
+#include "types.h"
+
+#include "batch.h"
+#include "client.h"
+#include "config.h"
+#include "entity.h"
+#include "jitter.h"
+#include "log.h"
+#include "message.h"
+#include "pack.h"
+#include "player.h"
+#include "snapshot.h"
+#include "unpack.h"
+#include "update.h"
+
+#include <limits.h>
+#include <time.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Codec benchmark: encodes and decodes synthetic update records of all
+ * formats with the legacy, the delta (REVISION_DELTA) and the bit-packed
+ * (REVISION_BITPACK) encoding, and reports the size per entity as well as
+ * the throughput. The first frame is absolute, all others are relative to
+ * the previous one. Decoded records are checked against the originals.
+ *
+ * The legacy records are also packed by update_batch_pack with each byte
+ * order conversion the CPU supports, which must give the same bytes as
+ * packing them one at a time.
+ *
+ * Finally, the jitter buffer of a client is fed with Input messages that
+ * arrive in order, out of order, late in bursts or after gaps longer than
+ * their history, at the client's frame interval and at others, and is
+ * updated every JITTER_TICK like the dedicated server does. Frames that
+ * arrive in order must not run the buffer dry once the interval of the
+ * client has been measured, swapped frames at most when the buffer shrinks
+ * after INPUT_CALM, and a late burst must drain back to the depth.
+ *
+ * usage: bench [-entities n] [-frames n] [-seed n]
+ */
+
+enum {
+    MAX_BENCH_ENTITIES = MAX_ENTITIES,
+    MAX_RECORD         = 64,
+    JITTER_TICK        = 30 /*ms*/, /* of the server updates */
+    JITTER_FRAMES      = 600,
+    JITTER_WARMUP      = 3000 /*ms*/, /* until the interval has been measured */
+};
+
+/* how the Input messages of the client arrive */
+enum {
+    ARRIVE_IN_ORDER,
+    ARRIVE_SWAPPED, /* every odd frame after the next one */
+    ARRIVE_BURST,   /* frames 50 to 65 of every hundred with frame 66 */
+    ARRIVE_GAP,     /* frames 50 to 61 of every hundred are lost */
+};
+
+typedef struct Scenario Scenario;
+struct Scenario {
+    const char *name;
+    Clock       interval; /* ms between two frames of the client */
+    int         arrive;
+};
+
+/* the observed behavior of the buffer */
+typedef struct Playout Playout;
+struct Playout {
+    size_t underruns, late;  /* all of them, and those after JITTER_WARMUP */
+    size_t buffered, depth;  /* most frames after JITTER_WARMUP, and the final depth */
+    size_t drained;          /* frames buffered in the end */
+};
+
+typedef struct Result Result;
+struct Result {
+    size_t   abs_bytes, rel_bytes;
+    uint64_t enc_ns, dec_ns;
+    size_t   errors;
+};
+
+static size_t nentities = 1024;
+static size_t nframes   = 64;
+static uint32_t rnd     = 1;
+
+static State truth[2][MAX_BENCH_ENTITIES]; /* previous and current frame */
+static State client[MAX_BENCH_ENTITIES];   /* as reconstructed by the decoder */
+static int16_t vx[MAX_BENCH_ENTITIES], vy[MAX_BENCH_ENTITIES], vphi[MAX_BENCH_ENTITIES];
+static char buf[MAX_BENCH_ENTITIES * MAX_RECORD];
+static char ref[MAX_BENCH_ENTITIES * MAX_RECORD];
+
+/* entities of the legacy records, every other one belongs to a player */
+static Entity  entities[MAX_BENCH_ENTITIES];
+static Entity *batch[MAX_BENCH_ENTITIES];
+static Entity  weapons[NUM_SLOTS];
+static Player  owner;
+static EntityType kind;
+
+static uint32_t next() {
+    rnd = rnd * 1103515245 + 12345;
+    return rnd >> 8;
+}
+
+static int range(int lo, int hi) {
+    return lo + (int)(next() % (uint32_t)(hi - lo + 1));
+}
+
+static uint64_t now() {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (uint64_t)tp.tv_sec * 1000000000 + (uint64_t)tp.tv_nsec;
+}
+
+static void state_init(State *s, size_t i) {
+    size_t j;
+    memset(s, 0, sizeof(State));
+    s->id.n   = (uint16_t)i;
+    s->id.gen = (uint16_t)range(0, 3);
+    s->x      = (int16_t)range(-20000, 20000);
+    s->y      = (int16_t)range(-20000, 20000);
+    s->phi    = (uint16_t)range(0, 35999);
+    s->len    = (uint16_t)range(0, 2000);
+    s->target.n   = USHRT_MAX;
+    s->radius = (uint16_t)range(50, 500);
+    s->health = 100;
+    s->shield = 100;
+    for(j=0; j<NUM_SLOTS; j++)
+        s->energy[j] = 100;
+    vx[i]   = (int16_t)range(-30, 30);
+    vy[i]   = (int16_t)range(-30, 30);
+    vphi[i] = (int16_t)(range(0, 3) ? 0 : range(-500, 500));
+}
+
+/* move the entity and occasionally change its other fields */
+static void state_step(State *s, const State *prev, size_t i) {
+    *s = *prev;
+    s->x   = (int16_t)(s->x + vx[i]);
+    s->y   = (int16_t)(s->y + vy[i]);
+    s->phi = (uint16_t)((s->phi + 36000 + vphi[i]) % 36000);
+    if(range(0, 15) == 0) {
+        s->len    = (uint16_t)range(0, 2000);
+        s->target.n   = range(0, 1) ? USHRT_MAX : (uint16_t)range(0, MAX_ENTITIES - 1);
+        s->target.gen = s->target.n == USHRT_MAX ? 0 : (uint16_t)range(0, 3);
+        s->health = (uint8_t)range(0, 100);
+        s->shield = s->health;
+        s->energy[range(0, NUM_SLOTS - 1)] = (uint8_t)range(0, 100);
+    }
+}
+
+static void delta_init(Delta *d, const State *cur, const State *base, unsigned fields) {
+    unsigned extra = fields & ~(STATE_X | STATE_Y | STATE_PHI);
+
+    d->state  = *cur;
+    d->fields = fields;
+    d->base   = base;
+    d->head   = 0;
+
+    if(!base) {
+        if(fields & (STATE_X | STATE_Y)) d->head |= DELTA_POS;
+        if(fields & STATE_PHI)           d->head |= DELTA_PHI;
+        if(extra)                        d->head |= DELTA_EXTRA;
+        return;
+    }
+
+    d->head = 1; /* age */
+    if(cur->x != base->x || cur->y != base->y)     d->head |= DELTA_POS;
+    if((fields & STATE_PHI) && cur->phi != base->phi) d->head |= DELTA_PHI;
+    if(extra && memcmp(&cur->len, &base->len, sizeof(State) - offsetof(State, len)))
+        d->head |= DELTA_EXTRA;
+}
+
+/* compare the decoded state with the original, up to the quantization */
+static bool state_check(const State *s, const State *t, unsigned fields, bool quantized) {
+    int16_t  x   = quantized ? (int16_t)((t->x >> POSITION_SHIFT) * (1 << POSITION_SHIFT)) : t->x;
+    int16_t  y   = quantized ? (int16_t)((t->y >> POSITION_SHIFT) * (1 << POSITION_SHIFT)) : t->y;
+    uint16_t phi = quantized ? angle_restore(angle_quantize(t->phi)) : t->phi;
+
+    if(!id_eq(s->id, t->id))                                  return false;
+    if((fields & STATE_X) && (s->x != x || s->y != y))       return false;
+    if((fields & STATE_PHI) && s->phi != phi)                 return false;
+    if((fields & STATE_LEN) && s->len != t->len)              return false;
+    if((fields & STATE_TARGET) && !id_eq(s->target, t->target)) return false;
+    if((fields & STATE_RADIUS) && s->radius != t->radius)     return false;
+    if((fields & STATE_HEALTH) && s->health != t->health)     return false;
+    if((fields & STATE_ENERGY) && memcmp(s->energy, t->energy, sizeof(s->energy))) return false;
+    return true;
+}
+
+/* encode and decode one frame of all entities */
+static void frame(Result *r, unsigned fields, int bitpacked, size_t f) {
+    State *cur  = truth[f % 2];
+    State *prev = truth[(f + 1) % 2];
+    Delta d;
+    BitStream b;
+    uint16_t id;
+    size_t i, n = 0;
+    uint64_t t0, t1, t2;
+
+    t0 = now();
+    id = 0;
+    bits_init(&b, buf, sizeof(buf));
+    for(i=0; i<nentities; i++) {
+        delta_init(&d, &cur[i], f ? &prev[i] : 0, fields);
+        if(bitpacked)
+            delta_write(&b, &d, &id);
+        else
+            n += delta_pack(buf + n, &d);
+    }
+    if(bitpacked)
+        n = bits_bytes(&b);
+    t1 = now();
+
+    id = 0;
+    bits_init(&b, buf, n);
+    n  = 0;
+    for(i=0; i<nentities; i++) {
+        /* unchanged fields are taken from the baseline */
+        d.state  = client[i];
+        d.fields = fields;
+        d.base   = f ? &client[i] : 0;
+        if(bitpacked)
+            delta_read(&b, &d, &id);
+        else
+            n += delta_unpack(buf + n, sizeof(buf) - n, &d);
+        client[i] = d.state;
+    }
+    if(bitpacked)
+        n = bits_bytes(&b);
+    t2 = now();
+
+    for(i=0; i<nentities; i++) {
+        if(!state_check(&client[i], &cur[i], fields, bitpacked))
+            r->errors ++;
+    }
+
+    if(f) r->rel_bytes += n;
+    else  r->abs_bytes += n;
+    r->enc_ns += t1 - t0;
+    r->dec_ns += t2 - t1;
+}
+
+static void run(Result *r, unsigned fields, int bitpacked, uint32_t seed) {
+    size_t i, f;
+
+    memset(r, 0, sizeof(Result));
+    memset(client, 0, sizeof(client));
+
+    rnd = seed;
+    for(i=0; i<nentities; i++)
+        state_init(&truth[0][i], i);
+
+    for(f=0; f<nframes; f++) {
+        if(f) {
+            for(i=0; i<nentities; i++)
+                state_step(&truth[f % 2][i], &truth[(f + 1) % 2][i], i);
+        }
+        frame(r, fields, bitpacked, f);
+    }
+}
+
+static void entities_setup() {
+    size_t i, j;
+
+    kind.init_health = 100;
+    kind.init_energy = 100;
+    for(j=0; j<NUM_SLOTS; j++) {
+        weapons[j].type   = &kind;
+        weapons[j].energy = (Real)range(0, 100);
+        owner.weapons[j].entity = &weapons[j];
+    }
+    owner.ship.entity = &entities[0];
+
+    for(i=0; i<nentities; i++) {
+        Entity *e = &entities[i];
+        e->type   = &kind;
+        e->id     = truth[0][i].id;
+        e->len    = truth[0][i].len;
+        e->radius = truth[0][i].radius;
+        e->health = (Real)range(1, 100);
+        e->player = i % 2 ? &owner : 0;
+        e->target = range(0, 1) ? &entities[range(0, (int)nentities - 1)] : 0;
+        batch[i]  = e;
+    }
+}
+
+static void entities_step(size_t f) {
+    size_t i;
+    for(i=0; i<nentities; i++) {
+        const State *s = &truth[f % 2][i];
+        entities[i].x.x = s->x;
+        entities[i].x.y = s->y;
+        entities[i].phi = (Real)s->phi / 36000 * 6.2831853f;
+    }
+}
+
+/* pack the legacy records of all entities one at a time and in batches,
+ * ns[0] is the time of the former, ns[1 + swap] of the latter
+ */
+static size_t run_batch(Format *f, uint64_t ns[1 + BATCH_COUNT], uint32_t seed) {
+    size_t i, n, fr, errors = 0;
+    BatchSwap swap, best = batch_selected();
+    uint64_t t0;
+
+    memset(ns, 0, (1 + BATCH_COUNT) * sizeof(uint64_t));
+
+    rnd = seed;
+    for(i=0; i<nentities; i++)
+        state_init(&truth[0][i], i);
+    entities_setup();
+
+    for(fr=0; fr<nframes; fr++) {
+        if(fr) {
+            for(i=0; i<nentities; i++)
+                state_step(&truth[fr % 2][i], &truth[(fr + 1) % 2][i], i);
+        }
+        entities_step(fr);
+
+        t0 = now();
+        for(i=0, n=0; i<nentities; i++)
+            n += f->pack(ref + n, batch[i]);
+        ns[0] += now() - t0;
+
+        for(swap=0; swap<BATCH_COUNT; swap++) {
+            if(!batch_select(swap))
+                continue;
+            memset(buf, 0, n);
+            t0 = now();
+            if(update_batch_pack(buf, f, batch, nentities) != n || memcmp(buf, ref, n))
+                errors ++;
+            ns[1 + swap] += now() - t0;
+        }
+    }
+
+    batch_select(best);
+    return errors;
+}
+
+/* arrival time of frame f in ms, 0 if it is lost */
+static Clock arrival(const Scenario *s, uint32_t f) {
+    uint32_t k = f % 100;
+
+    switch(s->arrive) {
+    case ARRIVE_SWAPPED:
+        return f % 2 ? (f + 1) * s->interval + 1 : f * s->interval;
+    case ARRIVE_BURST:
+        return k >= 50 && k <= 65 ? (f - k + 66) * s->interval : f * s->interval;
+    case ARRIVE_GAP:
+        return k >= 50 && k <= 61 ? 0 : f * s->interval;
+    default:
+        return f * s->interval;
+    }
+}
+
+static void playout(const Scenario *s, Playout *p) {
+    static Client c;
+    Message m;
+    Clock t, end = (JITTER_FRAMES + 1) * s->interval;
+    uint32_t f;
+
+    memset(&c, 0, sizeof(c));
+    memset(p, 0, sizeof(Playout));
+    jitter_reset(&c);
+
+    for(t = JITTER_TICK; t <= end + 2000; t += JITTER_TICK) {
+        /* the messages that arrived since the last update, in order */
+        Clock a, from = t - JITTER_TICK;
+        for(a = from + 1; a <= t; a++) {
+            for(f = 1; f <= JITTER_FRAMES; f++) {
+                if(arrival(s, f) != a)
+                    continue;
+                memset(&m, 0, sizeof(m));
+                m.type = MESSAGE_INPUT;
+                m.input.frameno  = f;
+                m.input.forwards = 0xff;
+                jitter_input(&c, &m, a * 1000);
+            }
+        }
+
+        jitter_update(&c, t);
+        if(t >= JITTER_WARMUP && t <= end) {
+            p->late     = c.jitter.underruns - p->underruns + p->late;
+            p->buffered = max(p->buffered, jitter_buffered(&c));
+        }
+        p->underruns = c.jitter.underruns;
+    }
+    p->depth   = c.jitter.depth;
+    p->drained = jitter_buffered(&c);
+}
+
+/* the buffer drains in any case, frames that arrive in time do not run it dry */
+static bool playout_check(const Scenario *s, const Playout *p) {
+    Clock end = (JITTER_FRAMES + 1) * s->interval;
+
+    if(p->drained || p->depth > INPUT_MAX_DEPTH)
+        return false;
+
+    switch(s->arrive) {
+    case ARRIVE_IN_ORDER:
+        return p->late == 0 && p->buffered <= p->depth + 1;
+    case ARRIVE_SWAPPED:
+        return p->late <= (end - JITTER_WARMUP) / INPUT_CALM + 1 && p->buffered <= p->depth + 1;
+    default:
+        return p->late > 0;
+    }
+}
+
+static double mrec(uint64_t ns) {
+    return ns ? (double)(nentities * nframes) * 1000 / (double)ns : 0;
+}
+
+int main(int argc, char *argv[]) {
+    static Format *formats[] = { &format_pos_rot, &format_pos, &format_ray, &format_circle, &format_ship };
+    static const char *names[] = { "pos_rot", "pos", "ray", "circle", "ship" };
+    static const Scenario scenarios[] = {
+        { "in order", INPUT_INTERVAL, ARRIVE_IN_ORDER },
+        { "slower",   35,             ARRIVE_IN_ORDER },
+        { "faster",   28,             ARRIVE_IN_ORDER },
+        { "swapped",  INPUT_INTERVAL, ARRIVE_SWAPPED },
+        { "burst",    INPUT_INTERVAL, ARRIVE_BURST },
+        { "gap",      INPUT_INTERVAL, ARRIVE_GAP },
+    };
+    uint32_t seed = 1;
+    size_t k, errors = 0, failed = 0;
+    BatchSwap sw;
+    int i;
+
+    for(i=1; i+1<argc; i+=2) {
+        const char *arg = argv[i];
+        const char *val = argv[i+1];
+        if(!strcmp(arg, "-entities"))      nentities = (size_t)atoi(val);
+        else if(!strcmp(arg, "-frames"))   nframes   = (size_t)atoi(val);
+        else if(!strcmp(arg, "-seed"))     seed      = (uint32_t)atoi(val);
+        else log_die("unknown option %s", arg);
+    }
+    if(nentities < 1 || nentities > MAX_BENCH_ENTITIES || nframes < 2)
+        log_die("invalid number of entities or frames");
+
+    printf("%zu entities, %zu frames, bytes per entity (absolute/relative), million records per second (encode/decode)\n",
+           nentities, nframes);
+    printf("%-8s %7s %15s %15s %15s %15s\n",
+           "format", "legacy", "delta", "bitpack", "delta Mrec/s", "bitpack Mrec/s");
+
+    for(k=0; k<sizeof(formats)/sizeof(formats[0]); k++) {
+        Format *f = formats[k];
+        Result r[2];
+
+        run(&r[0], f->fields, 0, seed);
+        run(&r[1], f->fields, 1, seed);
+        errors += r[0].errors + r[1].errors;
+
+        printf("%-8s %7zu %7.2f/%-7.2f %7.2f/%-7.2f %7.1f/%-7.1f %7.1f/%-7.1f\n",
+               names[k], f->len,
+               (double)r[0].abs_bytes / nentities, (double)r[0].rel_bytes / (nentities * (nframes - 1)),
+               (double)r[1].abs_bytes / nentities, (double)r[1].rel_bytes / (nentities * (nframes - 1)),
+               mrec(r[0].enc_ns), mrec(r[0].dec_ns),
+               mrec(r[1].enc_ns), mrec(r[1].dec_ns));
+    }
+
+    printf("\nlegacy records, million records per second (one at a time/in batches of %d)\n", BATCH_SIZE);
+    printf("%-8s %9s", "format", "single");
+    for(sw=0; sw<BATCH_COUNT; sw++)
+        printf(" %9s", batch_name(sw));
+    printf("\n");
+
+    for(k=0; k<sizeof(formats)/sizeof(formats[0]); k++) {
+        uint64_t ns[1 + BATCH_COUNT];
+        size_t failed = run_batch(formats[k], ns, seed);
+        if(failed)
+            printf("%zu frames of %s were not packed the same in batches\n", failed, names[k]);
+        errors += failed;
+
+        printf("%-8s %9.1f", names[k], mrec(ns[0]));
+        for(sw=0; sw<BATCH_COUNT; sw++) {
+            if(ns[1 + sw]) printf(" %9.1f", mrec(ns[1 + sw]));
+            else           printf(" %9s", "-");
+        }
+        printf("\n");
+    }
+
+    printf("\njitter buffer, %d frames, updated every %d ms (underruns all/after %d ms, most frames buffered, depth)\n",
+           JITTER_FRAMES, JITTER_TICK, JITTER_WARMUP);
+    for(k=0; k<sizeof(scenarios)/sizeof(scenarios[0]); k++) {
+        const Scenario *s = &scenarios[k];
+        Playout p;
+        bool ok;
+
+        playout(s, &p);
+        ok = playout_check(s, &p);
+        printf("%-8s %3llu ms %5zu/%-5zu %7zu %5zu   %s\n",
+               s->name, (unsigned long long)s->interval, p.underruns, p.late, p.buffered, p.depth,
+               ok ? "ok" : "FAILED");
+        if(!ok) {
+            printf("the jitter buffer failed for %s\n", s->name);
+            failed ++;
+        }
+    }
+
+    if(errors)
+        printf("%zu records were not decoded correctly\n", errors);
+    return errors || failed ? 1 : 0;
+}
@@ -2,12 +2,15 @@
 
 #include "config.h"
 #include "debug.h"
+#include "jitter.h"
+#include "latency.h"
 #include "log.h"
 #include "performance.h"
 #include "server_export.h"
 #include "server.h"
 #include "visualization.h"
 
+#include <sys/epoll.h>
 #include <time.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -17,16 +20,21 @@
 
 /* typedef unsigned long long Clock; */
 static int visual,stats;
+static unsigned int shards = 1;
+static int uring;
+static int emulate; /* see server_emulate */
 static Clock base,periodic;
+static int poller = -1;
 
 static Clock clock_get();
 
 enum {
     S  = 1000000,
     MS = 1000,
-    MAX_MEASURES = 16,
+    MAX_MEASURES = 32,
     FRAME_MS       =  30,
     FRAME_INTERVAL =  FRAME_MS * MS,
+    PACE_INTERVAL  =   2 * MS, /* packets are released in between the frames */
     STAT_S         =  1,
     STAT_INTERVAL  =  STAT_S * S,
 };
@@ -63,6 +71,32 @@ static void die  (const char *msg) { fputs(msg,stderr); fputs("\n",stderr); fflu
 static LogCallbacks _log = { die, eputs, eputs, iputs, eputs, };
 static PerformanceCallbacks perf = { start, stop, inc };
 
+static double ms(uint64_t us) {
+    return (double)us / MS;
+}
+
+/* round-trip time and delays of the input, see latency.c,
+ * and the buffered input frames, see jitter.c
+ */
+static void print_latencies() {
+    Client *c;
+
+    printf("latency (ms)   rtt    queue p50    p99    input p50    p99   buffer depth underruns\n");
+    clients_foreach(c) {
+        if(!c->remote || c->dead)
+            continue;
+        printf("  player %-3d %6llu   %10.2f %6.2f   %10.2f %6.2f   %6zu %5zu %9zu\n", (int)c->player.id.n,
+               (unsigned long long)c->rtt.srtt,
+               ms(latency_percentile(c->latency.queue, 50)),
+               ms(latency_percentile(c->latency.queue, 99)),
+               ms(latency_percentile(c->latency.input, 50)),
+               ms(latency_percentile(c->latency.input, 99)),
+               jitter_buffered(c), c->jitter.depth, c->jitter.underruns);
+        latency_clear(c);
+        jitter_clear(c);
+    }
+}
+
 static void print_stats() {
     float tall  = 100.0 * (float)get(TIMER_TOTAL)    / STAT_INTERVAL;
     float trecv = 100.0 * (float)get(TIMER_RECV)     / STAT_INTERVAL;
@@ -73,6 +107,18 @@ static void print_stats() {
     unsigned int crecv = (unsigned int)get(COUNTER_RECV) / STAT_S;
     unsigned int csend = (unsigned int)get(COUNTER_SEND) / STAT_S;
     unsigned int crtx  = (unsigned int)get(COUNTER_RESEND) / STAT_S;
+    unsigned int brecv = (unsigned int)get(COUNTER_RECV_BYTES) / STAT_S;
+    unsigned int bsend = (unsigned int)get(COUNTER_SEND_BYTES) / STAT_S;
+    unsigned int cpace = (unsigned int)get(COUNTER_PACED) / STAT_S;
+    unsigned int cdrop = (unsigned int)get(COUNTER_DROPPED) / STAT_S;
+    unsigned int cover = (unsigned int)get(COUNTER_OVERRUN) / STAT_S;
+    unsigned int csys  = (unsigned int)get(COUNTER_SYSCALLS) / STAT_S;
+    unsigned int cfilt = (unsigned int)get(COUNTER_FILTERED) / STAT_S;
+    unsigned int mevnt = (unsigned int)get(COUNTER_EVENTS) / STAT_S;
+    unsigned int mqueu = (unsigned int)get(COUNTER_QUEUED) / STAT_S;
+    unsigned int mpack = (unsigned int)get(COUNTER_PACKED) / STAT_S;
+    unsigned int bhead = (unsigned int)get(COUNTER_HEADER_BYTES) / STAT_S;
+    unsigned int rate  = get(COUNTER_RATE_CLIENTS) ? (unsigned int)(get(COUNTER_RATE) / get(COUNTER_RATE_CLIENTS)) : 0;
 
     printf("--- statistics ---\n");
     printf("cpu         %3.1f%%\n", tall);
@@ -84,13 +130,61 @@ static void print_stats() {
     printf("  recv     %4d\n", crecv);
     printf("  send     %4d\n", csend);
     printf("  resend   %4d\n", crtx);
+    printf("  paced    %4d\n", cpace);
+    printf("  dropped  %4d\n", cdrop);
+    printf("  overrun  %4d  (full shards)\n", cover);
+    printf("  syscalls %4d\n", csys);
+    printf("  filtered %4d  (unknown senders over their rate)\n", cfilt);
+    printf("io (bytes/s)\n");
+    printf("  recv     %6d\n", brecv);
+    printf("  send     %6d\n", bsend);
+    printf("  rate     %6d  (average per client)\n", rate);
+    printf("  headers  %6d  (of the packets and messages)\n", bhead);
+    printf("messages (per second)\n");
+    printf("  events   %4d  (adds, removes and collisions)\n", mevnt);
+    printf("  queued   %4d\n", mqueu);
+    printf("  packed   %4d\n", mpack);
+    print_latencies();
     printf("objects\n");
     printf("  client   %4ld\n", pool_nused(&server->clients));
     printf("  entities %4ld\n", pool_nused(&server->entities));
     printf("  queue    %4ld\n", pool_nused(&server->queue));
+    printf("  transfer %4ld\n", pool_nused(&server->transfers));
     printf("\n");
 }
 
+/* watch the server socket, unless shards receive the packets */
+static void poll_init() {
+    struct epoll_event ev;
+    int fd = server_fd();
+    if(fd < 0) return;
+
+    poller = epoll_create1(0);
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    if(poller >= 0 && epoll_ctl(poller, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        close(poller);
+        poller = -1;
+    }
+}
+
+/* receive packets as they arrive, at most until deadline */
+static void poll_wait(Clock deadline) {
+    struct epoll_event ev;
+    Clock t = clock_get();
+    int timeout = deadline > t ? (int)((deadline - t + MS - 1) / MS) : 0;
+
+    if(poller < 0) {
+        /* packets are received by the next update */
+        usleep(min(PACE_INTERVAL, deadline > t ? deadline - t : 0));
+        return;
+    }
+
+    /* emulated packets are due at the deadline, not when they arrive */
+    if(epoll_wait(poller, &ev, 1, timeout) > 0 || emulate)
+        server_receive(clock_get()/MS);
+}
+
 int main(int argc, char *argv[]) {
     int i;
     for(i=1; i<argc; i++) {
@@ -98,17 +192,42 @@ int main(int argc, char *argv[]) {
             visual = 1;
         else if(!strcmp(argv[i], "-stats"))
             stats = 1;
+        else if(!strcmp(argv[i], "-shards") && i+1 < argc)
+            shards = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-uring"))
+            uring = 1;
+        else if(!strcmp(argv[i], "-rev") && i+1 < argc) {
+            if(!server_revision((unsigned int)atoi(argv[++i]))) {
+                fprintf(stderr, "unknown revision %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "-relay") && i+1 < argc) {
+            if(!server_relay(argv[++i])) {
+                fprintf(stderr, "invalid relay address %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if(!strcmp(argv[i], "-netem") && i+1 < argc) {
+            emulate = 1;
+            if(!server_emulate(argv[++i])) {
+                fprintf(stderr, "invalid network conditions %s\n", argv[i]);
+                return 1;
+            }
+        }
     }
 
     server_log_callbacks(_log);
     server_performance_callbacks(perf);
+    server_io_uring(uring);
 
-    if(!server_init(DEFAULT_PORT)) return 1;
+    if(!server_init_sharded(DEFAULT_PORT, shards)) return 1;
 
     if(visual) {
         if(!visualization_init()) return 1;
     }
 
+    poll_init();
     periodic = clock_get();
 
     for(;;) {
@@ -123,8 +242,14 @@ int main(int argc, char *argv[]) {
         }
         Clock t1 = clock_get();
 
-        if(t1 - t0 < FRAME_INTERVAL) {
-            usleep(FRAME_INTERVAL - (t1 - t0));
+        /* until the next frame, input is handled as soon as it arrives
+         * and packets are released when the rate of their client allows
+         */
+        while(t1 - t0 < FRAME_INTERVAL) {
+            Clock deadline = server_deadline() * MS;
+            poll_wait(deadline ? min(t0 + FRAME_INTERVAL, deadline) : t0 + FRAME_INTERVAL);
+            t1 = clock_get();
+            server_pace(t1/MS);
         }
 
         if(stats && t1 - periodic > STAT_INTERVAL) {
@@ -139,6 +264,8 @@ int main(int argc, char *argv[]) {
     if(visual) {
         visualization_shutdown();
     }
+    if(poller >= 0)
+        close(poller);
     server_shutdown();
 
     return 0;
@@ -0,0 +1,178 @@
+#include "types.h"
+
+#include "config.h"
+#include "connection.h"
+#include "log.h"
+#include "packet.h"
+#include "performance.h"
+#include "server_export.h"
+#include "server.h"
+#include "shard.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Ingest benchmark: floods the server port on the loopback interface
+ * from a number of sender threads, each with its own socket and thus its
+ * own source port, and reports how many datagrams per second the server
+ * thread takes in with 1, 2, 4 and 8 shards (see shard.c). Each sender
+ * stands for a client, the kernel steers it to one of the shards.
+ *
+ * usage: ingest [-shards n] [-senders n] [-size n] [-duration s] [-port n]
+ *
+ * Without -shards, all four shard counts are measured in turn.
+ */
+
+enum {
+    S  = 1000000,
+    MAX_SENDERS = 64,
+};
+
+typedef struct Sender Sender;
+struct Sender {
+    pthread_t thread;
+    int       socket;
+    size_t    sent;
+};
+
+static Sender senders[MAX_SENDERS];
+static size_t nsenders = 16;
+static size_t size     = 64;
+static size_t duration = 3;
+static unsigned short port = DEFAULT_PORT + 1;
+
+static int sending;
+static size_t overrun;
+
+static uint64_t now() {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    return (uint64_t)tp.tv_sec * S + (uint64_t)tp.tv_nsec / 1000;
+}
+
+static void counted(unsigned int counter, unsigned int value) {
+    if(counter == COUNTER_OVERRUN)
+        overrun += value;
+}
+
+static void quiet(const char *msg) {}
+static void eputs(const char *msg) { fputs(msg,stderr); fputs("\n",stderr); }
+static void die  (const char *msg) { eputs(msg); exit(1); }
+
+static LogCallbacks _log = { die, eputs, eputs, quiet, quiet, };
+static PerformanceCallbacks perf = { 0, 0, counted };
+
+static void *send_run(void *p) {
+    Sender *s = (Sender*)p;
+    struct sockaddr_in6 to;
+    char buf[MAX_PACKET_LENGTH];
+
+    memset(buf, 0, sizeof(buf));
+    memset(&to, 0, sizeof(to));
+    to.sin6_family = AF_INET6;
+    to.sin6_addr   = in6addr_loopback;
+    to.sin6_port   = htons(port);
+
+    while(__atomic_load_n(&sending, __ATOMIC_RELAXED)) {
+        if(sendto(s->socket, buf, size, 0, (struct sockaddr*)&to, sizeof(to)) == (ssize_t)size)
+            s->sent ++;
+    }
+    return 0;
+}
+
+static void run(size_t nshards) {
+    Connection conn;
+    Packet p;
+    size_t i, received = 0, bytes = 0, sent = 0;
+    uint64_t t0, t1, end;
+
+    if(!conn_init(&conn) || !shards_init(&conn, nshards, port))
+        log_die("unable to open port %d", port);
+
+    overrun = 0;
+    __atomic_store_n(&sending, 1, __ATOMIC_RELAXED);
+    for(i=0; i<nsenders; i++) {
+        Sender *s = &senders[i];
+        s->sent   = 0;
+        s->socket = socket(PF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+        if(s->socket < 0 || pthread_create(&s->thread, 0, send_run, s) != 0)
+            log_die("unable to start sender %zu", i);
+    }
+
+    t0  = now();
+    end = t0 + duration * S;
+    for(t1 = t0; t1 < end; t1 = now()) {
+        /* the same path as packet_recv */
+        p.end = MAX_PACKET_LENGTH;
+        if(shards_active()) shards_recv(p.p, &p.end, &p.adr);
+        else                conn_recv(&conn, p.p, &p.end, &p.adr);
+
+        if(p.end) {
+            received ++;
+            bytes += p.end;
+        } else {
+            /* an idle server would update or sleep here */
+            sched_yield();
+        }
+    }
+
+    __atomic_store_n(&sending, 0, __ATOMIC_RELAXED);
+    for(i=0; i<nsenders; i++) {
+        pthread_join(senders[i].thread, 0);
+        close(senders[i].socket);
+        sent += senders[i].sent;
+    }
+
+    shards_shutdown();
+    conn_shutdown(&conn);
+
+    printf("%6zu %12.0f %12.0f %10.1f %12.0f\n", nshards,
+           (double)sent * S / (t1 - t0),
+           (double)received * S / (t1 - t0),
+           (double)bytes * 8 / (t1 - t0),
+           (double)overrun * S / (t1 - t0));
+}
+
+int main(int argc, char *argv[]) {
+    size_t shards = 0;
+    int i;
+
+    for(i=1; i+1<argc; i+=2) {
+        const char *arg = argv[i];
+        const char *val = argv[i+1];
+        if(!strcmp(arg, "-shards"))        shards   = (size_t)atoi(val);
+        else if(!strcmp(arg, "-senders")) nsenders = (size_t)atoi(val);
+        else if(!strcmp(arg, "-size"))     size     = (size_t)atoi(val);
+        else if(!strcmp(arg, "-duration")) duration = (size_t)atoi(val);
+        else if(!strcmp(arg, "-port"))     port     = (unsigned short)atoi(val);
+        else log_die("unknown option %s", arg);
+    }
+    if(nsenders < 1 || nsenders > MAX_SENDERS || size < 1 || size > MAX_PACKET_LENGTH)
+        log_die("invalid number of senders or size");
+
+    server_log_callbacks(_log);
+    server_performance_callbacks(perf);
+
+    printf("%zu senders, %zu byte datagrams, %zu s per run, %ld cores\n",
+           nsenders, size, duration, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%6s %12s %12s %10s %12s\n", "shards", "sent/s", "received/s", "Mbit/s", "overrun/s");
+
+    if(shards) {
+        run(shards);
+    } else {
+        run(1);
+        run(2);
+        run(4);
+        run(8);
+    }
+    return 0;
+}
@@ -0,0 +1,861 @@
+#include "types.h"
+
+#include "config.h"
+#include "connection.h"
+#include "entity.h"
+#include "log.h"
+#include "message.h"
+#include "pack.h"
+#include "packet.h"
+#include "server_export.h"
+#include "server.h"
+#include "snapshot.h"
+#include "templates.h"
+#include "unpack.h"
+#include "update.h"
+
+#include <arpa/inet.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Load generator: connects a number of simulated players to a server
+ * and reports the downstream traffic each of them receives.
+ *
+ * usage: loadgen [-host ip] [-port n] [-clients n] [-rev n] [-duration s] [-seed n]
+ *                [-mtu n] [-path n] [-loss n] [-chat n] [-flood n] [-netem spec]
+ *                [-interval ms]
+ *
+ * The bots announce NETWORK_REVISION unless -rev is given. The server only
+ * accepts the revisions after CLIENT_REVISION if it has been told to,
+ * e.g. by "dedicated -rev 39".
+ * -mtu announces the largest packet the bots can receive (revision 31),
+ * -path drops all received packets that are larger, to simulate a path
+ * with a smaller MTU, and -loss drops the given percentage of them.
+ * -chat makes every bot send a chat message and change its name every
+ * n inputs, which lets a long run check the string memory of the server.
+ * The chat messages carry the time they were first sent, so the bots
+ * report the delay from one bot through the server to the others, which
+ * includes the retransmissions of both reliable paths.
+ * The total reports how long the bots took from their first connect
+ * until they were synced, which is streamed from revision 37 on.
+ * -flood additionally sends n connects per second without a cookie
+ * (revision 33) from FLOOD_SOCKETS other ports, like a spoofing attacker
+ * that never receives the replies of the server. The connects announce
+ * the revision of -rev, so -rev 28 floods with connects that the server
+ * cannot ask for a cookie.
+ * -netem emulates a network path under the socket of every bot, see
+ * netem.h for the spec, e.g. "latency=50,jitter=10,loss=2,reorder=5".
+ * -interval sends the inputs every ms milliseconds instead of every
+ * INPUT_INTERVAL, like a client that rounds its frames to those it renders.
+ */
+
+enum {
+    S  = 1000000,
+    MS = 1000,
+    MAX_BOTS       = 256,
+    FRAME_INTERVAL = INPUT_INTERVAL * MS, /* of the bots by default, as in config.h */
+    RESEND_INTERVAL= 500 * MS,
+    STAT_INTERVAL  = S,
+    FLOOD_SOCKETS  = 64,
+    CHAT_RESEND    = 100 * MS,
+    OUTBOX         = 16,
+};
+
+/* chat and name messages that wait for the ack of the server */
+typedef struct Chat Chat;
+struct Chat {
+    size_t   seqno;            /* of the chat, the name follows it */
+    uint32_t frameno;
+    Clock    sent, last_tx;
+};
+
+typedef struct Bot Bot;
+struct Bot {
+    Connection conn;
+    Address    adr;
+
+    bool     synced;
+    Id       player_id;
+    uint32_t rnd;
+
+    /* reliable channels (revision 36), older revisions only use the first */
+    size_t   next_reliable[CHANNELS];    /* next outgoing reliable seqno */
+    size_t   last_in_reliable[CHANNELS]; /* ack for the server */
+    uint32_t sack[CHANNELS];             /* received reliable seqnos after a gap */
+    size_t   last_in_ack[CHANNELS];      /* acknowledged by the server */
+    bool     ack[CHANNELS];              /* a ChannelAck is due */
+    size_t   seqno_connect, seqno_mtu, seqno_select; /* resent explicitly */
+
+    /* the world that is streamed while joining (revision 37), see transfer.c */
+    char     world[TRANSFER_LENGTH];
+    size_t   world_len;
+    uint32_t chunks[(TRANSFER_CHUNKS + 31) / 32]; /* received chunks */
+    size_t   chunks_next;      /* all chunks before it have been received */
+    size_t   chunk_count;
+    bool     chunk_ack;        /* a ChunkAck is due */
+    Clock    started, joined;  /* first connect and synced */
+    size_t   next_unreliable;  /* next outgoing unreliable seqno */
+    bool     compact;          /* the server sends compact headers (revision 38) */
+    uint32_t frameno;
+
+    /* delta snapshot that is currently being received */
+    uint32_t snapshot;
+    unsigned parts;
+    int      last_part;
+    uint32_t complete;         /* last complete snapshot, to be acknowledged */
+    uint32_t cookie;           /* echoed with connect, see ingress.c */
+    bool     has_cookie;
+
+    Clock    last_tx;
+
+    Chat     outbox[OUTBOX];
+    size_t   nout;
+
+    size_t   bytes_in, packets_in, bytes_out;
+    size_t   reliable_in, dups_in;
+    size_t   held_in;          /* state messages that arrived after a gap in their channel */
+    size_t   events_in;        /* adds, removes and collisions, batched or not */
+    Clock    chat_delay, chat_max;  /* of the chat messages received */
+    size_t   chats_in;
+};
+
+static Bot bots[MAX_BOTS];
+static size_t nbots = 7;
+static uint8_t rev = NETWORK_REVISION;
+static size_t mtu  = MAX_PACKET_LENGTH;
+static size_t path = MAX_PACKET_LENGTH;
+static unsigned loss = 0;
+static unsigned chat = 0;
+static unsigned flood = 0;
+static const char *netem = "";
+static Clock interval = FRAME_INTERVAL;
+static Connection flooders[FLOOD_SOCKETS];
+
+static Clock base;
+
+/* time in microseconds since start */
+static Clock clock_get() {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    Clock now = (Clock)tp.tv_sec * S + tp.tv_nsec / 1000;
+    if(!base) base = now;
+    return now - base;
+}
+
+static void iputs(const char *msg) { fputs(msg,stdout); fputs("\n",stdout); fflush(stdout); }
+static void eputs(const char *msg) { fputs(msg,stderr); fputs("\n",stderr); fflush(stderr); }
+static void die  (const char *msg) { fputs(msg,stderr); fputs("\n",stderr); fflush(stderr); exit(1); };
+
+static LogCallbacks _log = { die, eputs, eputs, iputs, eputs, };
+
+static uint32_t bot_rand(Bot *b) {
+    b->rnd = b->rnd * 1103515245 + 12345;
+    return (b->rnd >> 16) & 0x7fff;
+}
+
+static Format *formats[] = {
+    &format_pos_rot, &format_pos, &format_ray, &format_circle, &format_ship,
+};
+
+static Format *format_for(uint8_t type) {
+    size_t i;
+    for(i=0; i<sizeof(formats)/sizeof(formats[0]); i++) {
+        if(formats[i]->type == type)
+            return formats[i];
+    }
+    return 0;
+}
+
+static size_t channel(MessageType type) {
+    return message_channel(type, rev);
+}
+
+static void bot_send(Bot *b, Message *m, size_t n) {
+    Header h;
+    char buf[MAX_PACKET_LENGTH];
+    size_t i, k=0;
+
+    /* compact headers once the server has shown that it knows them,
+     * the unreliable messages share the frame of the packet
+     */
+    h.app_id = b->compact ? APP_ID_COMPACT : APP_ID;
+    h.ack    = b->last_in_reliable[CHANNEL_STATE];
+    h.frame  = (uint32_t)b->next_unreliable;
+    h.time   = (uint32_t)(clock_get() / 1000);
+    k += header_pack(buf+k, &h);
+    for(i=0; i<n; i++) {
+        if(!m[i].seqno && is_reliable(&m[i]))
+            m[i].seqno = b->next_reliable[channel(m[i].type)]++;
+        else if(!m[i].seqno)
+            m[i].seqno = b->compact ? h.frame : b->next_unreliable++;
+        k += message_header_pack(buf+k, &m[i], &h);
+        k += message_body_pack(buf+k, &m[i]);
+    }
+    if(b->compact)
+        b->next_unreliable ++;
+
+    if(!conn_send(&b->conn, buf, k, &b->adr))
+        log_die("sending failed");
+    b->bytes_out += k;
+}
+
+static void bot_connect(Bot *b) {
+    Message m[3], *c = m;
+    memset(m, 0, sizeof(m));
+    if(b->has_cookie) {
+        c->type = MESSAGE_COOKIE;
+        c->cookie.value = b->cookie;
+        c ++;
+    }
+    c[0].type  = MESSAGE_CONNECT;
+    c[0].seqno = b->seqno_connect;
+    c[0].connect.rev = rev;
+    c[0].connect.nick.s = "loadgen";
+    c[0].connect.nick.n = strlen(c[0].connect.nick.s);
+    c[1].type  = MESSAGE_MTU;
+    c[1].seqno = b->seqno_mtu;
+    c[1].mtu.size = mtu;
+    bot_send(b, m, (size_t)(c - m) + (rev >= REVISION_MTU ? 2 : 1));
+}
+
+static void bot_select(Bot *b) {
+    Message m;
+    memset(&m, 0, sizeof(m));
+    m.type  = MESSAGE_SELECTION;
+    m.seqno = b->seqno_select;
+    m.selection.player_id    = b->player_id;
+    m.selection.ship_type    = ENTITY_TYPE_SHIP;
+    m.selection.weapon_type1 = ENTITY_TYPE_GUN;
+    m.selection.weapon_type2 = ENTITY_TYPE_PHASER;
+    m.selection.weapon_type3 = ENTITY_TYPE_ROCKETLAUNCHER;
+    m.selection.weapon_type4 = ENTITY_TYPE_GUN;
+    bot_send(b, &m, 1);
+}
+
+static void bot_input(Bot *b) {
+    Message m[3 + CHANNELS];
+    size_t i, n = 1;
+    uint32_t r = bot_rand(b);
+
+    memset(m, 0, sizeof(m));
+    m[0].type = MESSAGE_INPUT;
+    m[0].input.player_id  = b->player_id;
+    m[0].input.frameno    = ++b->frameno;
+    m[0].input.forwards   = (r & 3) ? 0xff : 0;
+    m[0].input.strafe_left= (r & 4) ? 0xff : 0;
+    m[0].input.fire1      = (r & 8) ? 0xff : 0;
+    m[0].input.fire2      = (r & 16) ? 0xff : 0;
+    m[0].input.aim_x      = (int16_t)(bot_rand(b) % 2000) - 1000;
+    m[0].input.aim_y      = (int16_t)(bot_rand(b) % 2000) - 1000;
+
+    if(rev >= REVISION_DELTA && b->complete) {
+        m[n].type = MESSAGE_DELTA_ACK;
+        m[n].delta_ack.snapshot = b->complete;
+        n ++;
+    }
+
+    if(rev >= REVISION_SACK && b->sack[CHANNEL_STATE]) {
+        m[n].type = MESSAGE_SACK;
+        m[n].sack.ack  = b->last_in_reliable[CHANNEL_STATE];
+        m[n].sack.mask = b->sack[CHANNEL_STATE];
+        n ++;
+    }
+
+    /* the other channels are not acknowledged in the header */
+    for(i=CHANNEL_STATE+1; i<CHANNELS; i++) {
+        if(!b->ack[i])
+            continue;
+        m[n].type = MESSAGE_CHANNEL_ACK;
+        m[n].channel_ack.channel = (uint8_t)i;
+        m[n].channel_ack.ack     = b->last_in_reliable[i];
+        m[n].channel_ack.mask    = b->sack[i];
+        b->ack[i] = false;
+        n ++;
+    }
+
+    bot_send(b, m, n);
+}
+
+/* Without selective acknowledgements, only the next reliable message of
+ * a channel is accepted. Otherwise later ones are accepted as well and
+ * remembered in b->sack, where bit i stands for seqno last_in_reliable+2+i.
+ * A client that processes the messages in order would have to hold them
+ * back until the gap is filled, which is counted for CHANNEL_STATE.
+ */
+static bool bot_reliable(Bot *b, size_t ch, size_t seqno) {
+    size_t i;
+
+    b->reliable_in ++;
+    b->ack[ch] = true;
+    if(seqno <= b->last_in_reliable[ch]) {
+        b->dups_in ++;
+        return false;
+    }
+
+    if(seqno == b->last_in_reliable[ch] + 1) {
+        b->last_in_reliable[ch] = seqno;
+        for(; b->sack[ch] & 1; b->sack[ch] >>= 1)
+            b->last_in_reliable[ch] ++;
+        b->sack[ch] >>= 1;
+        return true;
+    }
+
+    i = seqno - b->last_in_reliable[ch] - 2;
+    if(rev < REVISION_SACK || i >= 32)
+        return false;
+    if(b->sack[ch] & (1u << i)) {
+        b->dups_in ++;
+        return false;
+    }
+    b->sack[ch] |= 1u << i;
+    if(ch == CHANNEL_STATE)
+        b->held_in ++;
+    return true;
+}
+
+static void bot_delta(Bot *b, Packet *p, Message *m) {
+    Format *f = format_for(m->delta.format);
+    Delta d;
+    size_t i;
+    unsigned part = m->delta.part & ~DELTA_LAST;
+
+    if(!f) return;
+
+    d.fields = f->fields;
+    d.base   = 0;
+    if(rev >= REVISION_BITPACK) {
+        BitStream bs;
+        uint16_t prev = 0;
+        bits_init(&bs, p->p + p->start, p->end - p->start);
+        for(i=0; i<m->delta.n; i++)
+            delta_read(&bs, &d, &prev);
+        if(bs.overflow)
+            return;
+        p->start += bits_bytes(&bs);
+    } else {
+        for(i=0; i<m->delta.n; i++) {
+            if(!packet_get(p, delta_unpack, &d))
+                return;
+        }
+    }
+
+    if(m->delta.snapshot < b->snapshot)
+        return;
+    if(m->delta.snapshot > b->snapshot) {
+        b->snapshot  = m->delta.snapshot;
+        b->parts     = 0;
+        b->last_part = -1;
+    }
+
+    b->parts ++;
+    if(m->delta.part & DELTA_LAST)
+        b->last_part = part;
+    if(b->last_part >= 0 && b->parts == (unsigned)b->last_part + 1)
+        b->complete = b->snapshot;
+}
+
+static void bot_synced(Bot *b, Id player_id, Clock now) {
+    b->synced    = true;
+    b->player_id = player_id;
+    b->joined    = now;
+    bot_select(b);
+}
+
+#define chunk_word(b,i) (b)->chunks[(i) / 32]
+#define chunk_bit(i)    ((uint32_t)1 << ((i) % 32))
+
+/* the messages of the complete world, as if they had arrived in order */
+static void bot_world(Bot *b) {
+    static Message events[UINT8_MAX];
+    Message m;
+    size_t i = 0, k, size;
+
+    while(i < b->world_len) {
+        k = message_unpack(b->world + i, b->world_len - i, &m);
+        if(!k) return;
+        i += k;
+
+        if(is_batched(&m)) {
+            if(!events_unpack(b->world + i, b->world_len - i, &m, events, &size))
+                return;
+            i += size;
+            b->events_in += m.events.n;
+        } else if(m.type == MESSAGE_SYNCED && !b->synced) {
+            bot_synced(b, m.synced.player_id, clock_get());
+        }
+    }
+}
+
+static void bot_chunk(Bot *b, Message *m, const char *s) {
+    size_t i = m->chunk.index;
+
+    /* acknowledged even if it is a duplicate, the ack may have been lost */
+    b->chunk_ack = true;
+    if(   b->synced || m->chunk.count > TRANSFER_CHUNKS || i >= m->chunk.count
+       || m->chunk.len > TRANSFER_CHUNK || (chunk_word(b,i) & chunk_bit(i)))
+        return;
+
+    memcpy(b->world + i * TRANSFER_CHUNK, s, m->chunk.len);
+    chunk_word(b,i) |= chunk_bit(i);
+    b->chunk_count = m->chunk.count;
+    if(i + 1 == m->chunk.count)
+        b->world_len = i * TRANSFER_CHUNK + m->chunk.len;
+
+    while(b->chunks_next < b->chunk_count && (chunk_word(b,b->chunks_next) & chunk_bit(b->chunks_next)))
+        b->chunks_next ++;
+    if(b->chunks_next == b->chunk_count)
+        bot_world(b);
+}
+
+static void bot_chunk_ack(Bot *b) {
+    Message m;
+    size_t i, j;
+
+    memset(&m, 0, sizeof(m));
+    m.type = MESSAGE_CHUNK_ACK;
+    m.chunk_ack.next = (uint16_t)b->chunks_next;
+    for(i=0; i<32; i++) {
+        j = b->chunks_next + 1 + i;
+        if(j < b->chunk_count && (chunk_word(b,j) & chunk_bit(j)))
+            m.chunk_ack.mask |= (uint32_t)1 << i;
+    }
+    bot_send(b, &m, 1);
+    b->chunk_ack = false;
+}
+
+static void bot_chat_recv(Bot *b, Str *msg) {
+    char buf[32];
+    unsigned long long sent;
+    Clock now = clock_get();
+
+    if(msg->n >= sizeof(buf)) return;
+    memcpy(buf, msg->s, msg->n);
+    buf[msg->n] = 0;
+    if(sscanf(buf, "message %*u %llu", &sent) != 1 || sent > now)
+        return;
+
+    b->chat_delay += now - sent;
+    b->chat_max    = max(b->chat_max, now - sent);
+    b->chats_in ++;
+}
+
+/* the next message of p, see stream.c */
+static bool message_get(Packet *p, Header *h, Message *m) {
+    size_t n;
+
+    if(p->start == p->end)
+        return false;
+    n = message_unpack_in(p->p + p->start, p->end - p->start, m, h);
+    if(!n || p->start + n > p->end)
+        return false;
+    p->start += n;
+    return true;
+}
+
+static void bot_handle(Bot *b, Packet *p) {
+    static Message events[UINT8_MAX];
+    Header h;
+    Message m;
+    size_t size;
+
+    /* strings are decoded into the arena of the library */
+    arena_reset(&server->scratch);
+
+    if(!packet_get(p, header_unpack, &h))
+        return;
+    if(h.app_id == APP_ID_COMPACT)
+        b->compact = rev >= REVISION_COMPACT;
+    else if(h.app_id != APP_ID)
+        return;
+    b->last_in_ack[CHANNEL_STATE] = h.ack;
+
+    while(message_get(p, &h, &m)) {
+        /* the records of a batch follow it, and are skipped with it */
+        if(is_batched(&m)) {
+            if(!events_unpack(p->p + p->start, p->end - p->start, &m, events, &size))
+                return;
+            p->start += size;
+            b->events_in += m.events.n;
+        } else if(message_batched(m.type)) {
+            b->events_in ++;
+        }
+
+        if(is_reliable(&m)) {
+            bool next = bot_reliable(b, channel(m.type), m.seqno);
+
+            switch(m.type) {
+            case MESSAGE_SYNCED:
+                if(next && !b->synced)
+                    bot_synced(b, m.synced.player_id, clock_get());
+                break;
+            case MESSAGE_CHAT:
+                if(next)
+                    bot_chat_recv(b, &m.chat.msg);
+                break;
+            default:
+                break;
+            }
+        } else if(is_update(&m)) {
+            Format *f = format_for(m.type);
+            if(!f) return;
+
+            /* skip records */
+            p->start += m.update.n * f->len;
+            if(p->start > p->end)
+                return;
+        } else if(m.type == MESSAGE_DELTA) {
+            bot_delta(b, p, &m);
+        } else if(m.type == MESSAGE_CHUNK) {
+            if(p->start + m.chunk.len > p->end)
+                return;
+            bot_chunk(b, &m, p->p + p->start);
+            p->start += m.chunk.len;
+        } else if(m.type == MESSAGE_MTU_PROBE) {
+            Message r;
+            memset(&r, 0, sizeof(r));
+            r.type = MESSAGE_MTU_ACK;
+            r.mtu_ack.size = m.mtu_probe.size;
+            bot_send(b, &r, 1);
+        } else if(m.type == MESSAGE_CHANNEL_ACK) {
+            if(m.channel_ack.channel < CHANNELS)
+                b->last_in_ack[m.channel_ack.channel] = max(b->last_in_ack[m.channel_ack.channel], (size_t)m.channel_ack.ack);
+        } else if(m.type == MESSAGE_COOKIE) {
+            /* the connect is not acknowledged, resend it right away */
+            b->cookie     = m.cookie.value;
+            b->has_cookie = true;
+            if(!b->synced)
+                bot_connect(b);
+        } else if(m.type == MESSAGE_REJECT) {
+            log_die("connection rejected");
+        }
+    }
+
+    if(b->chunk_ack)
+        bot_chunk_ack(b);
+}
+
+static void bot_recv(Bot *b) {
+    Packet p;
+
+    for(;;) {
+        packet_init_recv(&p);
+        p.end = MAX_PACKET_LENGTH;
+        if(!conn_recv(&b->conn, p.p, &p.end, &p.adr))
+            log_die("receiving failed");
+        if(p.end == 0) /* EAGAIN */
+            break;
+        if(p.end > path || (unsigned)(rand() % 100) < loss)
+            continue;
+
+        b->bytes_in += p.end;
+        b->packets_in ++;
+        bot_handle(b, &p);
+    }
+}
+
+static void bot_chat_send(Bot *b, Chat *c) {
+    Message m[2];
+    char msg[32], nick[16];
+
+    memset(m, 0, sizeof(m));
+    snprintf(msg,  sizeof(msg),  "message %u %llu", c->frameno, (unsigned long long)c->sent);
+    snprintf(nick, sizeof(nick), "bot %u", c->frameno % 97);
+    m[0].type  = MESSAGE_CHAT;
+    m[0].seqno = c->seqno;
+    m[0].chat.player_id = b->player_id;
+    m[0].chat.msg.s = msg;
+    m[0].chat.msg.n = strlen(msg);
+    m[1].type  = MESSAGE_NAME;
+    m[1].seqno = c->seqno + 1;
+    m[1].name.player_id = b->player_id;
+    m[1].name.nick.s = nick;
+    m[1].name.nick.n = strlen(nick);
+    bot_send(b, m, 2);
+}
+
+/* once the selection has arrived, the seqnos of further reliable
+ * messages follow it, they are kept in the outbox until they are
+ * acknowledged and resent every CHAT_RESEND
+ */
+static void bot_chat(Bot *b, Clock now) {
+    Chat *c;
+
+    if(b->nout == OUTBOX)
+        return;
+
+    c = &b->outbox[b->nout ++];
+    c->seqno   = b->next_reliable[channel(MESSAGE_CHAT)];
+    c->frameno = b->frameno;
+    c->sent    = c->last_tx = now;
+    b->next_reliable[channel(MESSAGE_CHAT)] += 2; /* chat and name */
+    bot_chat_send(b, c);
+}
+
+static void bot_resend(Bot *b, Clock now) {
+    size_t i, n = 0;
+
+    for(i=0; i<b->nout; i++) {
+        Chat *c = &b->outbox[i];
+        if(c->seqno + 1 <= b->last_in_ack[channel(MESSAGE_CHAT)])
+            continue;
+        if(now - c->last_tx > CHAT_RESEND) {
+            c->last_tx = now;
+            bot_chat_send(b, c);
+        }
+        b->outbox[n++] = *c;
+    }
+    b->nout = n;
+}
+
+static bool selected(Bot *b) {
+    return b->last_in_ack[channel(MESSAGE_SELECTION)] >= b->seqno_select;
+}
+
+static void bot_update(Bot *b, Clock now) {
+    bot_recv(b);
+
+    if(!b->synced) {
+        if(now - b->last_tx > RESEND_INTERVAL) {
+            if(!b->started)
+                b->started = now;
+            b->last_tx = now;
+            bot_connect(b);
+        }
+    } else {
+        if(!selected(b) && now - b->last_tx > RESEND_INTERVAL) {
+            b->last_tx = now;
+            bot_select(b);
+        }
+        bot_input(b);
+        bot_resend(b, now);
+        if(chat && selected(b) && b->frameno % chat == 0)
+            bot_chat(b, now);
+    }
+}
+
+static void bot_init(Bot *b, const char *host, unsigned short port, unsigned seed) {
+    char ip[64];
+    struct in6_addr adr;
+    size_t i;
+
+    memset(b, 0, sizeof(Bot));
+    for(i=0; i<CHANNELS; i++)
+        b->next_reliable[i] = 1;
+    b->seqno_connect   = b->next_reliable[channel(MESSAGE_CONNECT)]++;
+    if(rev >= REVISION_MTU)
+        b->seqno_mtu   = b->next_reliable[channel(MESSAGE_MTU)]++;
+    b->seqno_select    = b->next_reliable[channel(MESSAGE_SELECTION)]++;
+    b->next_unreliable = 1;
+    b->last_part       = -1;
+    b->rnd             = seed;
+
+    if(strchr(host, ':')) snprintf(ip, sizeof(ip), "%s", host);
+    else                  snprintf(ip, sizeof(ip), "::ffff:%s", host);
+    if(inet_pton(AF_INET6, ip, &adr) != 1)
+        log_die("invalid host");
+
+    memcpy(b->adr.ip, &adr, sizeof(b->adr.ip));
+    b->adr.port   = htons(port);
+    b->adr.isIPv6 = true;
+
+    if(!conn_init(&b->conn) || !conn_bind(&b->conn, 0))
+        log_die("unable to create socket");
+
+    /* each bot has its own path */
+    if(*netem) {
+        char spec[256];
+        snprintf(spec, sizeof(spec), "%s,seed=%u", netem, seed);
+        if(!conn_emulate(&b->conn, spec))
+            log_die("invalid network emulation");
+    }
+}
+
+/* connects of the current revision without a cookie, n in total from
+ * all flooders, the replies are never read
+ */
+static void flood_send(Bot *target, size_t n) {
+    static size_t next;
+    Header h;
+    Message m;
+    char buf[MAX_PACKET_LENGTH];
+    size_t i, k;
+
+    memset(&h, 0, sizeof(h));
+    memset(&m, 0, sizeof(m));
+    h.app_id = APP_ID;
+    m.type   = MESSAGE_CONNECT;
+    m.seqno  = 1;
+    m.connect.rev = rev;
+    m.connect.nick.s = "flood";
+    m.connect.nick.n = strlen(m.connect.nick.s);
+    k  = header_pack(buf, &h);
+    k += message_pack(buf+k, &m);
+
+    for(i=0; i<n; i++) {
+        conn_send(&flooders[next], buf, k, &target->adr);
+        next = (next + 1) % FLOOD_SOCKETS;
+    }
+}
+
+static void print_stats(double s, bool total) {
+    size_t i, nsynced = 0;
+    size_t bin = 0, pin = 0, bout = 0, rin = 0, din = 0, hin = 0, cin = 0, ein = 0;
+    Clock delay = 0, delay_max = 0, join = 0, join_max = 0;
+
+    for(i=0; i<nbots; i++) {
+        Bot *b = &bots[i];
+        if(b->synced) {
+            nsynced ++;
+            join    += b->joined - b->started;
+            join_max = max(join_max, b->joined - b->started);
+        }
+        bin  += b->bytes_in;
+        pin  += b->packets_in;
+        bout += b->bytes_out;
+        rin  += b->reliable_in;
+        din  += b->dups_in;
+        hin  += b->held_in;
+        ein  += b->events_in;
+        cin  += b->chats_in;
+        delay += b->chat_delay;
+        delay_max = max(delay_max, b->chat_max);
+        if(!total) {
+            b->bytes_in = b->packets_in = b->bytes_out = b->reliable_in = b->dups_in = b->held_in = b->events_in = 0;
+            b->chats_in = b->chat_delay = b->chat_max = 0;
+        }
+    }
+
+    printf("%s clients %2zu/%2zu  per client: recv %7.0f bytes/s %5.1f packets/s  send %6.0f bytes/s  reliable %5.1f/s (%4.1f dups, %4.1f held)  events %5.1f/s\n",
+           total ? "total " : "      ", nsynced, nbots,
+           bin / s / nbots, pin / s / nbots, bout / s / nbots, rin / s / nbots, din / s / nbots, hin / s / nbots, ein / s / nbots);
+    if(cin)
+        printf("       chat delay %6.1f ms (max %6.1f ms)\n",
+               (double)delay / cin / MS, (double)delay_max / MS);
+    if(total && nsynced)
+        printf("       join %6.1f ms (max %6.1f ms)\n",
+               (double)join / nsynced / MS, (double)join_max / MS);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = "127.0.0.1";
+    unsigned short port = DEFAULT_PORT;
+    unsigned duration = 10;
+    unsigned seed = 1;
+    size_t i;
+    size_t total_in = 0, total_packets = 0, total_out = 0, total_rel = 0, total_dups = 0, total_held = 0, total_events = 0;
+    size_t total_chats = 0;
+    Clock  total_delay = 0, total_max = 0;
+
+    for(i=1; i<(size_t)argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i+1 < (size_t)argc) ? argv[i+1] : 0;
+        if(!val) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return 1;
+        }
+        i ++;
+
+        if(!strcmp(arg, "-host"))          host     = val;
+        else if(!strcmp(arg, "-port"))     port     = atoi(val);
+        else if(!strcmp(arg, "-clients"))  nbots    = atoi(val);
+        else if(!strcmp(arg, "-rev"))      rev      = atoi(val);
+        else if(!strcmp(arg, "-duration")) duration = atoi(val);
+        else if(!strcmp(arg, "-seed"))     seed     = atoi(val);
+        else if(!strcmp(arg, "-mtu"))      mtu      = atoi(val);
+        else if(!strcmp(arg, "-path"))     path     = atoi(val);
+        else if(!strcmp(arg, "-loss"))     loss     = atoi(val);
+        else if(!strcmp(arg, "-chat"))     chat     = atoi(val);
+        else if(!strcmp(arg, "-flood"))    flood    = atoi(val);
+        else if(!strcmp(arg, "-netem"))    netem    = val;
+        else if(!strcmp(arg, "-interval")) interval = (Clock)atoi(val) * MS;
+        else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return 1;
+        }
+    }
+
+    if(nbots < 1 || nbots > MAX_BOTS) {
+        fprintf(stderr, "number of clients must be in 1..%d\n", MAX_BOTS);
+        return 1;
+    }
+
+    server_log_callbacks(_log);
+    arena_dynamic(&server->scratch, MAX_SCRATCH);
+    srand(seed);
+
+    for(i=0; i<nbots; i++)
+        bot_init(&bots[i], host, port, seed + i);
+
+    for(i=0; flood && i<FLOOD_SOCKETS; i++) {
+        if(!conn_init(&flooders[i]) || !conn_bind(&flooders[i], 0))
+            log_die("unable to create socket");
+    }
+
+    Clock start    = clock_get();
+    Clock periodic = start;
+    Clock next     = start;
+
+    while(clock_get() - start < (Clock)duration * S) {
+        Clock now = clock_get();
+
+        if(now >= next) {
+            next += interval;
+            for(i=0; i<nbots; i++)
+                bot_update(&bots[i], now);
+            if(flood)
+                flood_send(&bots[0], (size_t)(flood * interval / S));
+        } else {
+            for(i=0; i<nbots; i++)
+                bot_recv(&bots[i]);
+            usleep(MS);
+        }
+
+        if(now - periodic >= STAT_INTERVAL) {
+            for(i=0; i<nbots; i++) {
+                total_in      += bots[i].bytes_in;
+                total_packets += bots[i].packets_in;
+                total_out     += bots[i].bytes_out;
+                total_rel     += bots[i].reliable_in;
+                total_dups    += bots[i].dups_in;
+                total_held    += bots[i].held_in;
+                total_events  += bots[i].events_in;
+                total_chats   += bots[i].chats_in;
+                total_delay   += bots[i].chat_delay;
+                total_max      = max(total_max, bots[i].chat_max);
+            }
+            print_stats((double)(now - periodic) / S, false);
+            periodic = now;
+        }
+    }
+
+    for(i=0; i<nbots; i++) {
+        Message m;
+        memset(&m, 0, sizeof(m));
+        m.type = MESSAGE_DISCONNECT;
+        bot_send(&bots[i], &m, 1);
+
+        bots[i].bytes_in   = total_in      / nbots;
+        bots[i].packets_in = total_packets / nbots;
+        bots[i].bytes_out  = total_out     / nbots;
+        bots[i].reliable_in = total_rel    / nbots;
+        bots[i].dups_in     = total_dups   / nbots;
+        bots[i].held_in     = total_held   / nbots;
+        bots[i].events_in   = total_events / nbots;
+        bots[i].chats_in    = i ? 0 : total_chats;
+        bots[i].chat_delay  = i ? 0 : total_delay;
+        bots[i].chat_max    = i ? 0 : total_max;
+    }
+    print_stats((double)(periodic - start) / S, true);
+
+    for(i=0; i<nbots; i++)
+        conn_shutdown(&bots[i].conn);
+    for(i=0; flood && i<FLOOD_SOCKETS; i++)
+        conn_shutdown(&flooders[i]);
+
+    return 0;
+}
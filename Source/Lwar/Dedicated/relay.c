@@ -0,0 +1,968 @@
+#include "types.h"
+
+#include "bitstream.h"
+#include "config.h"
+#include "connection.h"
+#include "id.h"
+#include "log.h"
+#include "message.h"
+#include "pack.h"
+#include "packet.h"
+#include "server_export.h"
+#include "server.h"
+#include "snapshot.h"
+#include "uint.h"
+#include "unpack.h"
+#include "update.h"
+
+#include <arpa/inet.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Spectator relay: connects to a game server as a relay (revision 34) and
+ * forwards the match to spectators, which connect to the relay just like
+ * to a server. The game server sends a single stream to the relay however
+ * many spectators watch, and does not announce the relay as a player.
+ * The game server only accepts relays from the addresses it has been
+ * given, e.g. by "dedicated -relay ip", and must accept RELAY_REVISION,
+ * e.g. "dedicated -rev 35".
+ *
+ * usage: relay [-host ip] [-port n] [-listen n] [-delay ms] [-spectators n]
+ *
+ * The relay never acknowledges snapshots, so all update records from the
+ * game server are absolute and need no history to be decoded. The latest
+ * state of each entity is kept in a frame after every update, and a frame
+ * is serialized once into packets of absolute records that all spectators
+ * receive; only the ack in the packet header differs between them.
+ *
+ * The reliable messages from the game server are appended to a log. A
+ * joining spectator first receives a Join for each player, an Add for each
+ * entity and a Synced message, which are kept until they are acknowledged,
+ * and then the log from that point on, with sequence numbers of its own.
+ * -delay holds back frames and reliable messages for the given time, so
+ * that spectators cannot help the players.
+ *
+ * Batched adds, removes and collisions (revision 35) are split up into
+ * single messages, which spectators of all revisions understand.
+ *
+ * The log is a single sequence of reliable messages, so the relay does
+ * not use reliable channels (revision 36): it connects with RELAY_REVISION
+ * and serves spectators up to it.
+ *
+ * Spectators need revision 30 or later (bit-packed records); their
+ * reliable messages are acknowledged but ignored. They receive the id of
+ * the relay's player in their Synced message, which is not a player of the
+ * match.
+ */
+
+enum {
+    S  = 1000000,
+    MS = 1000,
+    MAX_SPECTATORS    = 1024,
+    RELAY_LOG         = 4096, /* reliable messages that are kept for spectators */
+    RELAY_FRAMES      =  512, /* updates that are kept for the delay */
+    RELAY_COLLISIONS  =   32, /* per frame */
+    RELAY_PACKETS     =   96, /* of a serialized frame */
+    SPECTATOR_PACKETS =    4, /* of reliable messages per spectator and update */
+    RESEND_INTERVAL   = 500 * MS,
+    SPECTATOR_RESEND  = RETRANSMIT_INTERVAL * MS,
+    SPECTATOR_TIMEOUT = TIMEOUT_INTERVAL * MS,
+    TICK_INTERVAL     = UPDATE_INTERVAL * MS,
+    STAT_INTERVAL     = S,
+    RELAY_REVISION    = REVISION_CHANNELS - 1,
+};
+
+typedef struct Event Event;
+typedef struct Record Record;
+typedef struct Frame Frame;
+typedef struct Spectator Spectator;
+typedef struct Upstream Upstream;
+
+/* a reliable message of the log with its own copy of the string */
+struct Event {
+    Message m;
+    Clock   at;
+    char    s[MAX_CHAT_LENGTH];
+};
+
+/* latest state of an entity, with the head of its absolute record */
+struct Record {
+    State   state;
+    Format *f;
+    uint8_t head;
+};
+
+struct Frame {
+    Clock    at;
+    size_t   n, cap;
+    Record  *records;
+    size_t   ncollisions;
+    Message  collisions[RELAY_COLLISIONS];
+    bool     has_stats;
+    Message  stats;
+};
+
+struct Spectator {
+    bool     used;
+    Address  adr;
+    size_t   last_in_reliable;   /* its messages, only acknowledged */
+    size_t   last_in_ack;        /* of the seqnos below */
+    size_t   next_out;           /* first seqno that has not been sent yet */
+    Clock    last_activity, last_resend;
+
+    /* seqnos 1..njoin, log entry i has seqno njoin + 1 + i - base */
+    Message *join;
+    char   (*nicks)[MAX_NAME_LENGTH];
+    size_t   njoin;
+    size_t   base;
+};
+
+struct Upstream {
+    Connection conn;
+    Address    adr;
+    bool       synced;
+    Id         player_id;
+    size_t     last_in_reliable; /* in order only, without sacks */
+    size_t     next_unreliable;
+    uint32_t   cookie;
+    bool       has_cookie;
+    bool       updated;          /* a delta has arrived since the last frame */
+    Clock      last_tx;
+};
+
+static Upstream up;
+static Connection conn;
+
+/* the latest states from the game server, indexed by entity */
+static Record  current[MAX_ENTITIES];
+static bool    present[MAX_ENTITIES];
+
+/* players and entities as far as the log has been released */
+static Message players[MAX_CLIENTS];
+static char    nicks[MAX_CLIENTS][MAX_NAME_LENGTH];
+static Message entities[MAX_ENTITIES];
+
+/* log entries log_tail <= i < log_head, up to log_released for spectators */
+static Event  log_events[RELAY_LOG];
+static size_t log_tail, log_released, log_head;
+
+/* frames frame_tail <= i < frame_head */
+static Frame  frames[RELAY_FRAMES];
+static size_t frame_tail, frame_head;
+static uint32_t snapshot;
+
+/* the serialized frame */
+static char   packets[RELAY_PACKETS][MAX_PACKET_LENGTH];
+static size_t sizes[RELAY_PACKETS];
+static size_t npackets;
+static size_t next_unreliable = 1;
+
+static Spectator spectators[MAX_SPECTATORS];
+static size_t max_spectators = MAX_SPECTATORS;
+static size_t nspectators;
+static Clock delay;
+
+static size_t bytes_up, bytes_down, packets_down;
+static Clock  fanout_time, fanout_max;
+static size_t nframes;
+
+static Clock base;
+
+/* time in microseconds since start */
+static Clock clock_get() {
+    struct timespec tp;
+    clock_gettime(CLOCK_MONOTONIC, &tp);
+    Clock now = (Clock)tp.tv_sec * S + tp.tv_nsec / 1000;
+    if(!base) base = now;
+    return now - base;
+}
+
+static void iputs(const char *msg) { fputs(msg,stdout); fputs("\n",stdout); fflush(stdout); }
+static void eputs(const char *msg) { fputs(msg,stderr); fputs("\n",stderr); fflush(stderr); }
+static void die  (const char *msg) { fputs(msg,stderr); fputs("\n",stderr); fflush(stderr); exit(1); };
+
+static LogCallbacks _log = { die, eputs, eputs, iputs, eputs, };
+
+static Format *formats[] = {
+    &format_pos_rot, &format_pos, &format_ray, &format_circle, &format_ship,
+};
+
+static Format *format_for(uint8_t type) {
+    size_t i;
+    for(i=0; i<sizeof(formats)/sizeof(formats[0]); i++) {
+        if(formats[i]->type == type)
+            return formats[i];
+    }
+    return 0;
+}
+
+/* point the string of m to a copy in s */
+static void copy_str(Message *m, char *s, size_t len) {
+    Str *str = message_str(m);
+    if(!str) return;
+    str->n = (unsigned char)min((size_t)str->n, len);
+    memcpy(s, str->s, str->n);
+    str->s = s;
+}
+
+/* game server */
+
+static void up_send(Message *m, size_t n) {
+    Header h;
+    char buf[MAX_PACKET_LENGTH];
+    size_t i, k=0;
+
+    memset(&h, 0, sizeof(h));
+    h.app_id = APP_ID;
+    h.ack    = up.last_in_reliable;
+    k += header_pack(buf+k, &h);
+    for(i=0; i<n; i++) {
+        if(!m[i].seqno)
+            m[i].seqno = up.next_unreliable++;
+        k += message_pack(buf+k, &m[i]);
+    }
+
+    if(!conn_send(&up.conn, buf, k, &up.adr))
+        log_die("sending to the server failed");
+}
+
+static void up_connect() {
+    Message m[4], *c = m;
+    memset(m, 0, sizeof(m));
+    if(up.has_cookie) {
+        c->type = MESSAGE_COOKIE;
+        c->cookie.value = up.cookie;
+        c ++;
+    }
+    c->type = MESSAGE_RELAY;
+    c ++;
+    c[0].type  = MESSAGE_CONNECT;
+    c[0].seqno = 1;
+    c[0].connect.rev = RELAY_REVISION;
+    c[0].connect.nick.s = "relay";
+    c[0].connect.nick.n = strlen(c[0].connect.nick.s);
+    c[1].type  = MESSAGE_MTU;
+    c[1].seqno = 2;
+    c[1].mtu.size = MAX_PACKET_LENGTH;
+    up_send(m, (size_t)(c - m) + 2);
+}
+
+/* keeps the connection alive, the relay never sends input */
+static void up_ack() {
+    Message m;
+    memset(&m, 0, sizeof(m));
+    m.type = MESSAGE_SACK;
+    m.sack.ack  = up.last_in_reliable;
+    m.sack.mask = 0;
+    up_send(&m, 1);
+}
+
+static void log_append(Message *m, Clock now) {
+    Event *e;
+
+    /* spectators that still need the oldest entry are too slow */
+    if(log_head - log_tail == RELAY_LOG) {
+        log_warn("Log is full, dropping the oldest message.");
+        log_tail ++;
+        if(log_released < log_tail)
+            log_released = log_tail;
+    }
+
+    e = &log_events[log_head % RELAY_LOG];
+    e->m  = *m;
+    e->at = now;
+    copy_str(&e->m, e->s, sizeof(e->s));
+    log_head ++;
+}
+
+static void up_reliable(Message *m, Clock now) {
+    switch(m->type) {
+    case MESSAGE_SYNCED:
+        if(!up.synced)
+            log_info("Relaying as player %d.", m->synced.player_id.n);
+        up.synced    = true;
+        up.player_id = m->synced.player_id;
+        return;
+    case MESSAGE_MTU:
+        return;
+    case MESSAGE_REMOVE:
+        /* no more states, its slot may be reused */
+        if(m->remove.entity_id.n < MAX_ENTITIES)
+            present[m->remove.entity_id.n] = false;
+        break;
+    default:
+        break;
+    }
+    log_append(m, now);
+}
+
+static void up_delta(Packet *p, Message *m) {
+    Format *f = format_for(m->delta.format);
+    BitStream bs;
+    Delta d;
+    uint16_t prev = 0;
+    size_t i;
+
+    if(!f) return;
+
+    memset(&d, 0, sizeof(d));
+    d.fields = f->fields;
+    bits_init(&bs, p->p + p->start, p->end - p->start);
+    for(i=0; i<m->delta.n; i++) {
+        delta_read(&bs, &d, &prev);
+        if(bs.overflow || d.state.id.n >= MAX_ENTITIES)
+            return;
+        current[d.state.id.n].state = d.state;
+        current[d.state.id.n].f     = f;
+        current[d.state.id.n].head  = d.head;
+        present[d.state.id.n]       = true;
+    }
+    p->start += bits_bytes(&bs);
+    up.updated = true;
+}
+
+static void frame_collision(Message *m) {
+    Frame *fr = &frames[frame_head % RELAY_FRAMES];
+    if(fr->ncollisions < RELAY_COLLISIONS)
+        fr->collisions[fr->ncollisions ++] = *m;
+}
+
+static void up_handle(Packet *p, Clock now) {
+    static Message events[UINT8_MAX];
+    Header h;
+    Message m;
+    size_t i, size;
+
+    /* strings are decoded into the arena of the library */
+    arena_reset(&server->scratch);
+
+    if(!packet_get(p, header_unpack, &h) || h.app_id != APP_ID)
+        return;
+
+    while(packet_get(p, message_unpack, &m)) {
+        /* batches are split up, spectators receive single messages */
+        if(is_batched(&m)) {
+            if(!events_unpack(p->p + p->start, p->end - p->start, &m, events, &size))
+                return;
+            p->start += size;
+        }
+
+        if(is_reliable(&m)) {
+            if(m.seqno != up.last_in_reliable + 1)
+                continue;
+            up.last_in_reliable = m.seqno;
+            if(!is_batched(&m))
+                up_reliable(&m, now);
+            else for(i=0; i<m.events.n; i++)
+                up_reliable(&events[i], now);
+        } else if(m.type == MESSAGE_COLLISIONS) {
+            for(i=0; i<m.events.n; i++)
+                frame_collision(&events[i]);
+        } else if(m.type == MESSAGE_DELTA) {
+            up_delta(p, &m);
+        } else if(m.type == MESSAGE_COLLISION) {
+            frame_collision(&m);
+        } else if(m.type == MESSAGE_STATS) {
+            frames[frame_head % RELAY_FRAMES].stats     = m;
+            frames[frame_head % RELAY_FRAMES].has_stats = true;
+        } else if(is_update(&m)) {
+            return; /* only sent to older revisions */
+        } else if(m.type == MESSAGE_MTU_PROBE) {
+            Message r;
+            memset(&r, 0, sizeof(r));
+            r.type = MESSAGE_MTU_ACK;
+            r.mtu_ack.size = m.mtu_probe.size;
+            up_send(&r, 1);
+        } else if(m.type == MESSAGE_COOKIE) {
+            up.cookie     = m.cookie.value;
+            up.has_cookie = true;
+            if(!up.synced)
+                up_connect();
+        } else if(m.type == MESSAGE_REJECT) {
+            log_die("rejected by the server");
+        }
+    }
+}
+
+static void up_recv(Clock now) {
+    Packet p;
+
+    for(;;) {
+        packet_init_recv(&p);
+        p.end = MAX_PACKET_LENGTH;
+        if(!conn_recv(&up.conn, p.p, &p.end, &p.adr))
+            log_die("receiving from the server failed");
+        if(p.end == 0) /* EAGAIN */
+            break;
+        if(!address_eq(&p.adr, &up.adr))
+            continue;
+        bytes_up += p.end;
+        up_handle(&p, now);
+    }
+}
+
+/* keep the current states in a new frame, which already holds the
+ * collisions and stats that arrived with them
+ */
+static void frame_capture(Clock now) {
+    Frame *fr;
+    size_t i;
+
+    if(!up.updated) return;
+    up.updated = false;
+
+    if(frame_head - frame_tail == RELAY_FRAMES - 1)
+        frame_tail ++;
+
+    fr = &frames[frame_head % RELAY_FRAMES];
+    fr->at = now;
+    fr->n  = 0;
+    for(i=0; i<MAX_ENTITIES; i++) {
+        if(!present[i])
+            continue;
+        if(fr->n == fr->cap) {
+            fr->cap     = fr->cap ? 2 * fr->cap : 64;
+            fr->records = (Record*)realloc(fr->records, fr->cap * sizeof(Record));
+            if(!fr->records)
+                log_die("out of memory");
+        }
+        fr->records[fr->n ++] = current[i];
+    }
+
+    frame_head ++;
+    fr = &frames[frame_head % RELAY_FRAMES];
+    fr->ncollisions = 0;
+    fr->has_stats   = false;
+}
+
+/* released players and entities */
+
+static void world_apply(Message *m) {
+    Id id;
+
+    switch(m->type) {
+    case MESSAGE_JOIN:
+    case MESSAGE_NAME:
+        id = m->type == MESSAGE_JOIN ? m->join.player_id : m->name.player_id;
+        if(id.n >= MAX_CLIENTS) break;
+        if(m->type == MESSAGE_NAME && !id_eq(players[id.n].join.player_id, id)) break;
+        players[id.n].type = MESSAGE_JOIN;
+        players[id.n].join.player_id = id;
+        players[id.n].join.nick = m->type == MESSAGE_JOIN ? m->join.nick : m->name.nick;
+        copy_str(&players[id.n], nicks[id.n], sizeof(nicks[id.n]));
+        break;
+    case MESSAGE_LEAVE:
+        id = m->leave.player_id;
+        if(id.n < MAX_CLIENTS && id_eq(players[id.n].join.player_id, id))
+            players[id.n].type = 0;
+        break;
+    case MESSAGE_ADD:
+        if(m->add.entity_id.n < MAX_ENTITIES)
+            entities[m->add.entity_id.n] = *m;
+        break;
+    case MESSAGE_REMOVE:
+        id = m->remove.entity_id;
+        if(id.n < MAX_ENTITIES && id_eq(entities[id.n].add.entity_id, id))
+            entities[id.n].type = 0;
+        break;
+    default:
+        break;
+    }
+}
+
+/* spectators */
+
+static Spectator *spectator_lookup(Address *adr) {
+    size_t i;
+    for(i=0; i<max_spectators; i++) {
+        if(spectators[i].used && address_eq(&spectators[i].adr, adr))
+            return &spectators[i];
+    }
+    return 0;
+}
+
+static void spectator_reject(Address *adr, size_t ack, RejectReason reason) {
+    Header h;
+    Message m;
+    char buf[MAX_PACKET_LENGTH];
+    size_t k = 0;
+
+    memset(&h, 0, sizeof(h));
+    h.app_id = APP_ID;
+    h.ack    = (uint32_t)ack;
+    memset(&m, 0, sizeof(m));
+    message_reject(&m, reason);
+    m.seqno = 1;
+    k += header_pack(buf+k, &h);
+    k += message_pack(buf+k, &m);
+    conn_send(&conn, buf, k, adr);
+}
+
+static void spectator_remove(Spectator *s) {
+    free(s->join);
+    free(s->nicks);
+    memset(s, 0, sizeof(Spectator));
+    nspectators --;
+}
+
+/* the join snapshot is the released state of the players and entities */
+static void spectator_create(Address *adr, Clock now) {
+    Spectator *s = 0;
+    size_t i, n = 0;
+
+    for(i=0; i<max_spectators && !s; i++) {
+        if(!spectators[i].used)
+            s = &spectators[i];
+    }
+    if(!s) {
+        spectator_reject(adr, 1, REJECT_FULL);
+        return;
+    }
+
+    s->join  = (Message*)malloc((MAX_CLIENTS + MAX_ENTITIES + 1) * sizeof(Message));
+    s->nicks = malloc(MAX_CLIENTS * sizeof(*s->nicks));
+    if(!s->join || !s->nicks)
+        log_die("out of memory");
+
+    for(i=0; i<MAX_CLIENTS; i++) {
+        if(players[i].type != MESSAGE_JOIN)
+            continue;
+        s->join[n] = players[i];
+        copy_str(&s->join[n], s->nicks[i], sizeof(s->nicks[i]));
+        n ++;
+    }
+    for(i=0; i<MAX_ENTITIES; i++) {
+        if(entities[i].type == MESSAGE_ADD)
+            s->join[n++] = entities[i];
+    }
+    memset(&s->join[n], 0, sizeof(Message));
+    s->join[n].type = MESSAGE_SYNCED;
+    s->join[n].synced.player_id = up.player_id;
+    n ++;
+
+    s->used             = true;
+    s->adr              = *adr;
+    s->last_in_reliable = 1; /* the connect */
+    s->last_in_ack      = 0;
+    s->next_out         = 1;
+    s->last_activity    = now;
+    s->last_resend      = now;
+    s->njoin            = n;
+    s->base             = log_released;
+    for(i=0; i<n; i++)
+        s->join[i].seqno = i + 1;
+    nspectators ++;
+}
+
+static void spectator_handle(Packet *p, Clock now) {
+    Spectator *s = spectator_lookup(&p->adr);
+    Header h;
+    Message m;
+
+    arena_reset(&server->scratch);
+
+    if(!packet_get(p, header_unpack, &h) || h.app_id != APP_ID)
+        return;
+
+    if(s) {
+        s->last_activity = now;
+        s->last_in_ack   = max(s->last_in_ack, (size_t)h.ack);
+    }
+
+    while(packet_get(p, message_unpack, &m)) {
+        if(m.type == MESSAGE_CONNECT) {
+            if(s || !up.synced) /* resent until the relay has the game state */
+                continue;
+            if(m.connect.rev < REVISION_BITPACK || m.connect.rev > RELAY_REVISION) {
+                spectator_reject(&p->adr, m.seqno, REJECT_VERSION_MISMATCH);
+                return;
+            }
+            spectator_create(&p->adr, now);
+            s = spectator_lookup(&p->adr);
+        } else if(!s) {
+            return;
+        } else if(is_reliable(&m)) {
+            if(m.seqno == s->last_in_reliable + 1)
+                s->last_in_reliable = m.seqno;
+        } else if(m.type == MESSAGE_SACK) {
+            s->last_in_ack = max(s->last_in_ack, (size_t)m.sack.ack);
+        } else if(m.type == MESSAGE_DISCONNECT) {
+            spectator_remove(s);
+            return;
+        }
+        /* input and acks of snapshots are ignored */
+    }
+}
+
+static void spectators_recv(Clock now) {
+    Packet p;
+
+    for(;;) {
+        packet_init_recv(&p);
+        p.end = MAX_PACKET_LENGTH;
+        if(!conn_recv(&conn, p.p, &p.end, &p.adr))
+            log_die("receiving failed");
+        if(p.end == 0) /* EAGAIN */
+            break;
+        spectator_handle(&p, now);
+    }
+}
+
+/* the message with the given seqno of s, 0 if it is not released yet */
+static Message *spectator_message(Spectator *s, size_t seqno) {
+    size_t i;
+    Message *m;
+
+    if(seqno <= s->njoin)
+        return &s->join[seqno - 1];
+
+    i = s->base + (seqno - s->njoin - 1);
+    if(i >= log_released)
+        return 0;
+    m = &log_events[i % RELAY_LOG].m;
+    m->seqno = seqno;
+    return m;
+}
+
+/* first entry of the log that s has not acknowledged */
+static size_t spectator_needs(Spectator *s) {
+    return s->base + (s->last_in_ack > s->njoin ? s->last_in_ack - s->njoin : 0);
+}
+
+/* reliable messages from first on, SPECTATOR_PACKETS at most */
+static void spectator_send(Spectator *s, size_t first) {
+    Packet p;
+    Header h;
+    Message *m;
+    size_t seqno = first, npackets = 0;
+
+    memset(&h, 0, sizeof(h));
+    h.app_id = APP_ID;
+    h.ack    = (uint32_t)s->last_in_reliable;
+
+    while(npackets < SPECTATOR_PACKETS && (m = spectator_message(s, seqno))) {
+        packet_init_send(&p, &s->adr);
+        packet_put_header(&p, &h);
+        while(m && packet_put(&p, message_pack, m))
+            m = spectator_message(s, ++seqno);
+
+        conn_send(&conn, p.p, p.end, &s->adr);
+        bytes_down += p.end;
+        packets_down ++;
+        npackets ++;
+    }
+    s->next_out = max(s->next_out, seqno);
+}
+
+/* spectators that are too slow for the log are dropped */
+static void spectators_update(Clock now) {
+    size_t i;
+
+    for(i=0; i<max_spectators; i++) {
+        Spectator *s = &spectators[i];
+        if(!s->used)
+            continue;
+
+        if(s->last_activity + SPECTATOR_TIMEOUT < now || spectator_needs(s) < log_tail) {
+            spectator_remove(s);
+            continue;
+        }
+
+        if(s->last_in_ack + 1 < s->next_out && now - s->last_resend >= SPECTATOR_RESEND) {
+            s->last_resend = now;
+            spectator_send(s, s->last_in_ack + 1);
+        } else {
+            spectator_send(s, s->next_out);
+        }
+    }
+}
+
+/* release */
+
+static bool frame_open(Packet *p) {
+    Address none = address_none;
+    Header h;
+
+    if(npackets == RELAY_PACKETS)
+        return false;
+
+    memset(&h, 0, sizeof(h));
+    h.app_id = APP_ID;
+    packet_init_send(p, &none);
+    p->mtu = MIN_PACKET_LENGTH;
+    packet_put_header(p, &h);
+    return true;
+}
+
+static void frame_close(Packet *p) {
+    if(!packet_hasdata(p))
+        return;
+    memcpy(packets[npackets], p->p, p->end);
+    sizes[npackets] = p->end;
+    npackets ++;
+}
+
+/* write the final record count of the delta message at pos */
+static void delta_close(Packet *p, Message *m, size_t pos) {
+    if(m->delta.n || (m->delta.part & DELTA_LAST))
+        message_pack(p->p + pos, m);
+    else
+        p->end = pos;
+}
+
+/* serialize fr as absolute records, grouped by format, in parts like
+ * the snapshots of the game server (see stream.c)
+ */
+static void frame_serialize(Frame *fr) {
+    Packet p;
+    Message m;
+    BitStream b;
+    Delta d;
+    uint16_t prev = 0;
+    size_t i, k, pos = 0;
+    bool open = false;
+
+    npackets = 0;
+    if(!frame_open(&p))
+        return;
+
+    for(i=0; i<fr->ncollisions + fr->has_stats; i++) {
+        Message *c = i < fr->ncollisions ? &fr->collisions[i] : &fr->stats;
+        c->seqno = next_unreliable ++;
+        if(!packet_put(&p, message_pack, c)) {
+            frame_close(&p);
+            if(!frame_open(&p)) return;
+            packet_put(&p, message_pack, c);
+        }
+    }
+
+    memset(&m, 0, sizeof(m));
+    m.type = MESSAGE_DELTA;
+    m.delta.snapshot = ++snapshot;
+
+    for(k=0; k<sizeof(formats)/sizeof(formats[0]); k++) {
+        Format *f = formats[k];
+
+        for(i=0; i<fr->n; i++) {
+            Record *r = &fr->records[i];
+            Message *add;
+
+            if(r->f != f)
+                continue;
+            add = &entities[r->state.id.n];
+            if(add->type != MESSAGE_ADD || !id_eq(add->add.entity_id, r->state.id))
+                continue;
+
+            memset(&d, 0, sizeof(d));
+            d.fields = f->fields;
+            d.state  = r->state;
+            d.head   = r->head;
+        retry:
+            if(open && m.delta.format != f->type) {
+                delta_close(&p, &m, pos);
+                if(m.delta.n) m.delta.part ++;
+                open = false;
+            }
+            if(!open) {
+                if(m.delta.part == DELTA_LAST - 1)
+                    goto last;
+                m.delta.format = f->type;
+                m.delta.n = 0;
+                m.seqno   = next_unreliable ++;
+                pos  = p.end;
+                open = packet_put(&p, message_pack, &m);
+                prev = 0;
+                bits_init(&b, p.p + p.end, open ? p.mtu - p.end : 0);
+            }
+            if(open && m.delta.n < UINT8_MAX) {
+                size_t mark = b.pos;
+                delta_write(&b, &d, &prev);
+                if(!b.overflow) {
+                    p.end = (size_t)(b.s - p.p) + bits_bytes(&b);
+                    m.delta.n ++;
+                    continue;
+                }
+                b.pos = mark;
+                b.overflow = false;
+            }
+            if(open) {
+                delta_close(&p, &m, pos);
+                if(m.delta.n) m.delta.part ++;
+                open = false;
+            }
+            frame_close(&p);
+            if(!frame_open(&p))
+                return;
+            goto retry;
+        }
+    }
+
+last:
+    if(open) {
+        m.delta.part |= DELTA_LAST;
+        delta_close(&p, &m, pos);
+    }
+    frame_close(&p);
+}
+
+/* the same packets to all spectators, with their own ack */
+static void frame_send(Frame *fr) {
+    Clock start = clock_get(), t;
+    size_t i, j;
+
+    frame_serialize(fr);
+
+    for(i=0; i<max_spectators; i++) {
+        Spectator *s = &spectators[i];
+        if(!s->used)
+            continue;
+        for(j=0; j<npackets; j++) {
+            uint32_pack(packets[j] + sizeof(uint32_t), (uint32_t)s->last_in_reliable);
+            conn_send(&conn, packets[j], sizes[j], &s->adr);
+            bytes_down += sizes[j];
+            packets_down ++;
+        }
+    }
+    conn_flush(&conn);
+
+    t = clock_get() - start;
+    fanout_time += t;
+    fanout_max   = max(fanout_max, t);
+    nframes ++;
+}
+
+static void release(Clock now) {
+    size_t i;
+
+    for(; log_released < log_head; log_released ++) {
+        Event *e = &log_events[log_released % RELAY_LOG];
+        if(e->at + delay > now)
+            break;
+        world_apply(&e->m);
+    }
+
+    /* entries that all spectators have acknowledged */
+    for(; log_tail < log_released; log_tail ++) {
+        bool needed = false;
+        for(i=0; i<max_spectators && !needed; i++) {
+            Spectator *s = &spectators[i];
+            needed = s->used && spectator_needs(s) <= log_tail;
+        }
+        if(needed)
+            break;
+    }
+
+    for(; frame_tail < frame_head; frame_tail ++) {
+        Frame *fr = &frames[frame_tail % RELAY_FRAMES];
+        if(fr->at + delay > now)
+            break;
+        frame_send(fr);
+    }
+}
+
+static void print_stats(double s) {
+    printf("spectators %4zu  from server %7.0f bytes/s  to spectators %9.0f bytes/s %7.0f packets/s"
+           "  fan-out %6.1f us (max %6.1f us)  log %4zu\n",
+           nspectators, bytes_up / s, bytes_down / s, packets_down / s,
+           nframes ? (double)fanout_time / nframes : 0.0, (double)fanout_max,
+           log_head - log_tail);
+    fflush(stdout);
+    bytes_up = bytes_down = packets_down = 0;
+    fanout_time = fanout_max = 0;
+    nframes = 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *host = "127.0.0.1";
+    unsigned short port   = DEFAULT_PORT;
+    unsigned short listen = DEFAULT_PORT + 2;
+    char ip[64];
+    struct in6_addr adr;
+    size_t i;
+
+    for(i=1; i<(size_t)argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i+1 < (size_t)argc) ? argv[i+1] : 0;
+        if(!val) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return 1;
+        }
+        i ++;
+
+        if(!strcmp(arg, "-host"))            host   = val;
+        else if(!strcmp(arg, "-port"))       port   = atoi(val);
+        else if(!strcmp(arg, "-listen"))     listen = atoi(val);
+        else if(!strcmp(arg, "-delay"))      delay  = (Clock)atoi(val) * MS;
+        else if(!strcmp(arg, "-spectators")) max_spectators = atoi(val);
+        else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return 1;
+        }
+    }
+
+    if(max_spectators < 1 || max_spectators > MAX_SPECTATORS) {
+        fprintf(stderr, "number of spectators must be in 1..%d\n", MAX_SPECTATORS);
+        return 1;
+    }
+    if(delay >= (Clock)(RELAY_FRAMES - 1) * TICK_INTERVAL) {
+        fprintf(stderr, "delay must be less than %d ms\n", (RELAY_FRAMES - 1) * UPDATE_INTERVAL);
+        return 1;
+    }
+
+    server_log_callbacks(_log);
+    arena_dynamic(&server->scratch, MAX_SCRATCH);
+
+    if(strchr(host, ':')) snprintf(ip, sizeof(ip), "%s", host);
+    else                  snprintf(ip, sizeof(ip), "::ffff:%s", host);
+    if(inet_pton(AF_INET6, ip, &adr) != 1)
+        log_die("invalid host");
+
+    memcpy(up.adr.ip, &adr, sizeof(up.adr.ip));
+    up.adr.port   = htons(port);
+    up.adr.isIPv6 = true;
+    up.next_unreliable = 1;
+
+    if(!conn_init(&up.conn) || !conn_bind(&up.conn, 0))
+        log_die("unable to create socket");
+    if(!conn_init(&conn) || !conn_bind(&conn, listen))
+        log_die("unable to listen for spectators");
+
+    log_info("Relaying %s:%d to port %d with a delay of %d ms.", host, port, listen, (int)(delay / MS));
+
+    Clock periodic = clock_get();
+    Clock next     = periodic;
+
+    for(;;) {
+        Clock now = clock_get();
+
+        up_recv(now);
+        frame_capture(now);
+        spectators_recv(now);
+        release(now);
+
+        if(now >= next) {
+            next += TICK_INTERVAL;
+            if(!up.synced && now - up.last_tx > RESEND_INTERVAL) {
+                up.last_tx = now;
+                up_connect();
+            } else if(up.synced) {
+                up_ack();
+            }
+            spectators_update(now);
+            conn_flush(&conn);
+        } else {
+            usleep(MS);
+        }
+
+        if(now - periodic >= STAT_INTERVAL) {
+            print_stats((double)(now - periodic) / S);
+            periodic = now;
+        }
+    }
+
+    return 0;
+}
@@ -7,6 +7,7 @@
 	using Entities;
 	using Network;
 	using Network.Messages;
+	using Network.Server;
 	using Pegasus;
 	using Pegasus.Platform;
 	using Pegasus.Platform.Memory;
@@ -61,7 +62,11 @@
 				RootTransform = new Transformation();
 				EventMessages = new EventMessageList(this);
 
-				var channel = UdpChannel.Create(Allocator, serverEndPoint, NetworkProtocol.MaxPacketSize);
+				// A client of the server in this process does not need a socket
+				var transport = LwarServer.TryCreateLocalTransport(serverEndPoint);
+				var channel = transport == null
+					? UdpChannel.Create(Allocator, serverEndPoint, NetworkProtocol.MaxPacketSize)
+					: UdpChannel.Create(Allocator, serverEndPoint, transport, NetworkProtocol.MaxPacketSize);
 				Connection = Connection.Create(Allocator, channel);
 				Connection.Send(ClientConnectMessage.Create(Allocator, Cvars.PlayerName));
 
@@ -16,5 +16,10 @@
 		///     Indicates that the server uses another version of the network protocol than the client.
 		/// </summary>
 		VersionMismatch = 2,
+
+		/// <summary>
+		///     Indicates that the server does not accept spectator relays from the client's address.
+		/// </summary>
+		Relay = 3,
 	}
 }
\ No newline at end of file
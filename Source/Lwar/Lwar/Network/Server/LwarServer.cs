@@ -36,6 +36,11 @@ namespace Lwar.Network.Server
 		/// </summary>
 		private readonly StepTimer _timer = new StepTimer { UseFixedTimeStep = true };
 
+		/// <summary>
+		///     The port that the server listens on.
+		/// </summary>
+		private readonly ushort _port;
+
 		/// <summary>
 		///     The task that executes the server.
 		/// </summary>
@@ -49,6 +54,7 @@ namespace Lwar.Network.Server
 		/// <param name="updateRate">The server update rate in frames per second.</param>
 		protected LwarServer(string serverName, ushort port, float updateRate = 1 / 60.0f)
 		{
+			_port = port;
 			_timer.TargetElapsedSeconds = updateRate;
 			_timer.UpdateRequired += () => Update(_timer.ElapsedSeconds);
 			_serverDiscovery = new ServerDiscovery(serverName, port);
@@ -133,6 +139,19 @@ namespace Lwar.Network.Server
 			}
 		}
 
+		/// <summary>
+		///     Creates a transport that a client can use instead of a socket if it connects to the server that runs in this
+		///     process. Returns null if there is no such server or it does not support it.
+		/// </summary>
+		/// <param name="serverEndPoint">The endpoint that the client connects to.</param>
+		public static IPacketTransport TryCreateLocalTransport(IPEndPoint serverEndPoint)
+		{
+			if (_server == null || serverEndPoint.Address != IPAddress.LocalHost || serverEndPoint.Port != _server._port)
+				return null;
+
+			return _server.CreateLocalTransport();
+		}
+
 		/// <summary>
 		///     Checks whether any server errors occurred. If so, stops the server and raises an exception.
 		/// </summary>
@@ -153,6 +172,15 @@ namespace Lwar.Network.Server
 			_serverDiscovery.SafeDispose();
 		}
 
+		/// <summary>
+		///     Creates a transport that the local client can use to exchange packets with the server without a socket,
+		///     or returns null if the server does not support it.
+		/// </summary>
+		protected virtual IPacketTransport CreateLocalTransport()
+		{
+			return null;
+		}
+
 		/// <summary>
 		///     Updates the server.
 		/// </summary>
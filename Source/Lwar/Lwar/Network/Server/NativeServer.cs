@@ -23,6 +23,11 @@
 		/// </summary>
 		private bool _isRunning;
 
+		/// <summary>
+		///     Indicates whether the local client can exchange its packets with the server in memory.
+		/// </summary>
+		private bool _hasLocalTransport;
+
 		/// <summary>
 		///     The number of seconds that have elapsed since the the server has been started.
 		/// </summary>
@@ -53,7 +58,10 @@
 			_isRunning = NativeMethods.Initialize(port);
 
 			if (_isRunning)
+			{
+				_hasLocalTransport = NativeMethods.OpenLocal() > 0;
 				return;
+			}
 
 			this.SafeDispose();
 			throw new NetworkException("See the console for further details.");
@@ -78,6 +86,14 @@
 			Log.Error("Server stopped after error.");
 		}
 
+		/// <summary>
+		///     Creates a transport that the local client can use to exchange packets with the server without a socket.
+		/// </summary>
+		protected override IPacketTransport CreateLocalTransport()
+		{
+			return _hasLocalTransport ? new LocalTransport() : null;
+		}
+
 		/// <summary>
 		///     Disposes the object, releasing all managed and unmanaged resources.
 		/// </summary>
@@ -94,6 +110,44 @@
 			Log.Info("Server has shut down.");
 		}
 
+		/// <summary>
+		///     Exchanges the packets of the local client with the server through the in-memory queues of the server.
+		/// </summary>
+		private sealed class LocalTransport : IPacketTransport
+		{
+			/// <summary>
+			///     Sends the given packet to the server. The packet is lost if the queue of the server is full.
+			/// </summary>
+			/// <param name="buffer">The buffer that contains the data that should be sent.</param>
+			/// <param name="size">The number of bytes that should be sent.</param>
+			public void Send(byte[] buffer, int size)
+			{
+				if (NativeMethods.LocalSend(buffer, (uint)size) < 0)
+					throw new NetworkException("The server has shut down.");
+			}
+
+			/// <summary>
+			///     Tries to receive a packet sent by the server. Returns true if a packet has been received, false otherwise.
+			/// </summary>
+			/// <param name="buffer">The buffer the received data should be written to.</param>
+			/// <param name="size">Returns the number of bytes that have been received.</param>
+			public bool TryReceive(byte[] buffer, out int size)
+			{
+				size = NativeMethods.LocalReceive(buffer, (uint)buffer.Length);
+				if (size < 0)
+					throw new NetworkException("The server has shut down.");
+
+				return size > 0;
+			}
+
+			/// <summary>
+			///     The queues belong to the server, there is nothing to release.
+			/// </summary>
+			public void Dispose()
+			{
+			}
+		}
+
 		/// <summary>
 		///     Provides access to the native service types and functions.
 		/// </summary>
@@ -111,6 +165,15 @@
 			[DllImport(LibraryName, EntryPoint = "server_shutdown")]
 			public static extern void Shutdown();
 
+			[DllImport(LibraryName, EntryPoint = "server_local_open")]
+			public static extern int OpenLocal();
+
+			[DllImport(LibraryName, EntryPoint = "server_local_send")]
+			public static extern int LocalSend(byte[] buffer, uint size);
+
+			[DllImport(LibraryName, EntryPoint = "server_local_recv")]
+			public static extern int LocalReceive([Out] byte[] buffer, uint size);
+
 			[DllImport(LibraryName, EntryPoint = "server_log_callbacks")]
 			public static extern void SetCallbacks(LogCallbacks callbacks);
 
@@ -21,6 +21,53 @@ bool address_eq(Address *adr0, Address *adr1) {
 	return memcmp(adr0->ip, adr1->ip, sizeof(adr1->ip)) == 0;
 }
 
+/* IPv4 addresses as IPv4-mapped IPv6 addresses */
+static void ip_mapped(Address *adr, uint8_t ip[16]) {
+    if(adr->isIPv6) {
+        memcpy(ip, adr->ip, 16);
+    } else {
+        memset(ip, 0, 10);
+        ip[10] = ip[11] = 0xff;
+        memcpy(ip + 12, adr->ip, 4);
+    }
+}
+
+bool address_eq_ip(Address *adr0, Address *adr1) {
+    uint8_t ip0[16], ip1[16];
+    ip_mapped(adr0, ip0);
+    ip_mapped(adr1, ip1);
+    return memcmp(ip0, ip1, sizeof(ip0)) == 0;
+}
+
+bool address_parse_ip(Address *adr, const char *ip) {
+    struct in6_addr in6;
+    struct in_addr in4;
+
+    memset(adr, 0, sizeof(Address));
+    adr->isIPv6 = true;
+    if(inet_pton(AF_INET6, ip, &in6) == 1) {
+        memcpy(adr->ip, &in6, sizeof(adr->ip));
+        return true;
+    }
+    if(inet_pton(AF_INET, ip, &in4) == 1) {
+        adr->ip[10] = adr->ip[11] = 0xff;
+        memcpy(adr->ip + 12, &in4, 4);
+        return true;
+    }
+    return false;
+}
+
+/* FNV-1a of the ip and the port */
+size_t address_hash(Address *adr) {
+    uint32_t h = 2166136261u;
+    size_t i;
+    for(i=0; i<sizeof(adr->ip); i++)
+        h = (h ^ adr->ip[i]) * 16777619u;
+    h = (h ^ (adr->port & 0xff)) * 16777619u;
+    h = (h ^ (adr->port >> 8))   * 16777619u;
+    return h;
+}
+
 bool address_create(Address* adr, const char* ip, uint16_t port)
 {
 	memset(adr, 0, sizeof(Address));
@@ -2,6 +2,7 @@
 #define ADDRESS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef struct Address Address;
@@ -14,6 +15,9 @@ struct Address {
 
 bool address_create(Address *adr, const char *ip, uint16_t port);
 bool address_eq(Address *adr0, Address *adr1);
+bool address_eq_ip(Address *adr0, Address *adr1); /* regardless of the port */
+bool address_parse_ip(Address *adr, const char *ip); /* IPv4 is mapped to IPv6 */
+size_t address_hash(Address *adr);
 
 static const Address address_none = {{0}, 0,0};
 
@@ -0,0 +1,35 @@
+#include "arena.h"
+
+#include <stdlib.h> /* malloc */
+
+/* allocations are aligned for any type that decoded data may contain */
+#define ARENA_ALIGN sizeof(void *)
+
+void arena_init(Arena *a, void *p, size_t n) {
+    if(p) a->mem = (char*)p;
+    else  a->mem = (char*)malloc(n);
+    a->dynamic = !p;
+    a->n = a->mem ? n : 0;
+    a->i = 0;
+}
+
+void arena_shutdown(Arena *a) {
+    if(a->dynamic) {
+        free(a->mem);
+    }
+    a->mem = 0;
+    a->n = a->i = 0;
+}
+
+/* returns 0 if the arena is exhausted until its next reset */
+void *arena_alloc(Arena *a, size_t size) {
+    size_t i = (a->i + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if(size > a->n || i > a->n - size)
+        return 0;
+    a->i = i + size;
+    return a->mem + i;
+}
+
+void arena_reset(Arena *a) {
+    a->i = 0;
+}
@@ -0,0 +1,24 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct Arena Arena;
+
+/* bump allocator for data that is only needed until the next reset */
+struct Arena {
+    char  *mem;
+    bool   dynamic;
+    size_t n,i;
+};
+
+void  arena_init(Arena *a, void *p, size_t n);
+void  arena_shutdown(Arena *a);
+void *arena_alloc(Arena *a, size_t size);
+void  arena_reset(Arena *a);
+
+#define arena_static(a,p)    arena_init(a, p, sizeof(p));
+#define arena_dynamic(a,n)   arena_init(a, 0, n);
+
+#endif
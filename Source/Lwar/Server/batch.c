@@ -0,0 +1,133 @@
+#include "types.h"
+
+#include "batch.h"
+
+#include "debug.h"
+#include "update.h"
+
+
+/* The update records of a format have a fixed layout of big endian 16 bit
+ * words (bytes come in pairs). Packing them field by field shifts out one
+ * byte at a time. Instead, the fields of up to BATCH_SIZE entities are
+ * gathered as words in host byte order (Format.gather), and the whole block
+ * is swapped to big endian at once: with pshufb, which swaps 8 or 16 words
+ * per instruction, or with shifts if the CPU has neither SSSE3 nor AVX2.
+ *
+ * With GCC and Clang, the vector paths are compiled for their instruction
+ * set only and picked at run time, so the build does not need -mssse3.
+ */
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_X86
+#include <immintrin.h>
+#endif
+
+typedef void (Swap)(char *out, const uint16_t *w, size_t n);
+
+static void swap_scalar(char *out, const uint16_t *w, size_t n) {
+    size_t i;
+    for(i=0; i<n; i++) {
+        out[2*i]   = (char)(w[i] >> 8);
+        out[2*i+1] = (char)(w[i] & 0xff);
+    }
+}
+
+#ifdef BATCH_X86
+
+__attribute__((target("ssse3")))
+static void swap_ssse3(char *out, const uint16_t *w, size_t n) {
+    const __m128i mask = _mm_setr_epi8(1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14);
+    size_t i;
+    for(i=0; i+8 <= n; i+=8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(w+i));
+        _mm_storeu_si128((__m128i*)(out+2*i), _mm_shuffle_epi8(v, mask));
+    }
+    swap_scalar(out+2*i, w+i, n-i);
+}
+
+/* vpshufb shuffles within each 128 bit lane, so the mask is repeated */
+__attribute__((target("avx2")))
+static void swap_avx2(char *out, const uint16_t *w, size_t n) {
+    const __m256i mask = _mm256_setr_epi8(1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14,
+                                          1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14);
+    size_t i;
+    for(i=0; i+16 <= n; i+=16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(w+i));
+        _mm256_storeu_si256((__m256i*)(out+2*i), _mm256_shuffle_epi8(v, mask));
+    }
+    swap_ssse3(out+2*i, w+i, n-i);
+}
+
+#endif
+
+static const char *names[BATCH_COUNT] = { "scalar", "ssse3", "avx2" };
+
+static struct {
+    bool       init;
+    BatchSwap  swap;
+    Swap      *f;
+} batch;
+
+static bool supported(BatchSwap swap) {
+    switch(swap) {
+    case BATCH_SCALAR:
+        return true;
+#ifdef BATCH_X86
+    case BATCH_SSSE3:
+        return __builtin_cpu_supports("ssse3");
+    case BATCH_AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+bool batch_select(BatchSwap swap) {
+    if(swap >= BATCH_COUNT || !supported(swap))
+        return false;
+
+    batch.init = true;
+    batch.swap = swap;
+    switch(swap) {
+#ifdef BATCH_X86
+    case BATCH_SSSE3: batch.f = swap_ssse3; break;
+    case BATCH_AVX2:  batch.f = swap_avx2;  break;
+#endif
+    default:          batch.f = swap_scalar; break;
+    }
+    return true;
+}
+
+BatchSwap batch_selected() {
+    if(!batch.init) {
+        BatchSwap swap = BATCH_COUNT;
+        while(!batch_select(--swap));
+    }
+    return batch.swap;
+}
+
+const char *batch_name(BatchSwap swap) {
+    return swap < BATCH_COUNT ? names[swap] : "unknown";
+}
+
+size_t update_batch_pack(char *s, Format *f, Entity **e, size_t n) {
+    uint16_t w[BATCH_SIZE * BATCH_WORDS];
+    size_t i, k, len = 0;
+
+    assert(f->len <= 2 * BATCH_WORDS);
+    batch_selected();
+
+    while(n) {
+        k = 0;
+        for(i=0; i<n && i<BATCH_SIZE; i++)
+            k += f->gather(w+k, e[i]);
+        assert(2*k == i * f->len);
+
+        batch.f(s+len, w, k);
+        len += 2*k;
+        e   += i;
+        n   -= i;
+    }
+    return len;
+}
@@ -0,0 +1,32 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "types.h"
+
+enum {
+    BATCH_SIZE  = 64, /* records gathered at a time */
+    BATCH_WORDS = 8,  /* of the longest record */
+};
+
+/* conversions of the gathered words to big endian, see batch.c */
+typedef enum {
+    BATCH_SCALAR,
+    BATCH_SSSE3,
+    BATCH_AVX2,
+    BATCH_COUNT,
+} BatchSwap;
+
+/* write the update records of n entities of format f to s,
+ * the same bytes as f->pack for each of them,
+ * returns the number of bytes written
+ */
+size_t update_batch_pack(char *s, Format *f, Entity **e, size_t n);
+
+/* the conversion used by update_batch_pack, the best one the CPU supports
+ * unless selected, returns false if the CPU does not support it
+ */
+bool        batch_select(BatchSwap swap);
+BatchSwap   batch_selected();
+const char *batch_name(BatchSwap swap);
+
+#endif
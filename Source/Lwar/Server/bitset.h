@@ -1,26 +1,89 @@
 #ifndef BITSET_H
 #define BITSET_H
 
-typedef unsigned long BitSet;
+#include <stdbool.h>
+#include <stddef.h>
 
-#define set_empty 0
+#include "config.h"
+
+/* sets of small numbers, such as player ids or entity type ids,
+ * stored as an array of words with one bit per element
+ */
+
+enum {
+    BITSET_WORD  = 8 * sizeof(unsigned long),
+    BITSET_SIZE  = MAX_CLIENTS > MAX_ENTITY_TYPES ? MAX_CLIENTS : MAX_ENTITY_TYPES,
+    BITSET_WORDS = (BITSET_SIZE + BITSET_WORD - 1) / BITSET_WORD,
+};
+
+typedef struct BitSet BitSet;
+
+struct BitSet {
+    unsigned long w[BITSET_WORDS];
+};
+
+#define set_bit(i) \
+    (1ul << ((i) % BITSET_WORD))
+
+#define set_clear(s) \
+    bitset_clear(&(s))
 
 #define set_insert(s,i) \
-    (s) |= (BitSet)(1 << (i))
+    ((s).w[(i) / BITSET_WORD] |= set_bit(i))
 
 #define set_remove(s,i) \
-    (s) &= ~(BitSet)(1 << (i))
+    ((s).w[(i) / BITSET_WORD] &= ~set_bit(i))
 
 #define set_contains(s,i) \
-    (((s) & (BitSet)(1 << (i))) != 0)
+    (((s).w[(i) / BITSET_WORD] & set_bit(i)) != 0)
 
-#define set_intersection(s1,s2) \
-    ((s1) & (s2))
+/* r may be the same as s1 or s2 */
+#define set_intersection(r,s1,s2) \
+    bitset_intersection(&(r), &(s1), &(s2))
 
-#define set_union(s1,s2) \
-    ((s1) | (s2))
+#define set_union(r,s1,s2) \
+    bitset_union(&(r), &(s1), &(s2))
 
 #define set_disjoint(s1,s2) \
-    (set_intersection(s1,s2) == set_empty)
+    bitset_disjoint(&(s1), &(s2))
+
+#define set_isempty(s) \
+    bitset_isempty(&(s))
+
+static inline void bitset_clear(BitSet *s) {
+    size_t i;
+    for(i=0; i<BITSET_WORDS; i++)
+        s->w[i] = 0;
+}
+
+static inline void bitset_intersection(BitSet *r, const BitSet *s1, const BitSet *s2) {
+    size_t i;
+    for(i=0; i<BITSET_WORDS; i++)
+        r->w[i] = s1->w[i] & s2->w[i];
+}
+
+static inline void bitset_union(BitSet *r, const BitSet *s1, const BitSet *s2) {
+    size_t i;
+    for(i=0; i<BITSET_WORDS; i++)
+        r->w[i] = s1->w[i] | s2->w[i];
+}
+
+static inline bool bitset_disjoint(const BitSet *s1, const BitSet *s2) {
+    size_t i;
+    for(i=0; i<BITSET_WORDS; i++) {
+        if(s1->w[i] & s2->w[i])
+            return false;
+    }
+    return true;
+}
+
+static inline bool bitset_isempty(const BitSet *s) {
+    size_t i;
+    for(i=0; i<BITSET_WORDS; i++) {
+        if(s->w[i])
+            return false;
+    }
+    return true;
+}
 
 #endif
@@ -0,0 +1,128 @@
+#include "bitstream.h"
+
+void bits_init(BitStream *b, char *s, size_t len) {
+    b->s        = s;
+    b->len      = len;
+    b->pos      = 0;
+    b->overflow = false;
+}
+
+size_t bits_bytes(BitStream *b) {
+    return (b->pos + 7) / 8;
+}
+
+void bits_put(BitStream *b, uint32_t u, unsigned n) {
+    if(b->pos + n > b->len * 8) {
+        b->overflow = true;
+        return;
+    }
+
+    while(n > 0) {
+        unsigned char *c = (unsigned char*)b->s + b->pos / 8;
+        unsigned free = 8 - b->pos % 8;
+        unsigned k    = n < free ? n : free;
+        unsigned mask = (1u << k) - 1;
+        unsigned v    = (u >> (n - k)) & mask;
+
+        /* overwrite, the stream may have been rewound */
+        *c = (unsigned char)((*c & ~(mask << (free - k))) | (v << (free - k)));
+
+        b->pos += k;
+        n      -= k;
+    }
+}
+
+uint32_t bits_get(BitStream *b, unsigned n) {
+    uint32_t u = 0;
+
+    if(b->pos + n > b->len * 8) {
+        b->overflow = true;
+        return 0;
+    }
+
+    while(n > 0) {
+        unsigned char c = (unsigned char)b->s[b->pos / 8];
+        unsigned free = 8 - b->pos % 8;
+        unsigned k    = n < free ? n : free;
+
+        u = (u << k) | ((c >> (free - k)) & ((1u << k) - 1));
+
+        b->pos += k;
+        n      -= k;
+    }
+    return u;
+}
+
+void bits_put_golomb(BitStream *b, uint32_t u, unsigned k) {
+    uint64_t w = (uint64_t)u + ((uint64_t)1 << k);
+    unsigned n = 0;
+
+    while((w >> n) > 1)
+        n ++;
+
+    /* n-k leading zeros, followed by the n+1 bits of w */
+    bits_put(b, 0, n - k);
+    if(n >= 32) {
+        bits_put(b, (uint32_t)(w >> 32), n - 31);
+        bits_put(b, (uint32_t)w, 32);
+    } else {
+        bits_put(b, (uint32_t)w, n + 1);
+    }
+}
+
+uint32_t bits_get_golomb(BitStream *b, unsigned k) {
+    unsigned z = 0;
+    uint64_t w;
+
+    /* count the leading zeros a byte at a time */
+    for(;;) {
+        unsigned char c;
+        unsigned free, v;
+
+        if(b->pos >= b->len * 8 || z > 32) {
+            /* truncated or malformed input */
+            b->overflow = true;
+            return 0;
+        }
+
+        c    = (unsigned char)b->s[b->pos / 8];
+        free = 8 - b->pos % 8;
+        v    = c & ((1u << free) - 1);
+
+        if(v == 0) {
+            z      += free;
+            b->pos += free;
+        } else {
+            unsigned n = 0;
+            while((v >> n) > 1)
+                n ++;
+            z      += free - 1 - n;
+            b->pos += free - n;
+            break;
+        }
+    }
+    if(z > 32) {
+        b->overflow = true;
+        return 0;
+    }
+
+    /* the leading one has already been read */
+    w = ((uint64_t)1 << (z + k));
+    if(z + k > 0) {
+        if(z + k > 32) {
+            w |= (uint64_t)bits_get(b, z + k - 32) << 32;
+            w |= bits_get(b, 32);
+        } else {
+            w |= bits_get(b, z + k);
+        }
+    }
+    return (uint32_t)(w - ((uint64_t)1 << k));
+}
+
+uint32_t zigzag(int32_t i) {
+    return ((uint32_t)i << 1) ^ (uint32_t)(i >> 31);
+}
+
+int32_t unzigzag(uint32_t u) {
+    return (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+}
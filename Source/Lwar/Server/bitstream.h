@@ -0,0 +1,34 @@
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct BitStream BitStream;
+
+/* reads or writes bits to a buffer, most significant bit first */
+struct BitStream {
+    char  *s;
+    size_t len;      /* size of s in bytes */
+    size_t pos;      /* position in bits */
+    bool   overflow; /* set if reading or writing past the end */
+};
+
+void     bits_init(BitStream *b, char *s, size_t len);
+
+/* number of bytes that have been read or written so far */
+size_t   bits_bytes(BitStream *b);
+
+void     bits_put(BitStream *b, uint32_t u, unsigned n);
+uint32_t bits_get(BitStream *b, unsigned n);
+
+/* exponential-Golomb code of order k, short for small values */
+void     bits_put_golomb(BitStream *b, uint32_t u, unsigned k);
+uint32_t bits_get_golomb(BitStream *b, unsigned k);
+
+/* zig-zag mapping of signed values for bits_put_golomb */
+uint32_t zigzag(int32_t i);
+int32_t  unzigzag(uint32_t u);
+
+#endif
@@ -3,20 +3,43 @@
 #include "client.h"
 
 #include "log.h"
+#include "queue.h"
 #include "server.h"
+#include "transfer.h"
 
 static void client_ctor(size_t i, void *p) {
     Client *c = (Client*)p;
-    c->next_out_reliable_seqno    = 1; /* important to start with one */
+    size_t j;
+
+    for(j=0; j<CHANNELS; j++) {
+        c->channels[j].next_out    = 1; /* important to start with one */
+        c->channels[j].last_in     = 0;
+        c->channels[j].last_in_ack = 0;
+        c->channels[j].ack         = false;
+    }
 	c->next_out_unreliable_seqno  = 1;
-    c->last_in_ack                = 0;
-    c->last_in_reliable_seqno     = 0;
 	c->last_in_unreliable_seqno   = 0;
-    c->last_in_frameno            = 0;
     c->last_activity              = 0;
     c->misbehavior                = 0;
     c->dead                       = 0;
+    c->lagging                    = 0;
     c->ping                       = 0;
+    c->rev                        = 0;
+    c->relay                      = 0;
+    c->events                     = 0;
+    c->transfer                   = 0;
+    c->last_in_snapshot           = 0;
+
+    INIT_LIST_HEAD(&c->queue);
+
+    mtu_reset(c);
+    rtt_reset(c);
+    latency_reset(c);
+    jitter_reset(c);
+    pacing_reset(c);
+    interest_reset(c);
+    schedule_reset(c);
+    snapshot_reset(c);
 
     player_init(&c->player, i);
 }
@@ -32,12 +55,50 @@ static bool client_check_obsolete(size_t i, void *p) {
     return c->dead; /* (server->client_mask & (1 << i)) == 0; */
 }
 
+/* Remote clients are found by their address in server->addresses, a hash
+ * table with linear probing. On removal, the following entries that
+ * would no longer be found are moved back into the free slot.
+ */
+static size_t client_slot(Address *adr) {
+    return address_hash(adr) % CLIENT_TABLE_SIZE;
+}
+
+static void client_link(Client *c) {
+    size_t i = client_slot(&c->adr);
+    while(server->addresses[i])
+        i = (i + 1) % CLIENT_TABLE_SIZE;
+    server->addresses[i] = c;
+}
+
+static void client_unlink(Client *c) {
+    size_t i = client_slot(&c->adr);
+    size_t j, k;
+
+    while(server->addresses[i] != c) {
+        if(!server->addresses[i])
+            return;
+        i = (i + 1) % CLIENT_TABLE_SIZE;
+    }
+    server->addresses[i] = 0;
+
+    for(j = (i + 1) % CLIENT_TABLE_SIZE; server->addresses[j]; j = (j + 1) % CLIENT_TABLE_SIZE) {
+        k = client_slot(&server->addresses[j]->adr);
+        /* entry j stays if its slot k lies cyclically in (i,j] */
+        if(i < j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+        server->addresses[i] = server->addresses[j];
+        server->addresses[j] = 0;
+        i = j;
+    }
+}
+
 Client *client_create(Address *adr) {
     Client *c = pool_new(&server->clients, Client);
     if(c) {
         c->adr = *adr;
         c->remote = true;
         set_insert(server->connected, c->player.id.n);
+        client_link(c);
         log_debug("+ client %d", c->player.id.n);
     }
     return c;
@@ -56,14 +117,20 @@ Client *client_create_local() {
 void client_remove(Client *c) {
     c->dead = true;
     set_remove(server->connected, c->player.id.n);
+    if(c->remote)
+        client_unlink(c);
+    queue_forget(c);
+    transfer_forget(c);
     log_debug("- client %d", c->player.id.n);
 }
 
 Client *client_lookup(Address *adr) {
-    if(!adr) return 0;
+    size_t i;
     Client *c;
-    clients_foreach(c) {
-        if(c->remote && address_eq(&c->adr, adr))
+
+    if(!adr) return 0;
+    for(i = client_slot(adr); (c = server->addresses[i]); i = (i + 1) % CLIENT_TABLE_SIZE) {
+        if(address_eq(&c->adr, adr))
             return c;
     }
     return 0;
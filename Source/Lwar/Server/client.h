@@ -4,31 +4,86 @@
 #include "address.h"
 #include "clock.h"
 #include "list.h"
+#include "mtu.h"
+#include "pacing.h"
+#include "interest.h"
+#include "jitter.h"
+#include "latency.h"
+#include "message.h"
 #include "player.h"
+#include "rtt.h"
+#include "schedule.h"
+#include "snapshot.h"
+#include "vector.h"
+
+/* a sequence of reliable messages in both directions, see network.txt */
+struct Channel {
+    size_t next_out;    /* seqno of the next reliable message to the client */
+    size_t last_in;     /* of the reliable messages from the client, in order */
+    size_t last_in_ack; /* acknowledged by the client */
+    bool   ack;         /* a ChannelAck is due, see send_acks */
+};
 
 struct Client {
     List _l;
 
     Player player;
     Address adr;
-    size_t ping;   /* TODO: implement */
+    size_t ping;   /* smoothed round-trip time in ms */
 
+    uint8_t rev;   /* protocol revision of the client */
     bool remote;   /* adr is valid */
+    bool relay;    /* forwards the game to spectators and is not a player */
     // bool hasleft;  /* has actively disconnected */
     bool dead;     /* memory will be released, don't use any more */
+    bool lagging;  /* used up the deliveries and is dropped, see queue.c */
 
-    size_t next_out_reliable_seqno;
+    Channel channels[CHANNELS]; /* only CHANNEL_STATE before REVISION_CHANNELS */
 	size_t next_out_unreliable_seqno;
-
-	size_t last_in_reliable_seqno;
 	size_t last_in_unreliable_seqno;
 
-    size_t last_in_ack;
-    size_t last_in_frameno;
     Clock  last_activity;
 
     /* count protocol violations */
     size_t misbehavior;
+
+    /* messages to send, see queue.c */
+    List queue;
+    Events *events; /* open batch of adds or removes */
+
+    /* the world while the client joins, see transfer.c */
+    Transfer *transfer;
+
+    /* packet size, see mtu.c */
+    Mtu mtu;
+
+    /* retransmission timeout, see rtt.c */
+    Rtt rtt;
+
+    /* delays of the input, see latency.c */
+    Latency latency;
+
+    /* input that waits for the simulation, see jitter.c */
+    Jitter jitter;
+
+    /* send rate, see pacing.c */
+    Pacer pacer;
+
+    /* area of interest, see interest.c */
+    Vec view;
+    Interest interest;
+
+    /* update priorities, see schedule.c */
+    Schedule schedule;
+
+    /* delta compression, see snapshot.c */
+    uint32_t last_in_snapshot;
+    Baseline baselines[MAX_ENTITIES];
+};
+
+enum {
+    /* slots of the hash table from addresses to clients */
+    CLIENT_TABLE_SIZE = 2 * MAX_CLIENTS,
 };
 
 void    clients_init();
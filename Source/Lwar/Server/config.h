@@ -1,25 +1,131 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+/* the C# client handles at most 8 players (NetworkProtocol.MaxPlayers),
+ * servers for larger matches can be built with -DSERVER_MAX_CLIENTS=256
+ */
+#ifndef SERVER_MAX_CLIENTS
+#define SERVER_MAX_CLIENTS 8
+#endif
+
 enum {
     /* network */
     APP_ID              = 0xf27087c5,
-	NETWORK_REVISION    =   28,
+    APP_ID_COMPACT      = 0xf27087c6, /* packets with compact headers, see pack.c */
+	NETWORK_REVISION    =   39,
+    MIN_REVISION        =   28, /* oldest revision that is still accepted */
+    CLIENT_REVISION     =   28, /* of the released client, newer ones only with server_revision */
     DEFAULT_PORT        = 32422,
 
     UPDATE_INTERVAL     = 30        /*ms*/, /* only used if server_update is called with force == false */
     TIMEOUT_INTERVAL    = 15 * 1000 /*ms*/, /* drop connection after 15 seconds */
-    RETRANSMIT_INTERVAL =       100 /*ms*/,
+    SHARD_WAIT          =       100 /*ms*/, /* until a shard checks whether to stop */
+    RETRANSMIT_INTERVAL =       100 /*ms*/, /* until the round-trip time of a client is known */
+    UPDATE_BUDGET       =      1024 /*bytes*/, /* default size of the update records per client and update */
+    RELAY_BUDGET        =  8 * 1024 /*bytes*/, /* for a relay, which receives all entities */
+    MAX_RELAYS          =     4, /* addresses that may connect as relays, see server_relay */
     /* TODO: should be a parameter to some function */
     // RETRANSMIT_INTERVAL = 2*UPDATE_INTERVAL,
 
+    /* first revisions that support optional protocol features */
+    REVISION_DELTA      =   29, /* delta-compressed snapshots */
+    REVISION_BITPACK    =   30, /* bit-packed, quantized delta records */
+    REVISION_MTU        =   31, /* negotiated packet size */
+    REVISION_SACK       =   32, /* selective acknowledgements */
+    REVISION_COOKIE     =   33, /* connect cookies */
+    REVISION_RELAY      =   34, /* spectator relays */
+    REVISION_EVENTS     =   35, /* batched adds, removes and collisions */
+    REVISION_CHANNELS   =   36, /* independent reliable channels */
+    REVISION_TRANSFER   =   37, /* the world is streamed to joining clients */
+    REVISION_COMPACT    =   38, /* compact packet and message headers */
+    REVISION_INTEREST   =   39, /* area of interest, entities that leave it are removed */
+
+    /* retransmission of reliable messages, see rtt.c */
+    MIN_RETRANSMIT_INTERVAL =   2 * UPDATE_INTERVAL,
+    MAX_RETRANSMIT_INTERVAL =  1000 /*ms*/,
+    RETRANSMIT_BACKOFF  =     3, /* how often the timeout is doubled for the same message */
+    FAST_RETRANSMIT     =     3, /* later messages acknowledged before a missing one is resent */
+
+    /* send rate of each client, see pacing.c */
+    PACING_INITIAL_RATE =   64 * 1024 /*bytes/s*/,
+    PACING_MIN_RATE     =    8 * 1024 /*bytes/s*/,
+    PACING_MAX_RATE     = 1024 * 1024 /*bytes/s*/,
+    PACING_BURST        =   2 * 1200  /*bytes*/, /* two packets of the largest size */
+    PACING_DELAY        =   100 /*ms*/, /* growth of the round-trip time that counts as congestion */
+    PACING_QUEUE        =     8, /* packets that may wait for the rate */
+
+    /* the world as it is streamed to joining clients, see transfer.c */
+    TRANSFER_CHUNK      =   448 /*bytes*/, /* payload of a Chunk, fits into the smallest packet */
+    TRANSFER_WINDOW     =    16, /* chunks after the first unacknowledged one that may be sent */
+    TRANSFER_LENGTH     = 64 * 1024 /*bytes*/, /* larger worlds are sent message by message */
+    TRANSFER_CHUNKS     = (TRANSFER_LENGTH + TRANSFER_CHUNK - 1) / TRANSFER_CHUNK,
+    MAX_TRANSFERS       =     4, /* joining clients at the same time, the others join message by message */
+
+    /* admission of packets from unknown senders, see ingress.c */
+    INGRESS_SOURCES     =  1024, /* senders whose rate is tracked */
+    INGRESS_RATE        =     4 /*packets/s*/, /* of each unknown sender */
+    INGRESS_BURST       =     8 /*packets*/,
+    INGRESS_TOTAL_RATE  =   256 /*packets/s*/, /* of all unknown senders together */
+    INGRESS_TOTAL_BURST =    64 /*packets*/,
+    INGRESS_LEGACY_RATE =     1 /*clients/s*/, /* created without a cookie, before REVISION_COOKIE */
+    INGRESS_LEGACY_BURST=     4 /*clients*/,
+    COOKIE_INTERVAL     = 10000 /*ms*/, /* a cookie is valid for one to two intervals */
+
+    /* send intervals of the periodic messages, see rate.c */
+    STATS_INTERVAL      =   500 /*ms*/, /* ~2 Hz, and only the pages that changed */
+    STATS_REFRESH       =  2000 /*ms*/, /* unchanged pages are resent, they may have been lost */
+    STATS_PING          =    10 /*ms*/, /* smaller changes of a ping wait for the refresh */
+    SHIP_INTERVAL       = UPDATE_INTERVAL, /* of the update formats, see rules.c */
+    POS_INTERVAL        = UPDATE_INTERVAL,
+    RAY_INTERVAL        = UPDATE_INTERVAL,
+    CIRCLE_INTERVAL     = UPDATE_INTERVAL,
+    BODY_INTERVAL       = 4 * UPDATE_INTERVAL, /* planets and suns move slowly, see format_body */
+
+    /* delays of the input, see latency.c */
+    LATENCY_BUCKETS     =    80, /* four per power of two microseconds, up to 2s */
+
+    /* buffering of the input, see jitter.c */
+    INPUT_INTERVAL      =    33 /*ms*/, /* a frame of the clients, ~30 Hz, until it is measured */
+    INPUT_MIN_INTERVAL  =    16 /*ms*/, /* bounds of the measured frame interval */
+    INPUT_MAX_INTERVAL  =   133 /*ms*/,
+    INPUT_RATE_FRAMES   =    30, /* frames over which the interval is measured, ~1 s */
+    INPUT_HISTORY       =     8, /* frames in an Input message */
+    INPUT_FRAMES        =    32, /* buffered per client, more than INPUT_MAX_DEPTH + INPUT_HISTORY */
+    INPUT_MIN_DEPTH     =     1, /* frames */
+    INPUT_MAX_DEPTH     =     8, /* frames, bounds the delay of the input */
+    INPUT_CALM          =  2000 /*ms*/, /* without underrun until the buffer shrinks */
+
+    /* probing of larger packets, see mtu.c */
+    MTU_PROBE_INTERVAL  =   250 /*ms*/,
+    MTU_PROBE_TRIES     =     3, /* lost probes before trying a smaller size */
+    MTU_PROBE_STEP      =    64 /*bytes*/, /* smallest size difference worth probing */
+
+    /* precision of bit-packed delta records */
+    POSITION_SHIFT      =    1, /* positions are sent in units of 2^POSITION_SHIFT */
+    ANGLE_BITS          =   12, /* angles are sent as fractions of 2^ANGLE_BITS, at most 15 */
+
     /* capacity */
-    MAX_CLIENTS         =    8,
+    MAX_CLIENTS         = SERVER_MAX_CLIENTS,
     MAX_ENTITIES        = 4096,
     MAX_ENTITY_TYPES    =   32,
-    MAX_COLLISIONS      =   32, /* should be n^2-1 for priority queue */
-    MAX_QUEUE           = 4096,
-    MAX_STRINGS         =  128,
+    MAX_COLLISIONS      = MAX_CLIENTS > 8 ? 16 * MAX_CLIENTS - 1 : 32, /* should be n^2-1 for priority queue */
+    MAX_QUEUE           = MAX_CLIENTS > 16 ? 512 * MAX_CLIENTS : 4096, /* unacknowledged messages of all clients */
+    MAX_DELIVERIES      = 2 * MAX_QUEUE, /* queued messages times their receivers */
+    MAX_BATCHES         = MAX_QUEUE / 4, /* batched adds, removes and collisions, see queue.c */
+    BATCH_LENGTH        =  256, /* bytes of the records of a batched message */
+    MAX_BACKLOG         = 2 * MAX_CLIENTS + 256, /* unacknowledged messages before a client is dropped */
+    MAX_STATS           =    8, /* players per Stats message */
+    STATS_PAGES         = (MAX_CLIENTS + MAX_STATS - 1) / MAX_STATS,
+    MAX_STRINGS         = MAX_CLIENTS > 32 ? 4 * MAX_CLIENTS : 128, /* interned names and chat messages, see str.c */
+    MAX_SCRATCH         = 64 * 1024, /* bytes of decoded strings per tick, see arena.c */
+    MAX_SHARDS          =    8, /* receive threads, see shard.c */
+    SHARD_QUEUE         =  256, /* datagrams per shard */
+    LOCAL_QUEUE         =   64, /* datagrams in each direction of the in-process client, see local.c */
+    NETEM_QUEUE         =   64, /* datagrams in each direction of an emulated path, see netem.c */
+    URING_BUFFERS       =  256, /* receive buffers of the io_uring backend, a power of two */
+    URING_BUFFER_SIZE   = 2048, /* header, address, receive time and payload of a datagram */
+    URING_SEND          =   64, /* datagrams that may be sent at once */
+    MAX_SNAPSHOTS       =   32, /* at most DELTA_BASE+1 and the bits in Baseline.mask */
 
     NUM_SLOTS           =    4,
 
@@ -30,6 +136,9 @@ enum {
 
     MISBEHAVIOR_LIMIT   =   10,
 
+    INTEREST_RADIUS     = 10000, /* entities are sent to clients within this distance */
+    INTEREST_HYSTERESIS =  2000, /* and removed when they are further away by this margin */
+
     MAX_PLANETS         = 11,
     MIN_PLANET_DIST     = 2500,
     MAX_PLANET_DIST     = 2500,
@@ -5,6 +5,9 @@
 #include "config.h"
 #include "debug.h"
 #include "log.h"
+#include "netem.h"
+#include "packet.h"
+#include "uring.h"
 
 #include <stdint.h>
 #include <stdio.h>
@@ -17,8 +20,10 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 typedef int Socket;
@@ -34,6 +39,7 @@ typedef int Socket;
 #include <ws2tcpip.h>
 
 typedef SOCKET Socket;
+#define poll WSAPoll
 #define socket_error(s)   ((s) == SOCKET_ERROR)
 #define socket_invalid(s) ((s) == INVALID_SOCKET)
 #endif
@@ -41,10 +47,23 @@ typedef SOCKET Socket;
 
 #define socket_valid(s)   (! socket_invalid(s))
 
+/* shards receive on their own threads */
+#ifdef __unix__
+#define count_syscall(c) __atomic_fetch_add(&(c)->syscalls, 1, __ATOMIC_RELAXED)
+#else
+#define count_syscall(c) ((c)->syscalls ++)
+#endif
+
 static int numConnections = 0;
 
 struct Connection {
 	Socket socket;
+	unsigned syscalls; /* see conn_syscalls */
+#ifdef __linux__
+	Uring* uring; /* see conn_uring */
+#endif
+	uint64_t stamp; /* see conn_stamp */
+	Netem* netem; /* see conn_emulate */
 };
 
 static void conn_error(const char* const msg)
@@ -113,6 +132,13 @@ bool conn_init(Connection* connection)
 		return false;
 	}
 
+#ifdef SO_TIMESTAMPNS
+	/* the kernel tells when each datagram arrived, see conn_stamp */
+	int stamps = 1;
+	if (setsockopt(connection->socket, SOL_SOCKET, SO_TIMESTAMPNS, (char*)&stamps, sizeof(stamps)) != 0)
+		log_warn("Receive timestamps are not supported.");
+#endif
+
 	return true;
 }
 
@@ -120,6 +146,14 @@ void conn_shutdown(Connection* connection)
 {
 	assert(numConnections > 0);
 
+#ifdef __linux__
+	if (connection->uring)
+		uring_destroy(connection->uring);
+#endif
+
+	if (connection->netem)
+		netem_destroy(connection->netem);
+
 	if (socket_error(closesocket(connection->socket)))
 		conn_error("Unable to close socket.");
 
@@ -155,38 +189,111 @@ bool conn_bind(Connection* connection, unsigned short port)
 	return true;
 }
 
-bool conn_recv(Connection* connection, char *buf, size_t* size, Address* adr)
+bool conn_share(Connection* connection)
 {
-	struct sockaddr_storage from;
-	struct sockaddr_in6* from6;
-	struct sockaddr_in* from4;
-	socklen_t len = sizeof(from);
+#ifdef SO_REUSEPORT
+	int reuse = 1;
+	if (setsockopt(connection->socket, SOL_SOCKET, SO_REUSEPORT, (char*)&reuse, sizeof(reuse)) == 0)
+		return true;
+#endif
 
-	memset(&from, 0, len);
-	
-	int read_bytes = recvfrom(connection->socket, buf, *size, 0, (struct sockaddr*)&from, &len);
-#ifdef _MSC_VER
-	if (WSAGetLastError() == WSAEWOULDBLOCK)
+	conn_error("Unable to share the port.");
+	return false;
+}
+
+int conn_fd(Connection* connection)
+{
+	/* also with io_uring: its completions are only posted once the task
+	 * enters the kernel, until then the datagrams wait in the socket
+	 */
+	return (int)connection->socket;
+}
+
+bool conn_wait(Connection* connection, int timeout)
+{
+	struct pollfd fd;
+	fd.fd      = connection->socket;
+	fd.events  = POLLIN;
+	fd.revents = 0;
+
+	return poll(&fd, 1, timeout) > 0;
+}
+
+bool conn_uring(Connection* connection)
+{
+#ifdef __linux__
+	if (!connection->uring)
+		connection->uring = uring_create(connection->socket, &connection->syscalls);
+	return connection->uring != 0;
+#else
+	return false;
 #endif
+}
+
+unsigned conn_syscalls(Connection* connection)
+{
 #ifdef __unix__
-	if (socket_error(read_bytes) && errno == EAGAIN)
+	return __atomic_exchange_n(&connection->syscalls, 0, __ATOMIC_RELAXED);
+#else
+	unsigned n = connection->syscalls;
+	connection->syscalls = 0;
+	return n;
 #endif
-	{
-		*size = 0;
-		return true;
-	}
+}
+
+static bool conn_release(Connection* connection, uint64_t now);
+
+bool conn_emulate(Connection* connection, const char* spec)
+{
+	NetemConfig cfg;
+
+	if (!netem_parse(&cfg, spec))
+		return false;
+
+	if (!connection->netem)
+		connection->netem = netem_create(&cfg);
+	return connection->netem != 0;
+}
+
+bool conn_due(Connection* connection, uint64_t* wait)
+{
+	uint64_t due, now;
+
+	if (!connection->netem || !netem_next(connection->netem, &due))
+		return false;
+
+	now = netem_time();
+	*wait = due > now ? due - now : 0;
+	return true;
+}
 
-	switch (from.ss_family)
+void conn_flush(Connection* connection)
+{
+	if (connection->netem)
+		conn_release(connection, netem_time());
+
+#ifdef __linux__
+	if (connection->uring)
+		uring_flush(connection->uring);
+#endif
+}
+
+static void conn_address(struct sockaddr_storage* from, Address* adr)
+{
+	struct sockaddr_in6* from6;
+	struct sockaddr_in* from4;
+
+	switch (from->ss_family)
 	{
 	case AF_INET:
-		from4 = (struct sockaddr_in*)&from;
+		from4 = (struct sockaddr_in*)from;
 		adr->port = from4->sin_port;
 		memset(adr->ip, 0, sizeof(adr->ip));
 		memcpy(adr->ip, &from4->sin_addr, sizeof(int32_t));
 		adr->isIPv6 = false;
 		break;
 	case AF_INET6:
-		from6 = (struct sockaddr_in6*)&from;
+		from6 = (struct sockaddr_in6*)from;
 		adr->port = from6->sin6_port;
 		memcpy(adr->ip, &from6->sin6_addr, sizeof(adr->ip));
 		adr->isIPv6 = true;
@@ -194,6 +301,101 @@ bool conn_recv(Connection* connection, char *buf, size_t* size, Address* adr)
 	default:
 		log_die("Unsupported address family.");
 	}
+}
+
+#ifdef SO_TIMESTAMPNS
+static uint64_t conn_timespec(const struct timespec* t)
+{
+	return (uint64_t)t->tv_sec * 1000000 + (uint64_t)t->tv_nsec / 1000;
+}
+
+/* receive time in the control messages of a datagram, 0 if there is none,
+ * also used by uring.c
+ */
+uint64_t conn_cmsg_stamp(struct msghdr* msg)
+{
+	struct cmsghdr* cmsg;
+	struct timespec t;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+	{
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+		{
+			memcpy(&t, CMSG_DATA(cmsg), sizeof(t));
+			return conn_timespec(&t);
+		}
+	}
+	return 0;
+}
+#endif
+
+uint64_t conn_stamp(Connection* connection)
+{
+	return connection->stamp;
+}
+
+uint64_t conn_time()
+{
+#ifdef SO_TIMESTAMPNS
+	struct timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	return conn_timespec(&t);
+#else
+	return 0;
+#endif
+}
+
+static bool conn_recv_socket(Connection* connection, char *buf, size_t* size, Address* adr)
+{
+	struct sockaddr_storage from;
+	socklen_t len = sizeof(from);
+
+	memset(&from, 0, len);
+	connection->stamp = 0;
+
+#ifdef __linux__
+	if (connection->uring)
+	{
+		if (!uring_recv(connection->uring, buf, size, &from, &connection->stamp))
+			return false;
+		if (*size != 0)
+			conn_address(&from, adr);
+		return true;
+	}
+#endif
+
+	count_syscall(connection);
+#ifdef SO_TIMESTAMPNS
+	char control[CMSG_SPACE(sizeof(struct timespec))];
+	struct iovec iov = { buf, *size };
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name       = &from;
+	msg.msg_namelen    = len;
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = control;
+	msg.msg_controllen = sizeof(control);
+
+	int read_bytes = recvmsg(connection->socket, &msg, 0);
+	if (!socket_error(read_bytes))
+		connection->stamp = conn_cmsg_stamp(&msg);
+#else
+	int read_bytes = recvfrom(connection->socket, buf, *size, 0, (struct sockaddr*)&from, &len);
+#endif
+#ifdef _MSC_VER
+	if (WSAGetLastError() == WSAEWOULDBLOCK)
+#endif
+#ifdef __unix__
+	if (socket_error(read_bytes) && errno == EAGAIN)
+#endif
+	{
+		*size = 0;
+		return true;
+	}
+
+	conn_address(&from, adr);
 
 	if (socket_error(read_bytes))
 	{
@@ -206,7 +408,7 @@ bool conn_recv(Connection* connection, char *buf, size_t* size, Address* adr)
 	return true;
 }
 
-bool conn_send(Connection* connection, const char *buf, size_t size, Address* adr)
+static bool conn_send_socket(Connection* connection, const char *buf, size_t size, Address* adr)
 {
 	struct sockaddr_in addr4;
 	struct sockaddr_in6 addr6;
@@ -232,6 +434,12 @@ bool conn_send(Connection* connection, const char *buf, size_t size, Address* ad
 		len = sizeof(addr4);
 	}
 
+#ifdef __linux__
+	if (connection->uring)
+		return uring_send(connection->uring, buf, size, addr, len);
+#endif
+
+	count_syscall(connection);
 	int sent = sendto(connection->socket, buf, size, 0, addr, len);
 	if (socket_error(sent))
 	{
@@ -247,3 +455,62 @@ bool conn_send(Connection* connection, const char *buf, size_t size, Address* ad
 
 	return true;
 }
+
+/* send the emulated datagrams that have left their path */
+static bool conn_release(Connection* connection, uint64_t now)
+{
+	char buf[MAX_PACKET_LENGTH];
+	size_t size = sizeof(buf);
+	Address adr;
+
+	while (netem_get(connection->netem, NETEM_OUT, now, buf, &size, &adr))
+	{
+		if (!conn_send_socket(connection, buf, size, &adr))
+			return false;
+		size = sizeof(buf);
+	}
+	return true;
+}
+
+bool conn_recv(Connection* connection, char *buf, size_t* size, Address* adr)
+{
+	size_t capacity = *size;
+	uint64_t now;
+
+	if (!connection->netem)
+		return conn_recv_socket(connection, buf, size, adr);
+
+	now = netem_time();
+	if (!conn_release(connection, now))
+		return false;
+
+	/* all datagrams that have arrived enter the path */
+	for (;;)
+	{
+		*size = capacity;
+		if (!conn_recv_socket(connection, buf, size, adr))
+			return false;
+		if (*size == 0)
+			break;
+		netem_put(connection->netem, NETEM_IN, buf, *size, adr, now);
+	}
+
+	*size = capacity;
+	if (netem_get(connection->netem, NETEM_IN, now, buf, size, adr))
+		connection->stamp = conn_time();
+	else
+		*size = 0;
+	return true;
+}
+
+bool conn_send(Connection* connection, const char *buf, size_t size, Address* adr)
+{
+	uint64_t now;
+
+	if (!connection->netem)
+		return conn_send_socket(connection, buf, size, adr);
+
+	now = netem_time();
+	netem_put(connection->netem, NETEM_OUT, buf, size, adr, now);
+	return conn_release(connection, now);
+}
@@ -3,6 +3,8 @@
 
 #include "address.h"
 
+#include <stdint.h>
+
 bool conn_init(Connection* connection);
 void conn_shutdown(Connection* connection);
 
@@ -10,7 +12,45 @@ bool conn_isup(Connection *connection);
 
 bool conn_bind(Connection* connection, unsigned short port);
 
+/* allow several connections to bind the same port, the kernel
+ * distributes the datagrams by the address of the sender
+ */
+bool conn_share(Connection* connection);
+
+/* descriptor that can be polled for incoming datagrams */
+int conn_fd(Connection* connection);
+
+/* block until a datagram can be received or timeout millisecs passed */
+bool conn_wait(Connection* connection, int timeout);
+
+/* switch to the io_uring backend, see uring.c,
+ * keeps the sockets if the kernel does not support it
+ */
+bool conn_uring(Connection* connection);
+
 bool conn_recv(Connection* connection, char *buf, size_t* size, Address* adr);
 bool conn_send(Connection* connection, const char *buf, size_t size, Address* adr);
 
+/* time in microseconds at which the kernel received the datagram that
+ * conn_recv returned last, 0 if unknown, in the clock of conn_time
+ */
+uint64_t conn_stamp(Connection* connection);
+uint64_t conn_time();
+
+/* emulate the network conditions of spec in both directions,
+ * see netem.h, false if spec is invalid
+ */
+bool conn_emulate(Connection* connection, const char* spec);
+
+/* microseconds until the next emulated datagram is due,
+ * false if there is none
+ */
+bool conn_due(Connection* connection, uint64_t* wait);
+
+/* send what conn_send may have queued */
+void conn_flush(Connection* connection);
+
+/* system calls to receive and send since the last call */
+unsigned conn_syscalls(Connection* connection);
+
 #endif
@@ -149,6 +149,48 @@ void debug_message(Message *m, const char *s) {
     case MESSAGE_COLLISION:
         log_debug("%scollision %d:%d, %d:%d", s, ID_ARG(m->collision.entity_id[0]), ID_ARG(m->collision.entity_id[1]));
         break;
+    case MESSAGE_DELTA:
+        log_debug("%sdelta snapshot %u part %d format %d #%d", s, m->delta.snapshot, m->delta.part & ~DELTA_LAST, m->delta.format, m->delta.n);
+        break;
+    case MESSAGE_DELTA_ACK:
+        log_debug("%sdelta ack %u", s, m->delta_ack.snapshot);
+        break;
+    case MESSAGE_MTU:
+        log_debug("%smtu %d", s, m->mtu.size);
+        break;
+    case MESSAGE_MTU_ACK:
+        log_debug("%smtu ack %d", s, m->mtu_ack.size);
+        break;
+    case MESSAGE_MTU_PROBE:
+        log_debug("%smtu probe %d", s, m->mtu_probe.size);
+        break;
+    case MESSAGE_SACK:
+        log_debug("%ssack %u mask %08x", s, m->sack.ack, m->sack.mask);
+        break;
+    case MESSAGE_COOKIE:
+        log_debug("%scookie %08x", s, m->cookie.value);
+        break;
+    case MESSAGE_RELAY:
+        log_debug("%srelay", s);
+        break;
+    case MESSAGE_ADDS:
+        log_debug("%sadds #%d", s, m->events.n);
+        break;
+    case MESSAGE_REMOVES:
+        log_debug("%sremoves #%d", s, m->events.n);
+        break;
+    case MESSAGE_COLLISIONS:
+        log_debug("%scollisions #%d", s, m->events.n);
+        break;
+    case MESSAGE_CHANNEL_ACK:
+        log_debug("%sack %u mask %08x of channel %d", s, m->channel_ack.ack, m->channel_ack.mask, m->channel_ack.channel);
+        break;
+    case MESSAGE_CHUNK:
+        log_debug("%schunk %d/%d, %d bytes", s, m->chunk.index, m->chunk.count, m->chunk.len);
+        break;
+    case MESSAGE_CHUNK_ACK:
+        log_debug("%schunk ack %d mask %08x", s, m->chunk_ack.next, m->chunk_ack.mask);
+        break;
     }
 }
 
@@ -159,7 +201,10 @@ void debug_message(Message *m, const char *s) {
 */
 
 void debug_header(Header *h, const char *s) {
-    log_debug("%sack %d", s, h->ack);
+    if(h->app_id == APP_ID_COMPACT)
+        log_debug("%sack %d frame %d time %d", s, h->ack, h->frame, h->time);
+    else
+        log_debug("%sack %d", s, h->ack);
 }
 
 void debug_packet(Packet *p) {
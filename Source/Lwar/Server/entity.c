@@ -63,6 +63,7 @@ void entity_hit(Entity *e, Real damage, Player *k) {
     }
 
     e->health -= damage;
+    e->hit = server->cur_clock;
 	if (e->health <= 0)
 		entity_remove(e);
 }
@@ -160,6 +161,7 @@ Entity *entity_create(EntityType *t, Player *p, Vec x, Vec v) {
     e->interval = t->init_interval;
     e->energy = t->init_energy;
     e->health = t->init_health;
+    e->hit    = 0;
     e->shield = t->init_shield;
     e->len    = t->init_len;
     e->mass   = t->init_mass;
@@ -59,6 +59,7 @@ struct Entity {
 
     Real energy;  /* ammunition, fuel, damage ... */
     Real health;
+    Clock hit;    /* time of the last damage, 0 if none */
     Real shield;  /* damage multiplier */
     Real len;
     Real mass;
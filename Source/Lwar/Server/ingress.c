@@ -0,0 +1,235 @@
+#include "types.h"
+
+#include "ingress.h"
+
+#include "client.h"
+#include "log.h"
+#include "message.h"
+#include "packet.h"
+#include "performance.h"
+#include "server.h"
+#include "uint.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Packets of connected clients are only checked for their length and
+ * application id. Packets of unknown senders may be spoofed and are
+ * limited before they are decoded: by a token bucket for each sender,
+ * which is kept for the INGRESS_SOURCES senders that were seen last, and
+ * by a token bucket for all of them together, which bounds the work per
+ * tick however many addresses a flood uses. Packets that echo a valid
+ * cookie are only limited per sender, so that clients can still connect
+ * while a flood uses up the global bucket.
+ *
+ * Clients of revision 33 or later must echo a cookie before the server
+ * creates any state for them (see protocol.c). The cookie is a SipHash of
+ * the sender address and the current COOKIE_INTERVAL under a random key,
+ * so a sender has to receive packets at its address to get a valid one,
+ * and the server does not need to remember it. Older clients cannot echo
+ * a cookie, the clients created for them share a small token bucket, so
+ * that spoofed connects of an old revision create few clients as well.
+ */
+
+#define ROTL(x,b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND \
+    do { \
+        v0 += v1; v1 = ROTL(v1,13); v1 ^= v0; v0 = ROTL(v0,32); \
+        v2 += v3; v3 = ROTL(v3,16); v3 ^= v2; \
+        v0 += v3; v3 = ROTL(v3,21); v3 ^= v0; \
+        v2 += v1; v1 = ROTL(v1,17); v1 ^= v2; v2 = ROTL(v2,32); \
+    } while(0)
+
+/* SipHash-2-4 */
+static uint64_t siphash(const uint64_t key[2], const uint8_t *in, size_t len) {
+    uint64_t v0 = 0x736f6d6570736575ull ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dull ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ull ^ key[0];
+    uint64_t v3 = 0x7465646279746573ull ^ key[1];
+    uint64_t b = (uint64_t)len << 56, m;
+    size_t i, j;
+
+    for(i=0; i+8 <= len; i+=8) {
+        for(m=0, j=0; j<8; j++)
+            m |= (uint64_t)in[i+j] << (8*j);
+        v3 ^= m; SIPROUND; SIPROUND; v0 ^= m;
+    }
+    for(j=0; i+j < len; j++)
+        b |= (uint64_t)in[i+j] << (8*j);
+
+    v3 ^= b; SIPROUND; SIPROUND; v0 ^= b;
+    v2 ^= 0xff;
+    SIPROUND; SIPROUND; SIPROUND; SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/* the address and a tag, without the padding of Address */
+static uint64_t address_mac(Address *adr, uint32_t tag) {
+    uint8_t in[sizeof(adr->ip) + 2 + 1 + 4];
+    size_t i = 0;
+
+    memcpy(in, adr->ip, sizeof(adr->ip)); i += sizeof(adr->ip);
+    i += uint16_pack((char*)in+i, adr->port);
+    in[i++] = adr->isIPv6;
+    i += uint32_pack((char*)in+i, tag);
+    return siphash(server->ingress.key, in, i);
+}
+
+static void random_key(uint64_t key[2]) {
+    FILE *f = fopen("/dev/urandom", "rb");
+    if(f) {
+        size_t n = fread(key, sizeof(uint64_t), 2, f);
+        fclose(f);
+        if(n == 2) return;
+    }
+
+    /* not secret, but still unknown to a sender that cannot see replies */
+    log_warn("No random source, cookies can be guessed more easily.");
+    key[0] = (uint64_t)time(0) ^ (uint64_t)(uintptr_t)key;
+    key[1] = (uint64_t)clock() ^ (uint64_t)(uintptr_t)&random_key;
+}
+
+/* relays see all entities and receive a larger budget, so only the
+ * addresses that the host has configured may connect as relays; they
+ * are kept when the server is initialized again
+ */
+static Address relays[MAX_RELAYS];
+static size_t nrelays;
+
+bool ingress_relay_allow(const char *ip) {
+    if(nrelays == MAX_RELAYS || !address_parse_ip(&relays[nrelays], ip))
+        return false;
+    nrelays ++;
+    return true;
+}
+
+bool ingress_relay_allowed(Address *adr) {
+    size_t i;
+    for(i=0; i<nrelays; i++) {
+        if(address_eq_ip(&relays[i], adr))
+            return true;
+    }
+    return false;
+}
+
+void ingress_init() {
+    Ingress *in = &server->ingress;
+    memset(in, 0, sizeof(Ingress));
+    INIT_LIST_HEAD(&in->lru);
+    random_key(in->key);
+}
+
+static bool bucket_take(Bucket *b, size_t rate, size_t burst) {
+    Clock now = server->cur_clock;
+
+    if(!b->refill) {
+        b->tokens = burst * 1000;
+    } else if(now > b->refill) {
+        b->tokens = min(b->tokens + (size_t)(now - b->refill) * rate, burst * 1000);
+    }
+    b->refill = max(now, (Clock)1);
+
+    if(b->tokens < 1000)
+        return false;
+    b->tokens -= 1000;
+    return true;
+}
+
+bool ingress_legacy_admit() {
+    return bucket_take(&server->ingress.legacy, INGRESS_LEGACY_RATE, INGRESS_LEGACY_BURST);
+}
+
+static size_t source_slot(Address *adr) {
+    /* keyed, so that a flood cannot aim at a single slot */
+    return (size_t)(address_mac(adr, 0) % INGRESS_TABLE_SIZE);
+}
+
+static Source *source_get(Address *adr) {
+    Ingress *in = &server->ingress;
+    size_t i = source_slot(adr);
+    Source *s, **p;
+
+    for(s = in->table[i]; s; s = s->next) {
+        if(address_eq(&s->adr, adr)) {
+            list_move(&s->lru, &in->lru);
+            return s;
+        }
+    }
+
+    /* replace the sender that was seen longest ago */
+    if(in->n < INGRESS_SOURCES) {
+        s = &in->sources[in->n ++];
+    } else {
+        s = list_entry(in->lru.prev, Source, lru);
+        list_del(&s->lru);
+        for(p = &in->table[source_slot(&s->adr)]; *p != s; p = &(*p)->next);
+        *p = s->next;
+    }
+
+    memset(s, 0, sizeof(Source));
+    s->adr  = *adr;
+    s->next = in->table[i];
+    in->table[i] = s;
+    list_add(&s->lru, &in->lru);
+    return s;
+}
+
+/* whether the packet starts with a valid cookie, which a flood of
+ * spoofed packets cannot have
+ */
+static bool has_cookie(const char *p, size_t size, Address *adr) {
+    uint32_t app_id, cookie;
+
+    /* clients connect with full headers */
+    if(size < HEADER_LENGTH + MESSAGE_LENGTH_COOKIE)
+        return false;
+    uint32_unpack(p, &app_id);
+    if(app_id != APP_ID || (uint8_t)p[HEADER_LENGTH] != MESSAGE_COOKIE)
+        return false;
+
+    uint32_unpack(p + HEADER_LENGTH + MESSAGE_HEADER_LENGTH, &cookie);
+    return ingress_cookie_valid(adr, cookie);
+}
+
+bool ingress_admit(const char *p, size_t size, Address *adr) {
+    Ingress *in = &server->ingress;
+    uint32_t app_id;
+    bool ok;
+
+    /* a header and at least one message */
+    ok = size >= COMPACT_HEADER_LENGTH + COMPACT_MESSAGE_HEADER_LENGTH;
+    if(ok) {
+        uint32_unpack(p, &app_id);
+        if(app_id == APP_ID)
+            ok = size >= HEADER_LENGTH + MESSAGE_HEADER_LENGTH;
+        else
+            ok = app_id == APP_ID_COMPACT;
+    }
+
+    if(ok && !client_lookup(adr)) {
+        ok =    bucket_take(&source_get(adr)->bucket, INGRESS_RATE, INGRESS_BURST)
+             && (   has_cookie(p, size, adr)
+                 || bucket_take(&in->unknown, INGRESS_TOTAL_RATE, INGRESS_TOTAL_BURST));
+    }
+
+    if(!ok)
+        counter_set(COUNTER_FILTERED, 1);
+    return ok;
+}
+
+static uint32_t cookie_at(Address *adr, Clock t) {
+    return (uint32_t)address_mac(adr, (uint32_t)(t / COOKIE_INTERVAL + 1));
+}
+
+uint32_t ingress_cookie(Address *adr) {
+    return cookie_at(adr, server->cur_clock);
+}
+
+/* cookies of the previous interval are accepted as well */
+bool ingress_cookie_valid(Address *adr, uint32_t cookie) {
+    Clock t = server->cur_clock;
+    return    cookie == cookie_at(adr, t)
+           || (t >= COOKIE_INTERVAL && cookie == cookie_at(adr, t - COOKIE_INTERVAL));
+}
@@ -0,0 +1,59 @@
+#ifndef INGRESS_H
+#define INGRESS_H
+
+#include <stdint.h>
+
+#include "address.h"
+#include "clock.h"
+#include "config.h"
+#include "list.h"
+#include "types.h"
+
+/* token bucket of packets */
+struct Bucket {
+    size_t tokens; /* in thousandths of a packet */
+    Clock  refill;
+};
+
+/* an unknown sender, see ingress.c */
+struct Source {
+    List     lru;
+    Source  *next; /* in the same slot of the hash table */
+    Address  adr;
+    Bucket   bucket;
+};
+
+enum {
+    /* slots of the hash table from addresses to sources */
+    INGRESS_TABLE_SIZE = 2 * INGRESS_SOURCES,
+};
+
+struct Ingress {
+    uint64_t key[2];  /* of the cookies and the hash table */
+    Bucket   unknown; /* all packets of unknown senders */
+    Bucket   legacy;  /* all clients that connect without a cookie */
+    List     lru;     /* sources, most recently seen first */
+    size_t   n;
+    Source  *table[INGRESS_TABLE_SIZE];
+    Source   sources[INGRESS_SOURCES];
+};
+
+void ingress_init();
+
+/* allow spectator relays to connect from ip, see server_relay */
+bool ingress_relay_allow(const char *ip);
+
+/* whether a Relay message from adr is accepted */
+bool ingress_relay_allowed(Address *adr);
+
+/* cheap checks of a received packet before it is decoded */
+bool ingress_admit(const char *p, size_t size, Address *adr);
+
+/* whether a client may be created for a connect without a cookie */
+bool ingress_legacy_admit();
+
+/* the cookie a client echoes to connect, see network.txt */
+uint32_t ingress_cookie(Address *adr);
+bool     ingress_cookie_valid(Address *adr, uint32_t cookie);
+
+#endif
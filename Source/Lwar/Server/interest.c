@@ -0,0 +1,139 @@
+#include "types.h"
+
+#include "interest.h"
+
+#include "client.h"
+#include "entity.h"
+#include "message.h"
+#include "queue.h"
+#include "schedule.h"
+#include "server.h"
+#include "snapshot.h"
+#include "vector.h"
+
+#include <limits.h>
+#include <string.h>
+
+/* Each client only knows about entities within INTEREST_RADIUS of its ship
+ * (or where its ship was last seen). An entity that has been added to the
+ * client is kept until it is INTEREST_HYSTERESIS further away, such that
+ * entities near the border do not flap between add and remove.
+ * Entities of the server (planets, sun) and of the client itself are always relevant,
+ * a relay receives all entities for its spectators. Clients before REVISION_INTEREST
+ * receive all entities as well, they take a Remove for the destruction of the entity.
+ */
+
+#define visible_word(c,n) (c)->interest.visible[(n) / 32]
+#define visible_bit(n)    ((uint32_t)1 << ((n) % 32))
+
+static bool visible(Client *c, size_t n) {
+    return (visible_word(c,n) & visible_bit(n)) != 0;
+}
+
+static void set_visible(Client *c, Entity *e, bool v) {
+    if(v) {
+        visible_word(c,e->id.n) |= visible_bit(e->id.n);
+    } else {
+        visible_word(c,e->id.n) &= ~visible_bit(e->id.n);
+        schedule_forget(c, e);
+        snapshot_forget(c, e);
+    }
+}
+
+static bool is_relevant(Client *c, Entity *e, bool known) {
+    Real r = INTEREST_RADIUS + (known ? INTEREST_HYSTERESIS : 0);
+
+    if(c->relay || c->rev < REVISION_INTEREST)
+        return true;
+    if(e->player == &server->self->player || e->player == &c->player)
+        return true;
+
+    /* the parent has to be added first */
+    if(e->parent_id.n != USHRT_MAX && !visible(c, e->parent_id.n))
+        return false;
+
+    return len(sub(e->x, c->view)) - e->radius < r;
+}
+
+bool interest_contains(Client *c, Entity *e) {
+    return visible(c, e->id.n);
+}
+
+void interest_reset(Client *c) {
+    memset(&c->interest, 0, sizeof(Interest));
+    c->view = _0;
+}
+
+void interest_update(Client *c) {
+    Message m;
+    Format *f;
+    Entity *e;
+    bool known, relevant;
+
+    if(c->player.ship.entity)
+        c->view = c->player.ship.entity->x;
+
+    formats_foreach(f) {
+        updates_foreach(f,e) {
+            known    = interest_contains(c, e);
+            relevant = is_relevant(c, e, known);
+            if(known == relevant)
+                continue;
+
+            /* leave room for broadcasts and for the backlog of c,
+             * the entity is retried on the next update
+             */
+            if(!queue_room(MAX_CLIENTS) || queue_backlog(c) > MAX_BACKLOG / 2)
+                return;
+
+            if(relevant) message_add(&m, e);
+            else         message_remove(&m, e);
+
+            queue_event(c, &m);
+            set_visible(c, e, relevant);
+        }
+    }
+}
+
+size_t interest_join(Client *c, Entity **es, size_t max) {
+    Format *f;
+    Entity *e;
+    size_t n = 0, k;
+
+    if(c->player.ship.entity)
+        c->view = c->player.ship.entity->x;
+
+    /* children that come before their parent are found in the next pass */
+    do {
+        k = n;
+        formats_foreach(f) {
+            updates_foreach(f,e) {
+                if(n == max)
+                    return n;
+                if(interest_contains(c, e) || !is_relevant(c, e, false))
+                    continue;
+                es[n++] = e;
+                set_visible(c, e, true);
+            }
+        }
+    } while(n > k);
+
+    return n;
+}
+
+static bool contains(Client *c, void *p) {
+    return interest_contains(c, (Entity*)p);
+}
+
+void interest_remove(Entity *e) {
+    Message m;
+    Client *c;
+
+    message_remove(&m, e);
+    queue_event_multicast(&m, contains, e);
+
+    clients_foreach(c) {
+        if(interest_contains(c, e))
+            set_visible(c, e, false);
+    }
+}
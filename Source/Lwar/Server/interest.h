@@ -0,0 +1,32 @@
+#ifndef INTEREST_H
+#define INTEREST_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "types.h"
+
+/* the entities that have been added to a client */
+struct Interest {
+    uint32_t visible[MAX_ENTITIES / 32];
+};
+
+void interest_reset(Client *c);
+
+/* queue add and remove messages for entities that entered or left
+ * the area of interest of c
+ */
+void interest_update(Client *c);
+
+/* mark the entities that are relevant to a joining client as added,
+ * without queueing add messages, parents before their children,
+ * returns their number, at most max, see transfer.c
+ */
+size_t interest_join(Client *c, Entity **es, size_t max);
+
+/* queue remove messages for a dead entity */
+void interest_remove(Entity *e);
+
+bool interest_contains(Client *c, Entity *e);
+
+#endif
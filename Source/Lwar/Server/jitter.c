@@ -0,0 +1,235 @@
+#include "types.h"
+
+#include "jitter.h"
+
+#include "client.h"
+#include "connection.h"
+#include "latency.h"
+#include "message.h"
+#include "player.h"
+#include "server.h"
+
+#include <string.h>
+
+/* Clients sample their input once per frame, about every INPUT_INTERVAL,
+ * and each Input message carries the keys of the last INPUT_HISTORY
+ * frames, bit i of a key being frame frameno - i. Applied as they arrive,
+ * the inputs follow the jitter of the network, and a client whose
+ * messages arrive in bursts moves in bursts.
+ *
+ * Instead, the frames are buffered by their frameno and simulated one by
+ * one, at the rate at which the client sends them. The client rounds its
+ * frames to those it renders, so the rate is measured over the last
+ * INPUT_RATE_FRAMES rather than taken from INPUT_INTERVAL, which would
+ * drain or flood the buffer of every client that is a bit slower or
+ * faster.
+ *
+ * Once the first frames of a client have arrived, the server waits until
+ * depth frames are buffered. A frame that is due but has not arrived is an
+ * underrun: the last input stays in effect, the buffer becomes one frame
+ * deeper and is filled again before the next frame is simulated. After
+ * INPUT_CALM without underruns it shrinks by one frame. While more frames
+ * are buffered than the depth, one frame is dropped per interval, so that
+ * the delay does not grow without bound and bursts are not cut off at
+ * once. Frames that never arrive, because a gap is longer than the
+ * history of the messages, are skipped and count as underruns as well.
+ */
+
+enum {
+    KEY_FORWARDS,
+    KEY_BACKWARDS,
+    KEY_TURN_LEFT,
+    KEY_TURN_RIGHT,
+    KEY_STRAFE_LEFT,
+    KEY_STRAFE_RIGHT,
+    KEY_FIRE1,
+    KEY_FIRE2,
+    KEY_FIRE3,
+    KEY_FIRE4,
+};
+
+#define key(i,k) (((i)->keys >> (k)) & 1)
+
+static InputFrame *slot(Jitter *j, uint32_t frameno) {
+    return &j->frames[frameno % INPUT_FRAMES];
+}
+
+void jitter_reset(Client *c) {
+    Jitter *j = &c->jitter;
+    memset(j->frames, 0, sizeof(j->frames));
+    j->next      = 0;
+    j->newest    = 0;
+    j->depth     = INPUT_MIN_DEPTH;
+    j->due       = 0;
+    j->interval  = INPUT_INTERVAL * 1000;
+    j->mark      = 0;
+    j->marked    = 0;
+    j->measured  = false;
+    j->calm      = 0;
+    j->underruns = 0;
+}
+
+size_t jitter_buffered(Client *c) {
+    Jitter *j = &c->jitter;
+    if(!j->next || j->newest < j->next)
+        return 0;
+    return j->newest - j->next + 1;
+}
+
+void jitter_clear(Client *c) {
+    c->jitter.underruns = 0;
+}
+
+/* bit i of each key of the message */
+static uint16_t keys_of(Message *m, unsigned i) {
+    uint16_t keys = 0;
+    keys |= (uint16_t)((m->input.forwards     >> i) & 1) << KEY_FORWARDS;
+    keys |= (uint16_t)((m->input.backwards    >> i) & 1) << KEY_BACKWARDS;
+    keys |= (uint16_t)((m->input.turn_left    >> i) & 1) << KEY_TURN_LEFT;
+    keys |= (uint16_t)((m->input.turn_right   >> i) & 1) << KEY_TURN_RIGHT;
+    keys |= (uint16_t)((m->input.strafe_left  >> i) & 1) << KEY_STRAFE_LEFT;
+    keys |= (uint16_t)((m->input.strafe_right >> i) & 1) << KEY_STRAFE_RIGHT;
+    keys |= (uint16_t)((m->input.fire1        >> i) & 1) << KEY_FIRE1;
+    keys |= (uint16_t)((m->input.fire2        >> i) & 1) << KEY_FIRE2;
+    keys |= (uint16_t)((m->input.fire3        >> i) & 1) << KEY_FIRE3;
+    keys |= (uint16_t)((m->input.fire4        >> i) & 1) << KEY_FIRE4;
+    return keys;
+}
+
+/* average time between the frames since the mark, smoothed once the
+ * first measurement has replaced INPUT_INTERVAL */
+static void measure(Jitter *j, uint32_t frameno, uint64_t stamp) {
+    uint64_t t = stamp ? stamp : conn_time();
+    uint64_t sample;
+
+    if(j->mark && frameno - j->mark < INPUT_RATE_FRAMES)
+        return;
+
+    if(j->mark && t > j->marked) {
+        sample = (t - j->marked) / (frameno - j->mark);
+        sample = max(sample, (uint64_t)INPUT_MIN_INTERVAL * 1000);
+        sample = min(sample, (uint64_t)INPUT_MAX_INTERVAL * 1000);
+        j->interval = j->measured ? (3 * j->interval + sample) / 4 : sample;
+        j->measured = true;
+    }
+    j->mark   = frameno;
+    j->marked = t;
+}
+
+void jitter_input(Client *c, Message *m, uint64_t stamp) {
+    Jitter *j = &c->jitter;
+    uint32_t frameno = m->input.frameno;
+    unsigned i;
+
+    if(!frameno)
+        return;
+
+    if(frameno > j->newest)
+        measure(j, frameno, stamp);
+
+    /* the first input, older frames are of no interest */
+    if(!j->next)
+        j->next = frameno;
+
+    /* the oldest frames would share their slots with the new ones */
+    if(frameno >= j->next + INPUT_FRAMES)
+        j->next = frameno - INPUT_FRAMES + 1;
+
+    for(i=0; i<INPUT_HISTORY && i<frameno; i++) {
+        uint32_t f = frameno - i;
+        InputFrame *s;
+
+        if(f < j->next)
+            break;
+        s = slot(j, f);
+        if(s->frameno == f)
+            continue;
+
+        /* only the current aim is known */
+        s->frameno = f;
+        s->keys    = keys_of(m, i);
+        s->aim_x   = m->input.aim_x;
+        s->aim_y   = m->input.aim_y;
+        s->stamp   = stamp;
+    }
+
+    j->newest = max(j->newest, frameno);
+}
+
+static void simulate(Client *c, InputFrame *i) {
+    player_input(&c->player,
+                 key(i, KEY_FORWARDS),
+                 key(i, KEY_BACKWARDS),
+                 key(i, KEY_TURN_LEFT),
+                 key(i, KEY_TURN_RIGHT),
+                 key(i, KEY_STRAFE_LEFT),
+                 key(i, KEY_STRAFE_RIGHT),
+                 key(i, KEY_FIRE1),
+                 key(i, KEY_FIRE2),
+                 key(i, KEY_FIRE3),
+                 key(i, KEY_FIRE4),
+                 i->aim_x,
+                 i->aim_y);
+    latency_simulated(c, i->stamp);
+}
+
+static void underrun(Jitter *j, Clock now) {
+    j->underruns ++;
+    j->depth = min(j->depth + 1, (size_t)INPUT_MAX_DEPTH);
+    j->calm  = now;
+}
+
+void jitter_update(Client *c, Clock now) {
+    Jitter *j = &c->jitter;
+    uint64_t t = now * 1000;
+    InputFrame *i;
+
+    /* no input yet, or still filling */
+    if(!j->next)
+        return;
+    if(!j->due) {
+        if(jitter_buffered(c) < j->depth)
+            return;
+        j->due = t;
+        if(!j->calm)
+            j->calm = now;
+    }
+
+    while(j->due <= t) {
+        if(j->newest < j->next) {
+            /* the buffer ran dry, fill it to the new depth */
+            underrun(j, now);
+            j->due = 0;
+            break;
+        }
+
+        i = slot(j, j->next);
+        if(i->frameno == j->next)
+            simulate(c, i);
+        else
+            underrun(j, now);
+        j->next ++;
+
+        /* too far behind the client, the oldest frame is dropped */
+        if(jitter_buffered(c) > j->depth)
+            j->next ++;
+
+        j->due += j->interval;
+    }
+
+    if(now - j->calm >= INPUT_CALM && j->depth > INPUT_MIN_DEPTH) {
+        j->depth --;
+        j->calm = now;
+    }
+}
+
+void jitters_update() {
+    Clock now = server->cur_clock;
+    Client *c;
+
+    clients_foreach(c) {
+        if(c->dead || c->relay)
+            continue;
+        jitter_update(c, now);
+    }
+}
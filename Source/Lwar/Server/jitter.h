@@ -0,0 +1,50 @@
+#ifndef JITTER_H
+#define JITTER_H
+
+#include <stdint.h>
+
+#include "clock.h"
+#include "config.h"
+#include "types.h"
+
+/* the input of a client during one of its frames */
+struct InputFrame {
+    uint32_t frameno; /* 0 if the slot is empty */
+    uint16_t keys;    /* bit i is set if key i is pressed, see jitter.c */
+    int16_t  aim_x, aim_y;
+    uint64_t stamp;   /* receive time of the input, see latency.c */
+};
+
+/* inputs of a client that wait to be simulated, see jitter.c */
+struct Jitter {
+    InputFrame frames[INPUT_FRAMES]; /* indexed by frameno */
+    uint32_t next;      /* frameno that is simulated next, 0 before the first input */
+    uint32_t newest;    /* largest frameno received */
+    size_t   depth;     /* frames that are buffered before the first is simulated */
+    uint64_t due;       /* time in us at which frame next is simulated, 0 while filling */
+    uint64_t interval;  /* us between two frames of the client, as measured */
+    uint32_t mark;      /* frameno at which the measurement of the interval began */
+    uint64_t marked;    /* receive time of frame mark */
+    bool     measured;  /* interval is no longer INPUT_INTERVAL */
+    Clock    calm;      /* time of the last underrun or change of depth */
+    size_t   underruns; /* frames that were due, but had not arrived */
+};
+
+void jitter_reset(Client *c);
+
+/* buffer the frames of an input message, stamp as in latency_input */
+void jitter_input(Client *c, Message *m, uint64_t stamp);
+
+/* simulate the inputs that are due */
+void jitters_update();
+
+/* simulate the inputs of c that are due at now, as jitters_update */
+void jitter_update(Client *c, Clock now);
+
+/* frames that are currently buffered */
+size_t jitter_buffered(Client *c);
+
+/* restart the count of underruns */
+void jitter_clear(Client *c);
+
+#endif
@@ -0,0 +1,100 @@
+#include "types.h"
+
+#include "latency.h"
+
+#include "client.h"
+#include "connection.h"
+#include "server.h"
+
+#include <string.h>
+
+/* The kernel timestamps each datagram on arrival (see conn_stamp), which
+ * separates the delays of the server from those of the network: the
+ * queueing delay is the time an input spends in the socket buffer and in
+ * the receive threads until it is decoded, the input latency lasts until
+ * an update simulates it, which includes the time until the update and
+ * the time in the jitter buffer (see jitter.c).
+ *
+ * The histograms have four buckets per power of two, so a percentile is
+ * off by at most a quarter of its value. Small values have a bucket each.
+ */
+
+static size_t bucket(uint64_t us) {
+    size_t m = 2, b;
+
+    if(us < 4)
+        return (size_t)us;
+    while(us >> (m + 1))
+        m ++;
+
+    /* the two bits after the most significant one */
+    b = 4 * (m - 1) + (size_t)((us >> (m - 2)) & 3);
+    return b < LATENCY_BUCKETS ? b : LATENCY_BUCKETS - 1;
+}
+
+/* smallest value of the bucket */
+static uint64_t bucket_start(size_t b) {
+    if(b < 4)
+        return b;
+    return (uint64_t)(4 + b % 4) << (b / 4 - 1);
+}
+
+static void sample(uint32_t *h, uint64_t stamp, uint64_t now) {
+    /* the realtime clock may have been set back */
+    if(now >= stamp)
+        h[bucket(now - stamp)] ++;
+}
+
+void latency_reset(Client *c) {
+    c->latency.pending = 0;
+    latency_clear(c);
+}
+
+void latency_clear(Client *c) {
+    memset(c->latency.queue, 0, sizeof(c->latency.queue));
+    memset(c->latency.input, 0, sizeof(c->latency.input));
+}
+
+void latency_input(Client *c, uint64_t stamp) {
+    if(!stamp) return;
+
+    sample(c->latency.queue, stamp, conn_time());
+}
+
+void latency_simulated(Client *c, uint64_t stamp) {
+    if(!stamp) return;
+
+    if(!c->latency.pending || stamp < c->latency.pending)
+        c->latency.pending = stamp;
+}
+
+void latencies_update() {
+    uint64_t now = 0;
+    Client *c;
+
+    clients_foreach(c) {
+        if(!c->latency.pending)
+            continue;
+        if(!now)
+            now = conn_time();
+        sample(c->latency.input, c->latency.pending, now);
+        c->latency.pending = 0;
+    }
+}
+
+uint64_t latency_percentile(const uint32_t *h, unsigned p) {
+    uint64_t n = 0, k = 0;
+    size_t b;
+
+    for(b=0; b<LATENCY_BUCKETS; b++)
+        n += h[b];
+    if(!n)
+        return 0;
+
+    for(b=0; b<LATENCY_BUCKETS; b++) {
+        k += h[b];
+        if(100 * k >= (uint64_t)p * n)
+            break;
+    }
+    return bucket_start(b + 1);
+}
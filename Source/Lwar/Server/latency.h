@@ -0,0 +1,35 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "types.h"
+
+/* delays of the input of a client, histograms in microseconds */
+struct Latency {
+    uint64_t pending; /* receive time of the oldest input that is about to be simulated */
+    uint32_t queue[LATENCY_BUCKETS]; /* from the kernel until the input is decoded */
+    uint32_t input[LATENCY_BUCKETS]; /* from the kernel until the input is simulated */
+};
+
+void latency_reset(Client *c);
+
+/* the input that the kernel received at stamp has been decoded */
+void latency_input(Client *c, uint64_t stamp);
+
+/* the input that the kernel received at stamp is about to be simulated,
+ * see jitter.c
+ */
+void latency_simulated(Client *c, uint64_t stamp);
+
+/* the inputs of all clients are about to be simulated */
+void latencies_update();
+
+/* upper bound of the p-th percentile of a histogram, 0 if it is empty */
+uint64_t latency_percentile(const uint32_t *h, unsigned p);
+
+/* start new histograms */
+void latency_clear(Client *c);
+
+#endif
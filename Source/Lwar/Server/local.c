@@ -0,0 +1,116 @@
+#include "types.h"
+
+#include "local.h"
+
+#include "config.h"
+#include "connection.h"
+#include "packet.h"
+
+#include <string.h>
+
+/* A client that runs in the same process as the server (the host of a
+ * game, see NativeServer.cs) exchanges its packets through two rings of
+ * datagrams instead of the loopback interface, without system calls and
+ * the delays of the kernel. Each ring has a single producer and a single
+ * consumer, which may be different threads; head and tail only grow.
+ * Like the kernel, a full ring drops the datagram.
+ *
+ * The rings are static and only closed, never freed, because the client
+ * may still use them while or after the server shuts down.
+ */
+
+typedef struct Datagram Datagram;
+typedef struct Ring Ring;
+
+struct Datagram {
+    uint64_t stamp;
+    size_t   size;
+    char     buf[MAX_PACKET_LENGTH];
+};
+
+struct Ring {
+    size_t head, tail; /* written by the producer and the consumer */
+    Datagram ring[LOCAL_QUEUE];
+};
+
+#ifdef _MSC_VER
+#include <intrin.h>
+
+/* aligned accesses are atomic and x86 does not reorder them with the
+ * accesses of the datagrams, only the compiler has to be prevented
+ */
+static size_t load(volatile size_t *p)         { size_t v = *p; _ReadWriteBarrier(); return v; }
+static void   store(volatile size_t *p, size_t v) { _ReadWriteBarrier(); *p = v; }
+#else
+#define load(p)    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store(p,v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#endif
+
+static Ring up;   /* from the client to the server */
+static Ring down; /* from the server to the client */
+static size_t opened;
+
+static bool ring_put(Ring *r, const char *buf, size_t size) {
+    size_t head = r->head;
+    Datagram *d;
+
+    if(size > MAX_PACKET_LENGTH || head - load(&r->tail) == LOCAL_QUEUE)
+        return false;
+
+    d = &r->ring[head % LOCAL_QUEUE];
+    memcpy(d->buf, buf, size);
+    d->size  = size;
+    d->stamp = conn_time();
+    store(&r->head, head + 1);
+    return true;
+}
+
+static size_t ring_get(Ring *r, char *buf, size_t size, uint64_t *stamp) {
+    size_t tail = r->tail;
+    Datagram *d;
+
+    if(tail == load(&r->head))
+        return 0;
+
+    /* truncated like a datagram that does not fit */
+    d = &r->ring[tail % LOCAL_QUEUE];
+    size = d->size < size ? d->size : size;
+    memcpy(buf, d->buf, size);
+    if(stamp) *stamp = d->stamp;
+    store(&r->tail, tail + 1);
+    return size;
+}
+
+bool local_open() {
+    /* called before the client knows of the rings */
+    up.head   = up.tail   = 0;
+    down.head = down.tail = 0;
+    store(&opened, 1);
+    return true;
+}
+
+void local_shutdown() {
+    store(&opened, 0);
+}
+
+bool local_is(Address *adr) {
+    return address_eq(adr, (Address*)&address_local);
+}
+
+void local_recv(char *buf, size_t *size, uint64_t *stamp) {
+    *size = load(&opened) ? ring_get(&up, buf, *size, stamp) : 0;
+}
+
+bool local_send(const char *buf, size_t size) {
+    return ring_put(&down, buf, size);
+}
+
+int local_client_send(const char *buf, size_t size) {
+    if(!load(&opened)) return -1;
+    return ring_put(&up, buf, size) ? 1 : 0;
+}
+
+int local_client_recv(char *buf, size_t size) {
+    if(!load(&opened)) return -1;
+    return (int)ring_get(&down, buf, size, 0);
+}
@@ -0,0 +1,33 @@
+#ifndef LOCAL_H
+#define LOCAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "address.h"
+#include "types.h"
+
+/* the sender address of the client in the same process, see local.c,
+ * "::" is never the address of a remote sender
+ */
+static const Address address_local = {{0}, 1, true};
+
+bool local_open();
+void local_shutdown();
+
+/* whether adr is the client in the same process */
+bool local_is(Address *adr);
+
+/* next packet of the local client, *size = 0 if there is none,
+ * *stamp is the time it was handed over, as in conn_stamp
+ */
+void local_recv(char *buf, size_t *size, uint64_t *stamp);
+
+/* a packet for the local client, false if it has to be dropped */
+bool local_send(const char *buf, size_t size);
+
+/* the side of the client, called by its thread */
+int local_client_send(const char *buf, size_t size);
+int local_client_recv(char *buf, size_t size);
+
+#endif
@@ -21,6 +21,69 @@ bool is_update(Message *m) {
            && m->type <= MESSAGE_UPDATE_SHIP;
 }
 
+bool is_batched(Message *m) {
+    return message_single(m->type) != 0;
+}
+
+MessageType message_batched(MessageType type) {
+    switch(type) {
+    case MESSAGE_ADD:       return MESSAGE_ADDS;
+    case MESSAGE_REMOVE:    return MESSAGE_REMOVES;
+    case MESSAGE_COLLISION: return MESSAGE_COLLISIONS;
+    default:                return 0;
+    }
+}
+
+MessageType message_single(MessageType type) {
+    switch(type) {
+    case MESSAGE_ADDS:       return MESSAGE_ADD;
+    case MESSAGE_REMOVES:    return MESSAGE_REMOVE;
+    case MESSAGE_COLLISIONS: return MESSAGE_COLLISION;
+    default:                 return 0;
+    }
+}
+
+size_t message_channel(MessageType type, uint8_t rev) {
+    if(rev < REVISION_CHANNELS)
+        return CHANNEL_STATE;
+
+    switch(type) {
+    case MESSAGE_CHAT:
+    case MESSAGE_NAME:
+    case MESSAGE_SELECTION: return CHANNEL_CHAT;
+    case MESSAGE_MTU:       return CHANNEL_SESSION;
+    default:                return CHANNEL_STATE;
+    }
+}
+
+size_t message_length(MessageType type) {
+    switch(type) {
+#define MESSAGE(T, name)        case MESSAGE_##T: return MESSAGE_LENGTH_##T;
+#include "schema.h"
+    default: return 0;
+    }
+}
+
+#define STR_uint8(name, f)
+#define STR_uint16(name, f)
+#define STR_uint32(name, f)
+#define STR_int16(name, f)
+#define STR_id(name, f)
+#define STR_enum8(name, f)
+#define STR_pad(name, f)
+#define STR_str(name, f)    return &m->name.f;
+
+Str *message_str(Message *m) {
+    switch(m->type) {
+#define MESSAGE(T, name)        case MESSAGE_##T:
+#define FIELD(name, type, f)        STR_##type(name, f)
+#define MESSAGE_END(T, name)        break;
+#include "schema.h"
+    default: break;
+    }
+    return 0;
+}
+
 void message_join(Message *m, Client *c) {
     m->type = MESSAGE_JOIN;
     m->join.player_id = c->player.id;
@@ -33,6 +96,30 @@ void message_leave(Message *m, Client *c, LeaveReason reason) {
     m->leave.reason = reason;
 }
 
+void message_mtu(Message *m, size_t size) {
+    m->type = MESSAGE_MTU;
+    m->mtu.size = (uint16_t)size;
+}
+
+/* the padding is added in stream_send_probe */
+void message_mtu_probe(Message *m, size_t size) {
+    m->type = MESSAGE_MTU_PROBE;
+    m->mtu_probe.size = (uint16_t)size;
+    m->mtu_probe.pad = 0;
+}
+
+void message_channel_ack(Message *m, size_t channel, size_t ack) {
+    m->type = MESSAGE_CHANNEL_ACK;
+    m->channel_ack.channel = (uint8_t)channel;
+    m->channel_ack.ack     = (uint32_t)ack;
+    m->channel_ack.mask    = 0; /* the server keeps no messages after a gap */
+}
+
+void message_cookie(Message *m, uint32_t cookie) {
+    m->type = MESSAGE_COOKIE;
+    m->cookie.value = cookie;
+}
+
 void message_collision(Message *m, Collision *c) {
     m->type = MESSAGE_COLLISION;
     m->collision.entity_id[0] = c->e[0]->id;
@@ -41,6 +128,15 @@ void message_collision(Message *m, Collision *c) {
     m->collision.y = c->x.y;
 }
 
+void message_delta(Message *m, Client *c) {
+    m->type = MESSAGE_DELTA;
+    m->delta.snapshot = server->snapshot;
+    m->delta.part = 0;
+    m->delta.format = 0;
+    m->delta.n = 0;
+    m->delta.c = c;
+}
+
 void message_add(Message *m, Entity *e) {
     assert(!e->dead);
     m->type = MESSAGE_ADD;
@@ -61,15 +157,25 @@ void message_kill(Message *m, Player *k, Player *v) {
     m->kill.victim_id = v->id;
 }
 
-void message_stats(Message *m) {
+/* fill in the given page of at most MAX_STATS players,
+ * and advance to the next page or back to the first one
+ */
+void message_stats(Message *m, size_t *page) {
 	Client* c;
+    size_t i = 0;
 
     m->type = MESSAGE_STATS;
 	m->stats.n = 0;
 
 	clients_foreach(c) {
-		if (c->player.id.n == 0)
+		if (c->player.id.n == 0 || c->relay)
 			continue;
+        if (i++ < *page * MAX_STATS)
+            continue;
+        if (m->stats.n == MAX_STATS) {
+            (*page) ++;
+            return;
+        }
 
 		m->stats.info[m->stats.n].player_id = c->player.id;
 		m->stats.info[m->stats.n].kills = c->player.kills;
@@ -77,6 +183,7 @@ void message_stats(Message *m) {
 		m->stats.info[m->stats.n].ping = c->ping;
 		m->stats.n ++;
 	}
+    *page = 0;
 }
 
 void message_synced(Message *m, Player *p) {
@@ -89,8 +196,9 @@ void message_reject(Message *m, RejectReason reason) {
 	m->reject.reason = reason;
 }
 
-void message_update(Message *m, Format *f) {
+void message_update(Message *m, Format *f, Client *c) {
     m->type = f->type;
     m->update.n = f->n;
     m->update.f = f;
+    m->update.c = c;
 }
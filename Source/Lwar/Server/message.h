@@ -2,6 +2,7 @@
 #define MESSAGE_H
 
 #include "address.h"
+#include "bitstream.h"
 #include "id.h"
 #include "str.h"
 #include "config.h"
@@ -12,17 +13,40 @@ typedef enum   RejectReason RejectReason;
 
 bool is_reliable(Message *m);
 bool is_update(Message *m);
+bool is_batched(Message *m);
+
+/* the batched message type of a single Add, Remove or Collision, and back,
+ * 0 for other types
+ */
+MessageType message_batched(MessageType type);
+MessageType message_single(MessageType type);
+
+/* the reliable channel of a message type for clients of revision rev,
+ * which is always CHANNEL_STATE before REVISION_CHANNELS
+ */
+size_t message_channel(MessageType type, uint8_t rev);
+
+/* minimal length of a message of the given type, 0 if the type is unknown */
+size_t message_length(MessageType type);
+
+/* the string field of the message, 0 if it has none */
+Str *message_str(Message *m);
 
 void message_add(Message *m, Entity *e);
+void message_channel_ack(Message *m, size_t channel, size_t ack);
 void message_collision(Message *m, Collision *c);
+void message_cookie(Message *m, uint32_t cookie);
+void message_delta(Message *m, Client *c);
 void message_join(Message *m, Client *c);
 void message_kill(Message *m, Player *k, Player *v);
 void message_leave(Message *m, Client *c, LeaveReason reason);
+void message_mtu(Message *m, size_t size);
+void message_mtu_probe(Message *m, size_t size);
 void message_reject(Message *m, RejectReason reason);
 void message_remove(Message *m, Entity *e);
-void message_stats(Message *m);
+void message_stats(Message *m, size_t *page);
 void message_synced(Message *m, Player *p);
-void message_update(Message *m, Format *f); /* TODO: use data structure, e.g. Format. */
+void message_update(Message *m, Format *f, Client *c); /* TODO: use data structure, e.g. Format. */
 
 enum MessageType {
     MESSAGE_CONNECT         =   1,
@@ -36,6 +60,9 @@ enum MessageType {
     MESSAGE_NAME            =   9,
     MESSAGE_SYNCED          =  10,
     MESSAGE_KILL            =  11,
+    MESSAGE_MTU             =  12,
+    MESSAGE_ADDS            =  13,
+    MESSAGE_REMOVES         =  14,
 
     MESSAGE_STATS           = 101,
     /* */
@@ -44,6 +71,8 @@ enum MessageType {
     MESSAGE_COLLISION       = 105,
     MESSAGE_DISCONNECT      = 106,
     MESSAGE_REJECT          = 107,
+    MESSAGE_DELTA_ACK       = 108,
+    MESSAGE_MTU_ACK         = 109,
 
     /* Note: adapt is_update in message.c after adding more updates */
     MESSAGE_UPDATE          = 110,
@@ -51,12 +80,71 @@ enum MessageType {
     MESSAGE_UPDATE_RAY      = 112,
     MESSAGE_UPDATE_CIRCLE   = 113,
     MESSAGE_UPDATE_SHIP     = 114,
+
+    MESSAGE_DELTA           = 115,
+    MESSAGE_MTU_PROBE       = 116,
+    MESSAGE_SACK            = 117,
+    MESSAGE_COOKIE          = 118,
+    MESSAGE_RELAY           = 119,
+    MESSAGE_COLLISIONS      = 120,
+    MESSAGE_CHANNEL_ACK     = 121,
+    MESSAGE_CHUNK           = 122,
+    MESSAGE_CHUNK_ACK       = 123,
+};
+
+/* independent sequences of reliable messages, see network.txt */
+enum {
+    CHANNEL_STATE,   /* connect, players, entities, kills and synced */
+    CHANNEL_CHAT,    /* chat, names and selections */
+    CHANNEL_SESSION, /* packet size */
+    CHANNELS,
+};
+
+enum {
+    DELTA_LAST              = 0x80, /* marks the final part of a snapshot */
 };
 
 enum {
     MESSAGE_DISCOVERY       = 200,
 };
 
+/* lengths on the wire, generated from schema.h */
+#define LENGTH_uint8    1
+#define LENGTH_uint16   2
+#define LENGTH_uint32   4
+#define LENGTH_int16    2
+#define LENGTH_id       4
+#define LENGTH_enum8    1
+#define LENGTH_str      1 /* without the characters */
+#define LENGTH_pad      2 /* without the padding */
+
+enum {
+    MESSAGE_HEADER_LENGTH   = LENGTH_uint8 + LENGTH_uint32, /* type, seqno */
+    COMPACT_MESSAGE_HEADER_LENGTH = LENGTH_uint8, /* type of an unreliable message in a compact packet */
+};
+
+/* MESSAGE_LENGTH_T: length of message MESSAGE_T, without arrays and strings */
+enum {
+#define MESSAGE(T, name)        MESSAGE_LENGTH_##T = MESSAGE_HEADER_LENGTH
+#define FIELD(name, type, f)        + LENGTH_##type
+#define ARRAY(name, n, a, max)      + LENGTH_uint8
+#define MESSAGE_END(T, name)    ,
+#include "schema.h"
+};
+
+/* ITEM_LENGTH_name: length of an array element of m->name,
+ * RECORD_LENGTH_T:  length of an update record of message MESSAGE_T
+ */
+enum {
+#define ARRAY(name, n, a, max)  ITEM_LENGTH_##name = 0
+#define ITEM(name, a, type, f)      + LENGTH_##type
+#define ARRAY_END(name, a)      ,
+#define RECORD(T)               RECORD_LENGTH_##T = 0
+#define COLUMN(type, f)             + LENGTH_##type
+#define RECORD_END(T)           ,
+#include "schema.h"
+};
+
 enum LeaveReason {
     LEAVE_QUIT              = 1,
     LEAVE_DROPPED           = 2,
@@ -66,13 +154,33 @@ enum LeaveReason {
 enum RejectReason {
     REJECT_FULL             = 1,
     REJECT_VERSION_MISMATCH = 2,
+    REJECT_RELAY            = 3, /* relays are not allowed from the address */
 };
 
 struct Header {
-    uint32_t app_id;
+    uint32_t app_id; /* APP_ID, or APP_ID_COMPACT for the compact format */
     uint32_t ack;
-    uint32_t time;
+    uint32_t frame; /* compact only, seqno of all unreliable messages in the packet */
+    uint32_t time;  /* compact only, of the sender in ms */
+    uint32_t prev;  /* not serialized, seqno of the last reliable message in the packet */
     Address  adr;
+    size_t   mtu; /* not serialized, maximal packet size */
+    Client  *c;   /* not serialized, paces the packets if set, see pacing.c */
+    uint64_t stamp; /* not serialized, receive time, see conn_stamp */
+    bool     cookie; /* not serialized, a valid cookie came first in the packet */
+    bool     relay;  /* not serialized, a Relay message came before the connect */
+};
+
+/* records of a batched message, encoded by event_write when they are
+ * queued, see queue.c
+ */
+struct Events {
+    List        _l;
+    MessageType type;
+    uint8_t     n;
+    uint16_t    prev; /* entity id of the last record */
+    BitStream   b;
+    char        s[BATCH_LENGTH];
 };
 
 struct Discovery {
@@ -148,8 +256,62 @@ struct Message {
         struct {
             uint8_t n;
             Format *f; /* Note: not directly serialized, needs special case in stream. */
+            Client *c; /* only entities scheduled for c */
         } update;
 
+        struct {
+            uint32_t snapshot;
+            uint8_t  part;
+            uint8_t  format; /* update message type that determines the fields */
+            uint8_t  n;
+            Client  *c; /* Note: not directly serialized, needs special case in stream. */
+        } delta;
+
+        struct {
+            uint8_t n;
+            Events *e; /* Note: not directly serialized, the records follow the message, see stream.c */
+        } events;
+
+        struct {
+            uint32_t snapshot;
+        } delta_ack;
+
+        struct {
+            uint16_t size;
+        } mtu, mtu_ack;
+
+        struct {
+            uint16_t size;
+            uint16_t pad; /* number of padding bytes */
+        } mtu_probe;
+
+        struct {
+            uint32_t ack;  /* same as in the header */
+            uint32_t mask; /* bit i: received reliable message ack+2+i */
+        } sack;
+
+        struct {
+            uint32_t value; /* see ingress_cookie */
+        } cookie;
+
+        struct {
+            uint8_t  channel;
+            uint32_t ack;  /* last reliable message of the channel received in order */
+            uint32_t mask; /* as in the Sack message */
+        } channel_ack;
+
+        struct {
+            uint16_t index; /* of the chunk in the stream, see transfer.c */
+            uint16_t count; /* of the chunks */
+            uint16_t len;
+            const char *s;  /* Note: not directly serialized, the bytes follow the message, see stream.c */
+        } chunk;
+
+        struct {
+            uint16_t next; /* all chunks before next have been received */
+            uint32_t mask; /* bit i: received chunk next+1+i */
+        } chunk_ack;
+
         struct {
             Id player_id;
             uint32_t frameno;
@@ -175,7 +337,7 @@ struct Message {
                 uint16_t kills;
                 uint16_t deaths;
                 uint16_t ping;
-            } info[MAX_CLIENTS];
+            } info[MAX_STATS];
         } stats;
 
         struct {
@@ -0,0 +1,69 @@
+#include "types.h"
+
+#include "mtu.h"
+
+#include "client.h"
+#include "debug.h"
+#include "log.h"
+#include "message.h"
+#include "packet.h"
+#include "server.h"
+#include "stream.h"
+
+/* Clients with revision REVISION_MTU announce the largest packet they can
+ * receive. All packets are at most MIN_PACKET_LENGTH long until the
+ * client has acknowledged an unreliable probe packet of a larger size.
+ * The server starts probing with the announced size; whenever
+ * MTU_PROBE_TRIES probes of a size get lost, it falls back to the middle
+ * between that size and the confirmed one, until the difference is less
+ * than MTU_PROBE_STEP.
+ */
+
+void mtu_reset(Client *c) {
+    c->mtu.size  = MIN_PACKET_LENGTH;
+    c->mtu.max   = MIN_PACKET_LENGTH;
+    c->mtu.probe = 0;
+    c->mtu.tries = 0;
+    c->mtu.next  = 0;
+}
+
+void mtu_announce(Client *c, size_t size) {
+    size = max(min(size, (size_t)MAX_PACKET_LENGTH), (size_t)MIN_PACKET_LENGTH);
+
+    c->mtu.max   = size;
+    c->mtu.probe = size > c->mtu.size ? size : 0;
+    c->mtu.tries = 0;
+    c->mtu.next  = server->cur_clock;
+}
+
+void mtu_ack(Client *c, size_t size) {
+    if(!c->mtu.probe || size != c->mtu.probe)
+        return;
+
+    log_debug("packet size of %d: %d", c->player.id.n, (int)size);
+    c->mtu.size  = size;
+    c->mtu.probe = 0;
+}
+
+bool mtu_update(Client *c, Header *h) {
+    Message m;
+
+    if(!c->mtu.probe || server->cur_clock < c->mtu.next)
+        return true;
+
+    if(c->mtu.tries >= MTU_PROBE_TRIES) {
+        c->mtu.probe = c->mtu.size + (c->mtu.probe - c->mtu.size) / 2;
+        c->mtu.tries = 0;
+        if(c->mtu.probe < c->mtu.size + MTU_PROBE_STEP) {
+            c->mtu.probe = 0;
+            return true;
+        }
+    }
+
+    c->mtu.tries ++;
+    c->mtu.next = server->cur_clock + MTU_PROBE_INTERVAL;
+
+    message_mtu_probe(&m, c->mtu.probe);
+    m.seqno = c->next_out_unreliable_seqno ++;
+    return stream_send_probe(h, &m);
+}
@@ -0,0 +1,29 @@
+#ifndef MTU_H
+#define MTU_H
+
+#include <stddef.h>
+
+#include "clock.h"
+#include "types.h"
+
+/* size of the packets sent to a client */
+struct Mtu {
+    size_t size;  /* confirmed by the client */
+    size_t max;   /* announced by the client */
+    size_t probe; /* currently probed size, 0 if there is nothing to probe */
+    size_t tries; /* probes of that size sent so far */
+    Clock  next;  /* time of the next probe */
+};
+
+void mtu_reset(Client *c);
+
+/* the client can receive packets of the given size */
+void mtu_announce(Client *c, size_t size);
+
+/* the client has received a probe of the given size */
+void mtu_ack(Client *c, size_t size);
+
+/* send a probe if one is due */
+bool mtu_update(Client *c, Header *h);
+
+#endif
@@ -0,0 +1,201 @@
+#include "types.h"
+
+#include "netem.h"
+
+#include "config.h"
+#include "packet.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Network emulator: each direction of a connection is a path that holds
+ * the datagrams until they would have arrived over a link with the
+ * configured latency, jitter, loss, duplication, reordering and rate
+ * (see conn_emulate). A datagram first waits until the previous ones have
+ * been serialized at the rate, then travels for the latency plus or minus
+ * a random jitter, so jitter alone reorders as well. Reordered datagrams
+ * skip the latency. A path holds NETEM_QUEUE datagrams, further ones are
+ * dropped, like by the queue of a router in front of a slow link.
+ *
+ * The decisions are taken by a generator with a fixed seed, so a run with
+ * the same traffic in the same order is reproducible. The datagrams are
+ * only released when the connection is used, so the owner has to receive
+ * or flush at least as often as the delays should be accurate.
+ */
+
+typedef struct Delayed Delayed;
+typedef struct Path Path;
+
+struct Delayed {
+    bool     used;
+    uint64_t due;
+    uint64_t seqno; /* keeps datagrams with the same due time in order */
+    Address  adr;
+    size_t   size;
+    char     buf[MAX_PACKET_LENGTH];
+};
+
+struct Path {
+    uint64_t free;  /* when the link has serialized the previous datagrams */
+    uint64_t seqno;
+    size_t   n;
+    Delayed  queue[NETEM_QUEUE];
+};
+
+struct Netem {
+    NetemConfig cfg;
+    uint64_t    rnd;
+    Path        path[2];
+};
+
+bool netem_parse(NetemConfig *cfg, const char *spec) {
+    char name[16];
+    double value;
+    int len;
+
+    memset(cfg, 0, sizeof(NetemConfig));
+    cfg->seed = 1;
+
+    while(*spec) {
+        if(sscanf(spec, "%15[a-z]=%lf%n", name, &value, &len) != 2 || value < 0)
+            return false;
+        spec += len;
+        if(*spec == ',') spec ++;
+
+        if(!strcmp(name, "latency"))        cfg->latency   = (unsigned)value;
+        else if(!strcmp(name, "jitter"))    cfg->jitter    = (unsigned)value;
+        else if(!strcmp(name, "loss"))      cfg->loss      = value;
+        else if(!strcmp(name, "duplicate")) cfg->duplicate = value;
+        else if(!strcmp(name, "reorder"))   cfg->reorder   = value;
+        else if(!strcmp(name, "rate"))      cfg->rate      = (unsigned)value;
+        else if(!strcmp(name, "seed"))      cfg->seed      = (unsigned)value;
+        else return false;
+    }
+    return true;
+}
+
+Netem *netem_create(const NetemConfig *cfg) {
+    Netem *n = (Netem*)calloc(1, sizeof(Netem));
+    if(!n) return 0;
+
+    n->cfg = *cfg;
+    n->rnd = cfg->seed * 0x9e3779b97f4a7c15ull + 1;
+    return n;
+}
+
+void netem_destroy(Netem *n) {
+    free(n);
+}
+
+/* xorshift64*, uniform in [0,1) */
+static double netem_random(Netem *n) {
+    n->rnd ^= n->rnd >> 12;
+    n->rnd ^= n->rnd << 25;
+    n->rnd ^= n->rnd >> 27;
+    return (double)((n->rnd * 0x2545f4914f6cdd1dull) >> 11) / (double)(1ull << 53);
+}
+
+static bool netem_chance(Netem *n, double percent) {
+    return percent > 0 && netem_random(n) * 100 < percent;
+}
+
+static void netem_enqueue(Netem *n, Path *p, const char *buf, size_t size, Address *adr, uint64_t now) {
+    NetemConfig *cfg = &n->cfg;
+    int64_t delay = (int64_t)cfg->latency * 1000;
+    uint64_t depart = now;
+    Delayed *d;
+    size_t i;
+
+    if(p->n == NETEM_QUEUE || size > MAX_PACKET_LENGTH)
+        return;
+
+    if(cfg->jitter)
+        delay += (int64_t)((2 * netem_random(n) - 1) * cfg->jitter * 1000);
+    if(netem_chance(n, cfg->reorder) || delay < 0)
+        delay = 0;
+
+    if(cfg->rate) {
+        depart = p->free > now ? p->free : now;
+        depart += (uint64_t)size * 1000000 / cfg->rate;
+        p->free = depart;
+    }
+
+    for(i=0; p->queue[i].used; i++);
+    d = &p->queue[i];
+    d->used  = true;
+    d->due   = depart + (uint64_t)delay;
+    d->seqno = p->seqno ++;
+    d->adr   = *adr;
+    d->size  = size;
+    memcpy(d->buf, buf, size);
+    p->n ++;
+}
+
+void netem_put(Netem *n, int dir, const char *buf, size_t size, Address *adr, uint64_t now) {
+    Path *p = &n->path[dir];
+
+    if(netem_chance(n, n->cfg.loss))
+        return;
+
+    netem_enqueue(n, p, buf, size, adr, now);
+    if(netem_chance(n, n->cfg.duplicate))
+        netem_enqueue(n, p, buf, size, adr, now);
+}
+
+static Delayed *netem_first(Path *p) {
+    Delayed *first = 0;
+    size_t i;
+
+    for(i=0; i<NETEM_QUEUE && p->n; i++) {
+        Delayed *d = &p->queue[i];
+        if(d->used && (!first || d->due < first->due || (d->due == first->due && d->seqno < first->seqno)))
+            first = d;
+    }
+    return first;
+}
+
+bool netem_get(Netem *n, int dir, uint64_t now, char *buf, size_t *size, Address *adr) {
+    Path *p = &n->path[dir];
+    Delayed *d = netem_first(p);
+
+    if(!d || d->due > now)
+        return false;
+
+    *size = d->size < *size ? d->size : *size;
+    memcpy(buf, d->buf, *size);
+    *adr = d->adr;
+    d->used = false;
+    p->n --;
+    return true;
+}
+
+bool netem_next(Netem *n, uint64_t *due) {
+    Delayed *out = netem_first(&n->path[NETEM_OUT]);
+    Delayed *in  = netem_first(&n->path[NETEM_IN]);
+
+    if(!out && !in)
+        return false;
+
+    *due = !in || (out && out->due < in->due) ? out->due : in->due;
+    return true;
+}
+
+uint64_t netem_time() {
+#ifdef _MSC_VER
+    LARGE_INTEGER t, f;
+    QueryPerformanceCounter(&t);
+    QueryPerformanceFrequency(&f);
+    return (uint64_t)(t.QuadPart / f.QuadPart * 1000000 + t.QuadPart % f.QuadPart * 1000000 / f.QuadPart);
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000 + (uint64_t)t.tv_nsec / 1000;
+#endif
+}
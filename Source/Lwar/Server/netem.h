@@ -0,0 +1,53 @@
+#ifndef NETEM_H
+#define NETEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "address.h"
+#include "types.h"
+
+/* conditions of an emulated network path, see netem.c */
+struct NetemConfig {
+    unsigned latency;   /* ms, in each direction */
+    unsigned jitter;    /* ms, added to or subtracted from the latency at random */
+    double   loss;      /* percent of the datagrams that are dropped */
+    double   duplicate; /* percent of the datagrams that arrive twice */
+    double   reorder;   /* percent of the datagrams that skip the latency */
+    unsigned rate;      /* bytes/s in each direction, 0 if unlimited */
+    unsigned seed;      /* of the random decisions */
+};
+
+enum {
+    NETEM_OUT,
+    NETEM_IN,
+};
+
+/* spec is a comma-separated list of the fields of NetemConfig,
+ * e.g. "latency=50,jitter=10,loss=2,duplicate=1,reorder=5,rate=64000,seed=7",
+ * false if it is invalid
+ */
+bool netem_parse(NetemConfig *cfg, const char *spec);
+
+Netem *netem_create(const NetemConfig *cfg);
+void   netem_destroy(Netem *n);
+
+/* a datagram enters the path of direction dir at time now,
+ * dropped if the path is full
+ */
+void netem_put(Netem *n, int dir, const char *buf, size_t size, Address *adr, uint64_t now);
+
+/* the next datagram that has left the path by time now,
+ * truncated to *size, false if there is none
+ */
+bool netem_get(Netem *n, int dir, uint64_t now, char *buf, size_t *size, Address *adr);
+
+/* when the next datagram of either direction leaves its path,
+ * false if the paths are empty
+ */
+bool netem_next(Netem *n, uint64_t *due);
+
+/* monotonic time in microseconds */
+uint64_t netem_time();
+
+#endif
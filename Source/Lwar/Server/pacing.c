@@ -0,0 +1,122 @@
+#include "types.h"
+
+#include "pacing.h"
+
+#include "client.h"
+#include "config.h"
+#include "performance.h"
+#include "server.h"
+
+/* The packets to a client are released by a token bucket that fills with
+ * the rate of the client and holds at most PACING_BURST bytes, so that a
+ * large update is spread over the update interval if the server is
+ * updated or paced often enough (see server_pace). Packets that get no
+ * tokens wait in a short queue; while it is more than half full, no new
+ * packets are produced for the client, and when it is full, packets are
+ * dropped. The rate also limits the budget for update records.
+ *
+ * The rate is adapted by AIMD: it is halved at most once per round-trip
+ * time when reliable messages had to be resent, packets were dropped, or
+ * the round-trip time has grown by PACING_DELAY over its minimum, and it
+ * grows by one packet per round-trip time while it limits the client.
+ */
+
+void pacing_reset(Client *c) {
+    c->pacer.rate     = PACING_INITIAL_RATE;
+    c->pacer.tokens   = PACING_BURST;
+    c->pacer.refill   = 0;
+    c->pacer.decrease = 0;
+    c->pacer.lost     = false;
+    c->pacer.limited  = false;
+    c->pacer.head     = 0;
+    c->pacer.n        = 0;
+}
+
+static void pacing_refill(Pacer *pc, Clock now) {
+    if(now <= pc->refill)
+        return;
+    if(pc->refill)
+        pc->tokens = min(pc->tokens + (long)(pc->rate * (now - pc->refill) / 1000), (long)PACING_BURST);
+    pc->refill = now;
+}
+
+void pacing_update(Client *c) {
+    Pacer *pc = &c->pacer;
+    Clock rtt = max(c->rtt.srtt, (Clock)UPDATE_INTERVAL);
+    bool delayed = c->rtt.min && c->rtt.srtt > c->rtt.min + PACING_DELAY;
+
+    if(pc->lost || delayed) {
+        if(server->cur_clock >= pc->decrease + rtt) {
+            pc->rate = max(pc->rate / 2, (size_t)PACING_MIN_RATE);
+            pc->decrease = server->cur_clock;
+        }
+    } else if(pc->limited) {
+        pc->rate += c->mtu.size * 1000 / rtt * UPDATE_INTERVAL / rtt;
+        pc->rate = min(pc->rate, (size_t)PACING_MAX_RATE);
+    }
+
+    pc->lost    = false;
+    pc->limited = false;
+    c->schedule.budget = min((size_t)(c->relay ? RELAY_BUDGET : UPDATE_BUDGET), pc->rate * UPDATE_INTERVAL / 1000);
+
+    counter_set(COUNTER_RATE, pc->rate);
+    counter_set(COUNTER_RATE_CLIENTS, 1);
+}
+
+bool pacing_ready(Client *c) {
+    return c->pacer.n <= PACING_QUEUE / 2;
+}
+
+void pacing_loss(Client *c) {
+    c->pacer.lost = true;
+}
+
+bool pacing_send(Client *c, Packet *p) {
+    Pacer *pc = &c->pacer;
+
+    pacing_refill(pc, server->cur_clock);
+    if(!pc->n && pc->tokens > 0) {
+        pc->tokens -= p->end - p->start;
+        return packet_send(p);
+    }
+
+    pc->limited = true;
+    if(pc->n == PACING_QUEUE) {
+        counter_set(COUNTER_DROPPED, 1);
+        pc->lost = true;
+        return true;
+    }
+
+    pc->queue[(pc->head + pc->n) % PACING_QUEUE] = *p;
+    pc->n ++;
+    counter_set(COUNTER_PACED, 1);
+    return true;
+}
+
+Clock pacing_deadline(Client *c) {
+    Pacer *pc = &c->pacer;
+
+    if(!pc->n)
+        return 0;
+    if(pc->tokens > 0)
+        return pc->refill;
+
+    /* until the tokens are positive again */
+    return pc->refill + ((size_t)(1 - pc->tokens) * 1000 + pc->rate - 1) / pc->rate;
+}
+
+bool pacing_release(Client *c, Clock now) {
+    Pacer *pc = &c->pacer;
+    Packet *p;
+
+    pacing_refill(pc, now);
+    while(pc->n && pc->tokens > 0) {
+        p = &pc->queue[pc->head];
+        pc->head = (pc->head + 1) % PACING_QUEUE;
+        pc->n --;
+        pc->tokens -= p->end - p->start;
+        if(!packet_send(p))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef PACING_H
+#define PACING_H
+
+#include <stddef.h>
+
+#include "clock.h"
+#include "packet.h"
+#include "types.h"
+
+/* send rate of a client and the packets that wait for it */
+struct Pacer {
+    size_t rate;     /* allowed bytes per second */
+    long   tokens;   /* bytes that may be sent, negative after a large packet */
+    Clock  refill;   /* time the tokens were last added */
+    Clock  decrease; /* time of the last decrease of the rate */
+    bool   lost;     /* messages have been lost since the last update */
+    bool   limited;  /* packets had to wait since the last update */
+
+    /* ring buffer of waiting packets */
+    size_t head, n;
+    Packet queue[PACING_QUEUE];
+};
+
+void pacing_reset(Client *c);
+
+/* adapt the rate, once per update */
+void pacing_update(Client *c);
+
+/* whether new packets should be produced for c */
+bool pacing_ready(Client *c);
+
+/* a reliable message to c had to be resent */
+void pacing_loss(Client *c);
+
+/* send p to c if the rate allows it, otherwise queue it */
+bool pacing_send(Client *c, Packet *p);
+
+/* send as many queued packets as the rate allows at time now */
+bool pacing_release(Client *c, Clock now);
+
+/* time at which pacing_release can send the next queued packet,
+ * 0 if no packets wait
+ */
+Clock pacing_deadline(Client *c);
+
+#endif
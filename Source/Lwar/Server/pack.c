@@ -6,15 +6,12 @@
 #include "player.h"
 #include "message.h"
 #include "entity.h"
+#include "snapshot.h"
 #include "uint.h"
 
 #include <limits.h>
 #include <string.h>
 
-#ifdef _MSC_VER
-    #define strndup(s, n) _strdup(s)
-#endif
-
 size_t id_pack(char *out, Id id) {
     uint16_pack(out,   id.gen);
     uint16_pack(out+2, id.n);
@@ -29,12 +26,26 @@ size_t str_pack(char *out, Str in) {
 }
 
 
+/* Packets of clients of REVISION_COMPACT are marked by APP_ID_COMPACT.
+ * Their header has variable-length fields and a frame number, which
+ * replaces the seqnos of the unreliable messages in the packet; the
+ * seqnos of reliable messages are stored as differences to the previous
+ * reliable message in the same packet, which are small even across the
+ * channels. Packets of other clients and of unknown senders keep the
+ * full headers.
+ */
 size_t header_pack(char *s, void *p) {
     Header *h = (Header*)p;
     size_t i=0;
     i += uint32_pack(s+i, h->app_id);
-    i += uint32_pack(s+i, h->ack);
-    // i += uint32_pack(s+i, h->time);
+    if(h->app_id != APP_ID_COMPACT) {
+        i += uint32_pack(s+i, h->ack);
+    } else {
+        i += uint32_varpack(s+i, h->ack);
+        i += uint32_varpack(s+i, h->frame);
+        i += uint32_varpack(s+i, h->time);
+    }
+    h->prev = 0; /* the differences of the reliable seqnos start over */
     return i;
 }
 
@@ -48,105 +59,54 @@ size_t discovery_pack(char *s, void *p) {
     return i;
 }
 
+#define enum8_pack(s, e) uint8_pack(s, (uint8_t)(e))
+
+static size_t pad_pack(char *s, uint16_t n) {
+    uint16_pack(s, n);
+    memset(s + LENGTH_pad, 0, n);
+    return LENGTH_pad + n;
+}
+
+size_t message_header_pack(char *s, Message *m, Header *h) {
+    size_t i=0;
+
+    i += uint8_pack(s+i, m->type);
+
+    if(h->app_id != APP_ID_COMPACT) {
+        assert(m->seqno);
+        i += uint32_pack(s+i, m->seqno);
+    } else if(is_reliable(m)) {
+        i += uint32_varpack(s+i, zigzag((int32_t)((uint32_t)m->seqno - h->prev)));
+        h->prev = (uint32_t)m->seqno;
+    }
+    return i;
+}
+
 size_t message_pack(char *s, void *p) {
     Message *m = (Message *)p;
     size_t i=0;
-    int j;
 
     i += uint8_pack(s+i, m->type);
 
     assert(m->seqno);
     i += uint32_pack(s+i, m->seqno);
 
+    return i + message_body_pack(s+i, m);
+}
+
+size_t message_body_pack(char *s, Message *m) {
+    size_t i=0;
+    int j;
+
     switch(m->type) {
-    case MESSAGE_CONNECT:
-        i += uint8_pack(s+i, m->connect.rev);
-        i += str_pack(s+i, m->connect.nick);
-        break;
-    case MESSAGE_DISCONNECT:
-        break;
-    case MESSAGE_JOIN:
-        i += id_pack(s+i, m->join.player_id);
-        i += str_pack(s+i, m->join.nick);
-        break;
-    case MESSAGE_LEAVE:
-        i += id_pack(s+i, m->leave.player_id);
-        i += uint8_pack(s+i, (uint8_t)m->leave.reason);
-        break;
-    case MESSAGE_CHAT:
-        i += id_pack(s+i, m->chat.player_id);
-        i += str_pack(s+i, m->chat.msg);
-        break;
-    case MESSAGE_ADD:
-        i += id_pack(s+i, m->add.entity_id);
-        i += id_pack(s+i, m->add.player_id);
-		i += id_pack(s+i, m->add.parent_id);
-        i += uint8_pack(s+i, m->add.type_id);
-        break;
-    case MESSAGE_REMOVE:
-        i += id_pack(s+i, m->remove.entity_id);
-        break;
-    case MESSAGE_SELECTION:
-        i += id_pack(s+i, m->selection.player_id);
-        i += uint8_pack(s+i, m->selection.ship_type);
-        i += uint8_pack(s+i, m->selection.weapon_type1);
-        i += uint8_pack(s+i, m->selection.weapon_type2);
-        i += uint8_pack(s+i, m->selection.weapon_type3);
-        i += uint8_pack(s+i, m->selection.weapon_type4);
-        break;
-    case MESSAGE_NAME:
-        i += id_pack(s+i, m->name.player_id);
-        i += str_pack(s+i, m->name.nick);
-        break;
-    case MESSAGE_KILL:
-        i += id_pack(s+i, m->kill.killer_id);
-        i += id_pack(s+i, m->kill.victim_id);
-        break;
-    case MESSAGE_SYNCED:
-		i += id_pack(s+i, m->synced.player_id);
-        break;
-    case MESSAGE_REJECT:
-        i += uint8_pack(s+i, (uint8_t)m->reject.reason);
-        break;
-    case MESSAGE_UPDATE:
-    case MESSAGE_UPDATE_POS:
-    case MESSAGE_UPDATE_RAY:
-    case MESSAGE_UPDATE_CIRCLE:
-    case MESSAGE_UPDATE_SHIP:
-        i += uint8_pack(s+i, m->update.n);
-        break;
-    case MESSAGE_INPUT:
-        i += id_pack(s+i, m->input.player_id);
-        i += uint32_pack(s+i, m->input.frameno);
-        i += uint8_pack(s+i, m->input.forwards);
-        i += uint8_pack(s+i, m->input.backwards);
-        i += uint8_pack(s+i, m->input.turn_left);
-        i += uint8_pack(s+i, m->input.turn_right);
-        i += uint8_pack(s+i, m->input.strafe_left);
-        i += uint8_pack(s+i, m->input.strafe_right);
-		i += uint8_pack(s+i, m->input.after_burner);
-        i += uint8_pack(s+i, m->input.fire1);
-        i += uint8_pack(s+i, m->input.fire2);
-        i += uint8_pack(s+i, m->input.fire3);
-        i += uint8_pack(s+i, m->input.fire4);
-        i += int16_pack(s+i, m->input.aim_x);
-        i += int16_pack(s+i, m->input.aim_y);
-        break;
-    case MESSAGE_STATS:
-        i += uint8_pack(s+i, m->stats.n);
-        for (j = 0; j < m->stats.n; ++j) {
-            i += id_pack(s+i, m->stats.info[j].player_id);
-            i += uint16_pack(s+i, m->stats.info[j].kills);
-            i += uint16_pack(s+i, m->stats.info[j].deaths);
-            i += uint16_pack(s+i, m->stats.info[j].ping);
-        }
-        break;
-    case MESSAGE_COLLISION:
-        i += id_pack(s+i, m->collision.entity_id[0]);
-        i += id_pack(s+i, m->collision.entity_id[1]);
-        i += int16_pack(s+i, m->collision.x);
-        i += int16_pack(s+i, m->collision.y);
-        break;
+#define MESSAGE(T, name)        case MESSAGE_##T:
+#define FIELD(name, type, f)        i += type##_pack(s+i, m->name.f);
+#define ARRAY(name, n, a, max)      i += uint8_pack(s+i, m->name.n); \
+                                    for(j=0; j<m->name.n; j++) {
+#define ITEM(name, a, type, f)          i += type##_pack(s+i, m->name.a[j].f);
+#define ARRAY_END(name, a)          }
+#define MESSAGE_END(T, name)        break;
+#include "schema.h"
     }
     return i;
 }
@@ -219,3 +179,211 @@ size_t update_ship_pack(char *s, void *p) {
 
     return i;
 }
+
+static size_t id_gather(uint16_t *w, Id id) {
+    w[0] = id.gen;
+    w[1] = id.n;
+    return 2;
+}
+
+/* the conversions must be those of the int16_pack/uint16_pack calls above */
+size_t update_pos_rotation_gather(uint16_t *w, void *p) {
+    Entity *e = (Entity*)p;
+    size_t i=0;
+    i += id_gather(w+i, e->id);
+    w[i++] = e->x.x;
+    w[i++] = e->x.y;
+    w[i++] = deg100(e->phi);
+    return i;
+}
+
+size_t update_pos_gather(uint16_t *w, void *p) {
+    Entity *e = (Entity*)p;
+    size_t i=0;
+    i += id_gather(w+i, e->id);
+    w[i++] = e->x.x;
+    w[i++] = e->x.y;
+    return i;
+}
+
+size_t update_ray_gather(uint16_t *w, void *p) {
+    Entity *e = (Entity*)p;
+    Id none = { 0, USHRT_MAX };
+    size_t i=0;
+    i += id_gather(w+i, e->id);
+    w[i++] = e->x.x;
+    w[i++] = e->x.y;
+    w[i++] = deg100(e->phi);
+    w[i++] = e->len;
+    i += id_gather(w+i, !e->target ? none : e->target->id);
+    return i;
+}
+
+size_t update_circle_gather(uint16_t *w, void *p) {
+    Entity *e = (Entity*)p;
+    size_t i=0;
+    i += id_gather(w+i, e->id);
+    w[i++] = e->x.x;
+    w[i++] = e->x.y;
+    w[i++] = e->radius;
+    return i;
+}
+
+/* health, shield and the energies fill the high byte first */
+size_t update_ship_gather(uint16_t *w, void *p) {
+    Entity *e = (Entity*)p;
+    uint8_t b[2 + NUM_SLOTS];
+    size_t i=0, j=0;
+    i += id_gather(w+i, e->id);
+    w[i++] = e->x.x;
+    w[i++] = e->x.y;
+    w[i++] = deg100(e->phi);
+    b[j++] = 100 * e->health / e->type->init_health;
+    b[j++] = 100 * e->health / e->type->init_health;
+
+    if(e->player) {
+        Slot *sl;
+        SlotType *st;
+        slots_foreach(e->player,sl,st) {
+            Entity *r = sl->entity;
+            b[j++] = 100 * r->energy / r->type->init_energy;
+        }
+    } else {
+        for(; j<sizeof(b); j++)
+            b[j] = 100;
+    }
+
+    for(j=0; j<sizeof(b); j+=2)
+        w[i++] = (uint16_t)(b[j] << 8 | b[j+1]);
+    return i;
+}
+
+size_t delta_pack(char *s, void *p) {
+    Delta *d = (Delta*)p;
+    State *st = &d->state;
+    size_t i=0, j;
+    i += id_pack(s+i, st->id);
+    i += uint8_pack(s+i, d->head);
+    if(d->head & DELTA_POS) {
+        if(d->head & DELTA_BASE) {
+            i += int16_varpack(s+i, st->x - d->base->x);
+            i += int16_varpack(s+i, st->y - d->base->y);
+        } else {
+            i += int16_pack(s+i, st->x);
+            i += int16_pack(s+i, st->y);
+        }
+    }
+    if(d->head & DELTA_PHI) {
+        if(d->head & DELTA_BASE)
+            i += int16_varpack(s+i, st->phi - d->base->phi);
+        else
+            i += uint16_pack(s+i, st->phi);
+    }
+    if(d->head & DELTA_EXTRA) {
+        if(d->fields & STATE_LEN)    i += uint16_pack(s+i, st->len);
+        if(d->fields & STATE_TARGET) i += id_pack(s+i, st->target);
+        if(d->fields & STATE_RADIUS) i += uint16_pack(s+i, st->radius);
+        if(d->fields & STATE_HEALTH) {
+            i += uint8_pack(s+i, st->health);
+            i += uint8_pack(s+i, st->shield);
+        }
+        if(d->fields & STATE_ENERGY) {
+            for(j=0; j<NUM_SLOTS; j++)
+                i += uint8_pack(s+i, st->energy[j]);
+        }
+    }
+    return i;
+}
+
+static void coord_write(BitStream *b, int16_t x, const int16_t *base) {
+    int32_t q = x >> POSITION_SHIFT;
+    if(base)
+        bits_put_golomb(b, zigzag(q - (*base >> POSITION_SHIFT)), 3);
+    else
+        bits_put(b, (uint32_t)q, 16 - POSITION_SHIFT);
+}
+
+void delta_write(BitStream *b, Delta *d, uint16_t *prev) {
+    State *st = &d->state;
+    const State *base = (d->head & DELTA_BASE) ? d->base : 0;
+    size_t j;
+
+    /* the generation is implied by the baseline */
+    bits_put(b, d->head, 8);
+    bits_put_golomb(b, zigzag((int32_t)st->id.n - *prev), 2);
+    if(!(d->head & DELTA_BASE))
+        bits_put(b, st->id.gen, 8);
+    *prev = st->id.n;
+
+    if(d->head & DELTA_POS) {
+        coord_write(b, st->x, base ? &base->x : 0);
+        coord_write(b, st->y, base ? &base->y : 0);
+    }
+    if(d->head & DELTA_PHI) {
+        uint32_t q = angle_quantize(st->phi);
+        if(base) {
+            /* shortest way around */
+            int32_t a = (int32_t)((q - angle_quantize(base->phi)) % (1u << ANGLE_BITS));
+            if(a >= (1 << (ANGLE_BITS - 1))) a -= 1 << ANGLE_BITS;
+            bits_put_golomb(b, zigzag(a), 3);
+        } else {
+            bits_put(b, q, ANGLE_BITS);
+        }
+    }
+    if(d->head & DELTA_EXTRA) {
+        if(d->fields & STATE_LEN) bits_put_golomb(b, st->len, 6);
+        if(d->fields & STATE_TARGET) {
+            bool has = st->target.n != UINT16_MAX;
+            bits_put(b, has, 1);
+            if(has) {
+                bits_put(b, st->target.n, 16);
+                bits_put(b, st->target.gen, 8);
+            }
+        }
+        if(d->fields & STATE_RADIUS) bits_put_golomb(b, st->radius, 6);
+        if(d->fields & STATE_HEALTH) {
+            bits_put(b, st->health, 7);
+            bits_put(b, st->shield, 7);
+        }
+        if(d->fields & STATE_ENERGY) {
+            for(j=0; j<NUM_SLOTS; j++)
+                bits_put(b, st->energy[j], 7);
+        }
+    }
+}
+
+static void event_id_write(BitStream *b, Id id, uint16_t *prev) {
+    bits_put_golomb(b, zigzag((int32_t)id.n - *prev), 2);
+    bits_put_golomb(b, id.gen, 2);
+    *prev = id.n;
+}
+
+void event_write(BitStream *b, Message *m, uint16_t *prev) {
+    uint16_t n;
+
+    switch(m->type) {
+    case MESSAGE_ADD:
+        event_id_write(b, m->add.entity_id, prev);
+        n = 0;
+        event_id_write(b, m->add.player_id, &n);
+        /* children follow their parents closely */
+        bits_put(b, m->add.parent_id.n != USHRT_MAX, 1);
+        if(m->add.parent_id.n != USHRT_MAX) {
+            n = *prev;
+            event_id_write(b, m->add.parent_id, &n);
+        }
+        bits_put_golomb(b, m->add.type_id, 2);
+        break;
+    case MESSAGE_REMOVE:
+        event_id_write(b, m->remove.entity_id, prev);
+        break;
+    case MESSAGE_COLLISION:
+        event_id_write(b, m->collision.entity_id[0], prev);
+        event_id_write(b, m->collision.entity_id[1], prev);
+        bits_put(b, (uint16_t)m->collision.x, 16);
+        bits_put(b, (uint16_t)m->collision.y, 16);
+        break;
+    default:
+        assert(false);
+    }
+}
@@ -1,6 +1,7 @@
 #ifndef PACK_H
 #define PACK_H
 
+#include "bitstream.h"
 #include "id.h"
 #include "str.h"
 
@@ -12,10 +13,33 @@ size_t discovery_pack(char *s, void *p);
 size_t header_pack(char *s, void *p);
 size_t message_pack(char *s, void *p);
 
+/* message_pack in two parts: the header of m in a packet with header h,
+ * which is compact for APP_ID_COMPACT, and the fields of m
+ */
+size_t message_header_pack(char *s, Message *m, Header *h);
+size_t message_body_pack(char *s, Message *m);
+
 size_t update_pos_rotation_pack(char *s, void *p);
 size_t update_pos_pack(char *s, void *p);
 size_t update_ray_pack(char *s, void *p);
 size_t update_circle_pack(char *s, void *p);
 size_t update_ship_pack(char *s, void *p);
 
+/* the same records as 16 bit words in host byte order, see batch.c */
+size_t update_pos_rotation_gather(uint16_t *w, void *p);
+size_t update_pos_gather(uint16_t *w, void *p);
+size_t update_ray_gather(uint16_t *w, void *p);
+size_t update_circle_gather(uint16_t *w, void *p);
+size_t update_ship_gather(uint16_t *w, void *p);
+
+size_t delta_pack(char *s, void *p);
+
+/* bit-packed delta record, ids are relative to *prev */
+void   delta_write(BitStream *b, Delta *d, uint16_t *prev);
+
+/* bit-packed record of a single Add, Remove or Collision message in its
+ * batched message, ids are relative to *prev
+ */
+void   event_write(BitStream *b, Message *m, uint16_t *prev);
+
 #endif
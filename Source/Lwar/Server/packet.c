@@ -4,8 +4,11 @@
 
 #include "connection.h"
 #include "debug.h"
+#include "local.h"
 #include "pack.h"
+#include "performance.h"
 #include "server.h"
+#include "shard.h"
 #include "unpack.h"
 
 #include <string.h>
@@ -14,7 +17,7 @@ void debug_packet(Packet *p);
 
 static bool check_put(Packet *p,size_t n) {
     return    n != 0
-           && p->end + n <= MAX_PACKET_LENGTH;
+           && p->end + n <= p->mtu;
 }
 
 static bool check_get(Packet *p,size_t n) {
@@ -23,7 +26,7 @@ static bool check_get(Packet *p,size_t n) {
 }
 
 bool packet_hasdata(Packet *p) {
-    return (p->start + HEADER_LENGTH < p->end);
+    return (p->start + p->header < p->end);
 }
 
 bool packet_isempty(Packet *p) {
@@ -32,8 +35,8 @@ bool packet_isempty(Packet *p) {
 
 size_t packet_update_n(Packet *p, size_t s) {
     size_t i = p->end + UPDATE_HEADER_LENGTH;
-    if(i < MAX_PACKET_LENGTH)
-        return (MAX_PACKET_LENGTH - i) / s;
+    if(i < p->mtu)
+        return (p->mtu - i) / s;
     return 0;
 }
 
@@ -42,6 +45,7 @@ static void packet_init(Packet *p, const Address *adr, PacketType type, Connecti
     p->type  = type;
     p->adr   = *adr;
     p->conn  = conn;
+    p->mtu   = MIN_PACKET_LENGTH;
 }
 
 void packet_init_send(Packet *p, Address *adr) {
@@ -65,12 +69,19 @@ bool packet_put(Packet *p, Pack *pack, void *u) {
     }
 }
 
+bool packet_put_header(Packet *p, Header *h) {
+    if(!packet_put(p, header_pack, h))
+        return false;
+    p->header = p->end;
+    return true;
+}
+
 bool packet_get(Packet *p, Unpack *unpack, void *u) {
     assert(p->type == PACKET_RECV);
     assert(p->start <= p->end);
     if(p->start == p->end) return false;
 
-    size_t n = unpack(p->p + p->start, u);
+    size_t n = unpack(p->p + p->start, p->end - p->start, u);
     if(check_get(p,n)) {
         p->start += n;
         return true;
@@ -83,7 +94,7 @@ bool packet_peek(Packet *p, size_t *pos, Unpack *unpack, void *u) {
     assert(*pos <= p->end);
     if(*pos == p->end) return false;
 
-    size_t n = unpack(p->p + *pos, u);
+    size_t n = unpack(p->p + *pos, p->end - *pos, u);
     if(n != 0 && *pos + n <= p->end) {
         *pos += n;
         return true;
@@ -99,7 +110,29 @@ bool packet_recv(Packet *p) {
     p->end = MAX_PACKET_LENGTH;
 	p->adr = address_none;
 
-    return conn_recv(p->conn, p->p, &p->end, &p->adr);
+    /* the client in the same process first, it does not need a system call */
+    local_recv(p->p, &p->end, &p->stamp);
+    if(p->end != 0) {
+        p->adr = address_local;
+    }
+    else if(shards_active()) {
+        p->end = MAX_PACKET_LENGTH;
+        if(!shards_recv(p->p, &p->end, &p->adr))
+            return false;
+        p->stamp = shards_stamp();
+    }
+    else {
+        p->end = MAX_PACKET_LENGTH;
+        if(!conn_recv(p->conn, p->p, &p->end, &p->adr))
+            return false;
+        p->stamp = conn_stamp(p->conn);
+    }
+
+    if(p->end != 0) {
+        counter_set(COUNTER_RECV, 1);
+        counter_set(COUNTER_RECV_BYTES, p->end);
+    }
+    return true;
 }
 
 bool packet_send(Packet *p) {
@@ -110,5 +143,13 @@ bool packet_send(Packet *p) {
 
     debug_packet(p);
 
+    counter_set(COUNTER_SEND, 1);
+    counter_set(COUNTER_SEND_BYTES, p->end - p->start);
+
+    /* a full ring drops the packet like the kernel, which is no error */
+    if(local_is(&p->adr)) {
+        local_send(p->p, p->end - p->start);
+        return true;
+    }
     return conn_send(p->conn, p->p, p->end - p->start, &p->adr);
 }
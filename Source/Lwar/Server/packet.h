@@ -9,9 +9,11 @@ typedef enum PacketType PacketType;
 typedef struct Packet Packet;
 
 enum {
-    UPDATE_HEADER_LENGTH = sizeof(uint32_t) + 2 * sizeof(uint8_t),  /* msg type, n */
-    HEADER_LENGTH        = 3 * sizeof(uint32_t), /* app_id, ack, time */
-    MAX_PACKET_LENGTH    = 512,
+    UPDATE_HEADER_LENGTH = MESSAGE_LENGTH_UPDATE,  /* msg type, seqno, n */
+    HEADER_LENGTH        = 2 * sizeof(uint32_t), /* app_id, ack */
+    COMPACT_HEADER_LENGTH = sizeof(uint32_t) + 3, /* app_id, ack, frame, time at their shortest */
+    MIN_PACKET_LENGTH    =  512, /* supported by all clients */
+    MAX_PACKET_LENGTH    = 1200, /* largest size that can be negotiated */
 };
 
 enum PacketType {
@@ -26,15 +28,20 @@ struct Packet {
 
     Address adr;
 
-    /* allow some overflow: since string length is a byte, this can be max 256 + some backup */
-    char    p[MAX_PACKET_LENGTH + MAX_NAME_LENGTH + 16];
+    /* allow some overflow: a message is packed before its length is checked,
+     * since string length is a byte, this can be max 256 + a full stats page + some backup
+     */
+    char    p[MAX_PACKET_LENGTH + 256 + MAX_STATS * ITEM_LENGTH_stats + 16];
     size_t  start, end;
+    size_t  mtu;    /* maximal length of a packet to send */
+    size_t  header; /* length of the packet header of a packet to send */
 
     /* temp storage for incoming packets */
     /*
     size_t  ack;
     size_t  time;
     */
+    uint64_t stamp; /* receive time, see conn_stamp */
 
     Connection *conn;
 };
@@ -49,6 +56,7 @@ void packet_init_send(Packet *p, Address *adr);
 void packet_init_recv(Packet *p);
 
 bool packet_put(Packet *p, Pack *pack, void *u);
+bool packet_put_header(Packet *p, Header *h); /* which packet_hasdata does not count */
 bool packet_get(Packet *p, Unpack *unpack, void *u);
 bool packet_peek(Packet *p, size_t *pos, Unpack *unpack, void *u);
 
@@ -11,6 +11,19 @@ enum {
     COUNTER_RECV,
     COUNTER_SEND,
     COUNTER_RESEND,
+    COUNTER_RECV_BYTES,
+    COUNTER_SEND_BYTES,
+    COUNTER_PACED,        /* packets that had to wait for the rate of the client */
+    COUNTER_DROPPED,      /* packets dropped because too many had to wait */
+    COUNTER_RATE,         /* rate of a client, in bytes/s */
+    COUNTER_RATE_CLIENTS, /* number of rates in COUNTER_RATE */
+    COUNTER_OVERRUN,      /* datagrams dropped because a shard was full */
+    COUNTER_SYSCALLS,     /* system calls to receive and send */
+    COUNTER_FILTERED,     /* packets dropped before decoding, see ingress.c */
+    COUNTER_EVENTS,       /* adds, removes and collisions, see queue.c */
+    COUNTER_QUEUED,       /* messages that have been queued */
+    COUNTER_PACKED,       /* messages that have been packed into packets */
+    COUNTER_HEADER_BYTES, /* of the sent packets and their messages */
 };
 
 void timer_start(unsigned int timer);
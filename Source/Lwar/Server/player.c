@@ -35,6 +35,9 @@ void player_init(Player *p, size_t id) {
 
 void player_clear(Player *p) {
 	entities_remove_for(p);
+    str_release(p->name);
+    p->name.n = 0;
+    p->name.s = 0;
 }
 
 void player_input(Player *p,
@@ -129,8 +132,17 @@ void player_notify_entity(Entity *e) {
     e->slot->entity = 0;
 }
 
-void player_rename(Player *p, Str name) {
+bool player_rename(Player *p, Str name) {
+    if(name.n > MAX_NAME_LENGTH)
+        name.n = MAX_NAME_LENGTH;
+
+    /* keep the old name if the new one does not fit */
+    if(!str_intern(&name))
+        return false;
+
+    str_release(p->name);
     p->name = name;
+    return true;
 }
 
 static void player_action(Player *p) {
@@ -154,7 +166,8 @@ void players_update() {
     Client *c;
     Player *p;
     clients_foreach(c) {
-        if(c->dead) continue;
+        /* relays do not play */
+        if(c->dead || c->relay) continue;
 
         p = &c->player;
 
@@ -34,7 +34,7 @@ void player_select(Player *p,
                    int ship_type_id,
                    int weapon_type_id1, int weapon_type_id2,
                    int weapon_type_id3, int weapon_type_id4);
-void player_rename(Player *p, Str name);
+bool player_rename(Player *p, Str name);
 void player_spawn(Player *p, Vec x);
 void player_notify_entity(Entity *e);
 void players_update();
@@ -3,14 +3,26 @@
 #include "protocol.h"
 
 #include "config.h"
+#include "connection.h"
 #include "debug.h"
+#include "ingress.h"
+#include "interest.h"
+#include "jitter.h"
+#include "latency.h"
 #include "log.h"
 #include "message.h"
+#include "mtu.h"
+#include "pacing.h"
 #include "pack.h"
+#include "packet.h"
 #include "performance.h"
 #include "queue.h"
+#include "rate.h"
+#include "schedule.h"
 #include "server.h"
+#include "snapshot.h"
 #include "stream.h"
+#include "transfer.h"
 #include "unpack.h"
 
 #include <math.h>
@@ -27,7 +39,9 @@ void queue_gamestate_for(Client *cn);
 void debug_message(Message *m, const char *s);
 
 static void send_reject(Address *adr, size_t ack, RejectReason reason);
+static void send_cookie(Address *adr);
 static void send_kick(Client *c);
+static void queue_leave(Client *c, LeaveReason reason);
 
 static jmp_buf io_error_handler;
 
@@ -54,53 +68,104 @@ static bool check_behavior(Client *c, bool test, const char *msg) {
 }
 
 static bool check_behavior_id(Client *c, Id id) {
+    if(check_behavior(c, c->relay, "relay acts as a player")) return true;
     return check_behavior(c, !id_eq(c->player.id, id), "wrong player id");
 }
 
-static bool check_seqno(Client *c, Message *m) {
+/* the unreliable messages of a compact packet share its frame, so a
+ * frame is accepted more than once, see pack.c
+ */
+static bool check_seqno(Client *c, Header *h, Message *m) {
+    Channel *ch;
 	if (!c) return true;
 
     if(is_reliable(m)) {
-        if(m->seqno != c->last_in_reliable_seqno + 1) return false;
-        c->last_in_reliable_seqno = m->seqno;
+        ch = &c->channels[message_channel(m->type, c->rev)];
+        ch->ack = true; /* also if it has been resent */
+        if(m->seqno != ch->last_in + 1) return false;
+        ch->last_in = m->seqno;
     }
 	else {
-        if(m->seqno <= c->last_in_unreliable_seqno) return false;
+        if(h->app_id == APP_ID_COMPACT) {
+            if(m->seqno < c->last_in_unreliable_seqno) return false;
+        }
+        else if(m->seqno <= c->last_in_unreliable_seqno) return false;
         c->last_in_unreliable_seqno = m->seqno;
     }
     return true;
 }
 
-void message_handle(Client *c, Address *adr, Message *m) {
+void message_handle(Client *c, Header *h, Message *m) {
+    Address *adr = &h->adr;
+    Channel *ch;
     Message r;
 
     switch(m->type) {
     case MESSAGE_CONNECT:
-		if (m->connect.rev != NETWORK_REVISION) { 
+		if (m->connect.rev < MIN_REVISION || m->connect.rev > server->revision) {
 			send_reject(adr, m->seqno, REJECT_VERSION_MISMATCH);
 			break;
 		}
 
         /* TODO: probably allow reconnects */
         if(check_behavior(c, c != 0, "reconnect")) return;
+
+        /* no state for senders that have not shown that they receive
+         * at their address, see ingress.c
+         */
+        if(m->connect.rev >= REVISION_COOKIE && !h->cookie) {
+            send_cookie(adr);
+            return;
+        }
+
+        /* relays see the whole match, see interest.c */
+        if(h->relay && !ingress_relay_allowed(adr)) {
+            log_debug("relay rejected");
+            send_reject(adr, m->seqno, REJECT_RELAY);
+            return;
+        }
+
+        /* the game state of a new client needs a join for every player,
+         * the connect is not acknowledged and will be resent by the client
+         */
+        if(!queue_room(2 * MAX_CLIENTS)) return;
+
+        /* older revisions have no cookie, see ingress.c */
+        if(!h->cookie && !ingress_legacy_admit()) return;
+
         c = client_create(adr);
         if(c) {
-            check_seqno(c, m);
+            c->rev = m->connect.rev;
+            check_seqno(c, h, m);
             c->last_activity = server->cur_clock;
+            c->relay = h->relay && c->rev >= REVISION_RELAY;
 
 			player_rename(&c->player, m->connect.nick);
-            message_join(&r, c);
-            queue_broadcast(&r);
+            if(!c->relay) {
+                message_join(&r, c);
+                queue_broadcast(&r);
+            }
             queue_gamestate_for(c);
         } else {
             send_reject(adr, m->seqno, REJECT_FULL);
         }
         break;
 
+    case MESSAGE_COOKIE:
+        /* admits the connect that follows in the same packet */
+        if(!c) h->cookie = ingress_cookie_valid(adr, m->cookie.value);
+        break;
+
+    case MESSAGE_RELAY:
+        /* the connect that follows in the same packet is a relay,
+         * which is not announced to the players
+         */
+        if(!c) h->relay = true;
+        break;
+
     case MESSAGE_DISCONNECT:
         if(!c) return;
-        message_leave(&r, c, LEAVE_QUIT);
-        queue_broadcast(&r);
+        queue_leave(c, LEAVE_QUIT);
         client_remove(c);
         break;
 
@@ -125,33 +190,61 @@ void message_handle(Client *c, Address *adr, Message *m) {
     case MESSAGE_NAME:
         if(!c) return;
         if(check_behavior_id(c, m->name.player_id)) return;
-        player_rename(&c->player, m->name.nick);
+        if(!player_rename(&c->player, m->name.nick)) return;
+        m->name.nick = c->player.name;
         queue_broadcast(m);
         break;
 
     case MESSAGE_INPUT:
         if(!c) return;
         if(check_behavior_id(c, m->input.player_id)) return;
-        {
-            if(m->input.frameno < c->last_in_frameno)
-                break;
-            uint8_t mask = ~(0xff << (m->input.frameno - c->last_in_frameno));
-			c->last_in_frameno = m->input.frameno;
-            player_input(&c->player,
-                         mask & m->input.forwards,
-                         mask & m->input.backwards,
-                         mask & m->input.turn_left,
-                         mask & m->input.turn_right,
-                         mask & m->input.strafe_left,
-                         mask & m->input.strafe_right,
-                         mask & m->input.fire1,
-                         mask & m->input.fire2,
-                         mask & m->input.fire3,
-                         mask & m->input.fire4,
-                                m->input.aim_x,
-                                m->input.aim_y
-                         );
-        }
+        jitter_input(c, m, h->stamp);
+        break;
+
+    case MESSAGE_DELTA_ACK:
+        if(!c) return;
+        if(check_behavior(c, c->rev < REVISION_DELTA, "unexpected delta ack")) return;
+        if(check_behavior(c, m->delta_ack.snapshot > server->snapshot, "future snapshot")) return;
+        snapshot_ack(c, m->delta_ack.snapshot);
+        break;
+
+    case MESSAGE_MTU:
+        if(!c) return;
+        if(check_behavior(c, c->rev < REVISION_MTU, "unexpected mtu")) return;
+        mtu_announce(c, m->mtu.size);
+        message_mtu(&r, c->mtu.max);
+        queue_unicast(c, &r);
+        break;
+
+    case MESSAGE_MTU_ACK:
+        if(!c) return;
+        if(check_behavior(c, c->rev < REVISION_MTU, "unexpected mtu ack")) return;
+        mtu_ack(c, m->mtu_ack.size);
+        break;
+
+    case MESSAGE_SACK:
+        if(!c) return;
+        if(check_behavior(c, c->rev < REVISION_SACK, "unexpected sack")) return;
+        ch = &c->channels[CHANNEL_STATE];
+        if(check_behavior(c, m->sack.ack >= ch->next_out, "future ack")) return;
+        ch->last_in_ack = max((size_t)m->sack.ack, ch->last_in_ack);
+        queue_ack(c, CHANNEL_STATE, m->sack.ack, m->sack.mask);
+        break;
+
+    case MESSAGE_CHANNEL_ACK:
+        if(!c) return;
+        if(check_behavior(c, c->rev < REVISION_CHANNELS, "unexpected channel ack")) return;
+        if(check_behavior(c, m->channel_ack.channel >= CHANNELS, "invalid channel")) return;
+        ch = &c->channels[m->channel_ack.channel];
+        if(check_behavior(c, m->channel_ack.ack >= ch->next_out, "future ack")) return;
+        ch->last_in_ack = max((size_t)m->channel_ack.ack, ch->last_in_ack);
+        queue_ack(c, m->channel_ack.channel, m->channel_ack.ack, m->channel_ack.mask);
+        break;
+
+    case MESSAGE_CHUNK_ACK:
+        if(!c) return;
+        if(check_behavior(c, c->rev < REVISION_TRANSFER, "unexpected chunk ack")) return;
+        transfer_ack(c, m->chunk_ack.next, m->chunk_ack.mask);
         break;
 
     default:
@@ -159,20 +252,20 @@ void message_handle(Client *c, Address *adr, Message *m) {
     }
 }
 
+/* entities are added to clients in send_queue_for,
+ * once they enter the respective area of interest
+ */
 void protocol_notify_entity(Entity *e) {
     if(!e->type->format) return;
 
-    Message m;
-    if(e->dead) message_remove(&m, e);
-    else        message_add(&m, e);
-
-    queue_broadcast(&m);
+    if(e->dead)
+        interest_remove(e);
 }
 
 void protocol_notify_collision(Collision *c) {
     Message m;
     message_collision(&m, c);
-    queue_broadcast(&m);
+    queue_event_broadcast(&m);
 }
 
 void protocol_notify_kill(Player *k, Player *v) {
@@ -182,10 +275,12 @@ void protocol_notify_kill(Player *k, Player *v) {
 }
 
 static void header_for(Header *h, Client *c) {
-    h->app_id = APP_ID,
-    h->ack = c->last_in_reliable_seqno;
+    h->app_id = c->rev >= REVISION_COMPACT ? APP_ID_COMPACT : APP_ID;
+    h->ack = c->channels[CHANNEL_STATE].last_in;
     h->time = server->cur_clock;
     h->adr = c->adr;
+    h->mtu = c->mtu.size;
+    h->c = c;
 }
 
 static void header_for_unconnected(Header *h, Address *adr, size_t ack) {
@@ -193,6 +288,8 @@ static void header_for_unconnected(Header *h, Address *adr, size_t ack) {
     h->ack = ack;
     h->time = server->cur_clock;
     h->adr = *adr;
+    h->mtu = MIN_PACKET_LENGTH;
+    h->c = 0;
 }
 
 static void send_kick(Client *c) {
@@ -215,28 +312,43 @@ static void send_reject(Address *adr, size_t ack, RejectReason reason) {
     // stats.nsend ++;
 }
 
-static void send_timeout(Client *c) {
+/* does not acknowledge the connect, which is resent with the cookie */
+static void send_cookie(Address *adr) {
+    Header h;
     Message m;
-    message_leave(&m, c, LEAVE_DROPPED);
-    queue_broadcast(&m);
+    header_for_unconnected(&h, adr, 0);
+    message_cookie(&m, ingress_cookie(adr));
+    m.seqno = 1;
+    stream_send_flush(&h, &m);
 }
 
-
-static void queue_stats() {
+/* relays have never joined */
+static void queue_leave(Client *c, LeaveReason reason) {
     Message m;
-    message_stats(&m);
+    if(c->relay) return;
+    message_leave(&m, c, reason);
     queue_broadcast(&m);
 }
 
-static void queue_updates() {
+static void send_timeout(Client *c) {
+    queue_leave(c, LEAVE_DROPPED);
+}
+
+
+/* the pages of the stats that have to be sent, see rate.c */
+static void queue_stats() {
     Message m;
-    Format *f;
-    formats_foreach(f) {
-        if(f->n == 0)
-            continue;
-        message_update(&m, f);
-        queue_broadcast(&m);
-    }
+    size_t page = 0, i;
+
+    if(!server->rates.stats.due)
+        return;
+
+    do {
+        i = page;
+        message_stats(&m, &page);
+        if(rate_stats_page(&m, i))
+            queue_broadcast(&m);
+    } while(page);
 }
 
 /* Note: already enqueued add messages won't be duplicated,
@@ -245,28 +357,88 @@ static void queue_updates() {
 void queue_gamestate_for(Client *cn) {
     Message m;
 
+    rate_stats_reset();
+
+    /* the same messages as a stream, see transfer.c */
+    if(cn->rev >= REVISION_TRANSFER && transfer_start(cn))
+        return;
+
     Client *c;
     clients_foreach(c) {
-		if(c->dead) continue;
+		if(c->dead || c->relay) continue;
         if(c == cn) continue;
 
         message_join(&m, c);
         queue_unicast(cn, &m);
     }
 
-    Entity *e;
-    entities_foreach(e) {
-		if(e->dead) continue;
-        if(!e->type->format) continue;
-
-        message_add(&m, e);
-        queue_unicast(cn, &m);
-    }
+    interest_update(cn);
 
     message_synced(&m, &cn->player);
     queue_unicast(cn, &m);
 }
 
+/* full updates for clients that do not support delta compression,
+ * the others receive a delta-compressed snapshot
+ */
+static void send_updates_for(Client *c, cr_t *ss, Header *h) {
+    Message m;
+    Format *f;
+
+    schedule_update(c);
+
+    if(c->rev >= REVISION_DELTA) {
+        message_delta(&m, c);
+        if(!stream_send(ss, h, &m))
+            longjmp(io_error_handler,1);
+        return;
+    }
+
+    formats_foreach(f) {
+        if(f->n == 0 || !f->rate.due)
+            continue;
+        message_update(&m, f, c);
+        m.seqno = c->next_out_unreliable_seqno ++;
+        if(!stream_send(ss, h, &m))
+            longjmp(io_error_handler,1);
+    }
+}
+
+/* CHANNEL_STATE is acknowledged in the packet header, the other channels
+ * by a ChannelAck after a reliable message of them has arrived
+ */
+static void send_acks_for(Client *c, cr_t *ss, Header *h) {
+    Message m;
+    size_t j;
+
+    for(j=CHANNEL_STATE+1; j<CHANNELS; j++) {
+        if(!c->channels[j].ack)
+            continue;
+        message_channel_ack(&m, j, c->channels[j].last_in);
+        m.seqno = c->next_out_unreliable_seqno ++;
+        if(!stream_send(ss, h, &m))
+            longjmp(io_error_handler,1);
+        c->channels[j].ack = false;
+    }
+}
+
+/* the chunks of the world that fit into the rate of c for one update */
+static void send_transfer_for(Client *c, cr_t *ss, Header *h) {
+    Message m;
+    size_t tries;
+    size_t n = max(c->pacer.rate * UPDATE_INTERVAL / 1000 / TRANSFER_CHUNK, (size_t)1);
+
+    while(n-- > 0 && transfer_next(c, &m, &tries)) {
+        if(tries > 0) {
+            counter_set(COUNTER_RESEND, 1);
+            pacing_loss(c);
+        }
+        m.seqno = c->next_out_unreliable_seqno ++;
+        if(!stream_send(ss, h, &m))
+            longjmp(io_error_handler,1);
+    }
+}
+
 static void send_queue_for(Client *c) {
     size_t tries;
     cr_t qs = {0};
@@ -275,10 +447,27 @@ static void send_queue_for(Client *c) {
     Header h;
     header_for(&h, c);
 
+    pacing_update(c);
+    if(!pacing_release(c, server->cur_clock))
+        longjmp(io_error_handler,1);
+    if(!pacing_ready(c))
+        return;
+
+    interest_update(c);
+    queue_events_close(c);
+
+    if(!mtu_update(c, &h))
+        longjmp(io_error_handler,1);
+
+    send_acks_for(c, &ss, &h);
+    send_transfer_for(c, &ss, &h);
+
     Message *m;
     while((m = queue_next(&qs, c, &tries))) {
-        // if(tries > 0)
-            // stats.nresend ++;
+        if(tries > 0) {
+            counter_set(COUNTER_RESEND, 1);
+            pacing_loss(c);
+        }
         if(tries == 0 && is_reliable(m))
             debug_message(m, dest_fmt(c));
 
@@ -286,7 +475,11 @@ static void send_queue_for(Client *c) {
             longjmp(io_error_handler,1);
     }
 
-    stream_flush(&ss);
+    /* updates refer to entities that a joining client may not know yet */
+    if(!c->transfer)
+        send_updates_for(c, &ss, &h);
+
+    stream_flush(&ss, &h);
 }
 
 void protocol_recv() {
@@ -295,19 +488,58 @@ void protocol_recv() {
     Header h;
     Message m;
 
+    /* the strings of the previous messages are no longer needed */
+    arena_reset(&server->scratch);
+
     while(stream_recv(&ss, &h, &m)) {
         Client *c = client_lookup(&h.adr);
         if(c) {
-            c->last_in_ack   = max(h.ack, c->last_in_ack);
+            Channel *ch = &c->channels[CHANNEL_STATE];
+            if(h.ack > ch->last_in_ack)
+                queue_ack(c, CHANNEL_STATE, h.ack, 0);
+            ch->last_in_ack  = max(h.ack, ch->last_in_ack);
             c->last_activity = max(server->cur_clock, c->last_activity);
         }
 
-        if(check_seqno(c, &m)) {
+        if(check_seqno(c, &h, &m)) {
             if(is_reliable(&m))
                 debug_message(&m, src_fmt(c));
-            message_handle(c, &h.adr, &m);
+            message_handle(c, &h, &m);
+
+            if(c && m.type == MESSAGE_INPUT)
+                latency_input(c, h.stamp);
+        }
+    }
+}
+
+/* send the packets that wait for the rate of their client */
+void protocol_pace(Clock now) {
+    Client *c;
+    clients_foreach(c) {
+        if(c->remote && !c->dead && !pacing_release(c, now)) {
+            send_timeout(c);
+            client_remove(c);
         }
     }
+
+    conn_flush(&server->conn_clients);
+}
+
+/* next time at which protocol_pace releases packets, 0 if none wait */
+Clock protocol_deadline() {
+    Clock deadline = 0;
+    Clock t;
+
+    Client *c;
+    clients_foreach(c) {
+        if(!c->remote || c->dead)
+            continue;
+        t = pacing_deadline(c);
+        if(t && (!deadline || t < deadline))
+            deadline = t;
+    }
+
+    return deadline;
 }
 
 /* (re)send queued messages */
@@ -324,8 +556,10 @@ void protocol_send(bool force) {
     // stats.nsend   = 0;
     // stats.nresend = 0;
 
+    snapshot_capture();
+    rate_update();
     queue_stats();
-    queue_updates();
+    queue_events_close(0);
 
     Client *c;
     clients_foreach(c) {
@@ -337,6 +571,11 @@ void protocol_send(bool force) {
             send_timeout(c);
             client_remove(c);
         }
+        else if(queue_backlog(c) > MAX_BACKLOG || c->lagging) {
+            /* does not keep up with the reliable messages */
+            send_timeout(c);
+            client_remove(c);
+        }
         else if (c->misbehavior > MISBEHAVIOR_LIMIT) {
             send_kick(c);
             send_timeout(c);
@@ -355,6 +594,9 @@ void protocol_send(bool force) {
         }
     }
 
+    conn_flush(&server->conn_clients);
+    counter_set(COUNTER_SYSCALLS, conn_syscalls(&server->conn_clients));
+
     // timer_stop(TIMER_SEND);
     // counter_set(COUNTER_SEND,   stats.nsend);
     // counter_set(COUNTER_RESEND, stats.nresend);
@@ -10,133 +10,395 @@
 #include "debug.h"
 #include "log.h"
 #include "message.h"
+#include "pack.h"
+#include "performance.h"
 #include "physics.h"
+#include "rtt.h"
 #include "server.h"
+#include "str.h"
 
 typedef struct QueuedMessage QueuedMessage;
-typedef struct PerClient     PerClient;
-
-struct PerClient {
+typedef struct Delivery      Delivery;
+
+/* Each queued message has one delivery per receiving client, which is
+ * kept in the queue of that client until the message has been sent or,
+ * if it is reliable, acknowledged. The memory therefore grows with the
+ * number of pending deliveries, not with the queue length times the
+ * number of clients.
+ *
+ * A burst of weapon fire adds, removes and collides dozens of entities
+ * in a single update. For clients of REVISION_EVENTS, these events are
+ * not queued one by one but appended to a batch, whose records are
+ * bit-packed once (see event_write): one batch of adds or removes per
+ * client, which is queued before any other reliable message of its
+ * channel to keep the order, and one batch of collisions for all of them. The batches are
+ * queued at the latest with the next update, or when they are full.
+ * Without memory for a batch, the events are queued one by one again.
+ */
+
+struct Delivery {
+    List _l;
+    List queue; /* of the client */
+    QueuedMessage *qm;
+    size_t channel; /* of a reliable message, see message_channel */
     size_t seqno;
     size_t tries;
     Clock last_tx_time;
+    bool fast; /* has been resent because later messages arrived */
 };
 
 struct QueuedMessage {
     List _l;
-    BitSet dest;
-    /* sequence numbers for each client */
-    PerClient perclient[MAX_CLIENTS];
+    size_t refs; /* number of deliveries */
     Message m;
 };
 
 static void qm_ctor(size_t i, void *p) {
     QueuedMessage *qm = (QueuedMessage*)p;
-    qm->dest = set_empty;
+    qm->refs = 0;
 }
 
-static void qm_dtor(size_t i, void *p) {}
+static void qm_dtor(size_t i, void *p) {
+    QueuedMessage *qm = (QueuedMessage*)p;
+    Str *s = message_str(&qm->m);
+    if(s) str_release(*s);
+    if(is_batched(&qm->m)) pool_free(&server->batches, qm->m.events.e);
+}
 
 static bool qm_check_obsolete(size_t i, void *p) {
     QueuedMessage *qm = (QueuedMessage*)p;
     /* only keep qm for receiving clients */
-    return set_disjoint(qm->dest, server->connected);
+    return qm->refs == 0;
 }
 
-static bool qm_check_dest(Client *c, QueuedMessage *qm) {
-    size_t id = c->player.id.n;
-    return set_contains(qm->dest, id);
+static void delivery_free(Delivery *d) {
+    list_del(&d->queue);
+    d->qm->refs --;
+    pool_free(&server->deliveries, d);
 }
 
-static void qm_set_dest(Client *c, QueuedMessage *qm) {
-    size_t id = c->player.id.n;
-    set_insert(qm->dest, id);
-}
-
-static void qm_clear_dest(Client *c, QueuedMessage *qm) {
-    size_t id = c->player.id.n;
-    set_remove(qm->dest, id);
-}
-
-#define qm_seqno(c,qm) qm->perclient[c->player.id.n].seqno
-#define qm_tries(c,qm) qm->perclient[c->player.id.n].tries
-#define qm_last_tx_time(c,qm) qm->perclient[c->player.id.n].last_tx_time
-
-static bool qm_check_relevant(Client *c, QueuedMessage *qm) {
-    /* message not for c */
-    if(!qm_check_dest(c, qm)) {
-        return false;
-    }
-
+static bool delivery_check_relevant(Client *c, Delivery *d) {
 	 /* unreliable message for c, do not resend */
-    if(!is_reliable(&qm->m)) {
-        qm_clear_dest(c, qm);
+    if(!is_reliable(&d->qm->m)) {
         return true;
     }
 
-    if(   qm_tries(c,qm) > 0
-       && qm_last_tx_time(c,qm) + RETRANSMIT_INTERVAL >= server->cur_clock)
-    {
+    /* reliable message for c, already acknowledged */
+    if(d->seqno <= c->channels[d->channel].last_in_ack) {
+        delivery_free(d);
         return false;
     }
-    else {
-        qm_last_tx_time(c,qm) = server->cur_clock;
-    }
 
-    /* reliable message for c, already acknowledged */
-    if(qm_seqno(c, qm) <= c->last_in_ack) {
-        qm_clear_dest(c, qm);
+    /* the world is transferred first, see transfer.c */
+    if(c->transfer)
+        return false;
+
+    if(   d->tries > 0
+       && d->last_tx_time + rtt_timeout(c, d->tries) >= server->cur_clock)
+    {
         return false;
     }
 
     /* reliable, unacknowledged message for c */
+    d->last_tx_time = server->cur_clock;
     return true;
 }
 
-static QueuedMessage *qm_create() {
+static QueuedMessage *qm_create(Message *m) {
     QueuedMessage *qm = pool_new(&server->queue, QueuedMessage);
+    Str *s;
+
+    /* unreliable messages may be lost anyway */
+    if(!qm && !is_reliable(m)) {
+        if(is_batched(m)) pool_free(&server->batches, m->events.e);
+        return 0;
+    }
     /*
 	if (!qm) {
 		queue_foreach(qm) {
-			log_debug("dest = %lx", qm->dest);
+			log_debug("refs = %d", (int)qm->refs);
 			debug_message(&qm->m, "");
 		}
 		assert(false);
 	}
     */
     assert(qm); /* TODO: handle allocation failure */
+    qm->m = *m;
+    counter_set(COUNTER_QUEUED, 1);
+
+    /* the string must outlive the tick in which it was received,
+     * names of players are already interned and are always kept
+     */
+    s = message_str(&qm->m);
+    if(s && !str_intern(s)) {
+        log_warn("Dropping message, too many strings.");
+        pool_free(&server->queue, qm);
+        return 0;
+    }
     return qm;
 }
 
+/* the remote client with the most unacknowledged messages */
+static Client *laggard() {
+    Client *c, *l = 0;
+    clients_foreach(c) {
+        if(!c->remote || c->dead || c->lagging)
+            continue;
+        if(!l || queue_backlog(c) > queue_backlog(l))
+            l = c;
+    }
+    return l;
+}
+
+/* c no longer receives anything and is dropped by protocol_send */
+static void lag(Client *c) {
+    log_warn("Dropping client %d, out of deliveries.", c->player.id.n);
+    c->lagging = true;
+    queue_forget(c);
+}
+
 static void qm_enqueue(Client *c, QueuedMessage *qm) {
-    qm_set_dest(c,qm);
+    Delivery *d;
+    Client *l;
+
+    /* removed clients and bots receive nothing */
+    if(!set_contains(server->connected, c->player.id.n) || c->lagging)
+        return;
+
+    /* the events that came first */
+    if(   c->events && is_reliable(&qm->m)
+       && message_channel(qm->m.type, c->rev) == CHANNEL_STATE)
+        queue_events_close(c);
+
+    d = pool_new(&server->deliveries, Delivery);
+
+    /* the deliveries are used up by clients that do not acknowledge,
+     * the one that lags most is dropped, as for MAX_BACKLOG
+     */
+    if(!d && is_reliable(&qm->m) && (l = laggard())) {
+        lag(l);
+        if(l != c)
+            d = pool_new(&server->deliveries, Delivery);
+        if(!d && c->remote && !c->lagging)
+            lag(c);
+    }
+    if(!d)
+        return;
+
+    d->qm = qm;
+    qm->refs ++;
+    list_add_tail(&d->queue, &c->queue);
 
     if(is_reliable(&qm->m)) {
-        qm_seqno(c,qm) = (c->next_out_reliable_seqno ++);
+        d->channel = message_channel(qm->m.type, c->rev);
+        d->seqno = (c->channels[d->channel].next_out ++);
     }
 	else {
-		qm_seqno(c,qm) = (c->next_out_unreliable_seqno ++);
+		d->seqno = (c->next_out_unreliable_seqno ++);
 	}
 
-    qm_last_tx_time(c,qm) = 0;
-	qm_tries(c,qm) = 0;
+    d->last_tx_time = 0;
+	d->tries = 0;
+    d->fast = false;
 }
 
 void queue_unicast(Client *c, Message *m) {
-    QueuedMessage *qm = qm_create();
-    qm->m = *m;
+    QueuedMessage *qm = qm_create(m);
+    if(!qm) return;
     qm_enqueue(c,qm);
 }
 
 void queue_broadcast(Message *m) {
-    QueuedMessage *qm = qm_create();
-    qm->m = *m;
+    QueuedMessage *qm = qm_create(m);
+    if(!qm) return;
 
     Client *c;
     clients_foreach(c)
         qm_enqueue(c,qm);
 }
 
+void queue_multicast(Message *m, bool (*dest)(Client *c, void *p), void *p) {
+    QueuedMessage *qm = qm_create(m);
+    if(!qm) return;
+
+    Client *c;
+    clients_foreach(c) {
+        if(dest(c,p))
+            qm_enqueue(c,qm);
+    }
+}
+
+static Events *batch_open(MessageType type) {
+    Events *e = pool_new(&server->batches, Events);
+    if(!e) return 0;
+    e->type = message_batched(type);
+    e->n    = 0;
+    e->prev = 0;
+    bits_init(&e->b, e->s, sizeof(e->s));
+    return e;
+}
+
+/* append the record of m to e, false if it does not fit */
+static bool batch_put(Events *e, Message *m) {
+    size_t   mark = e->b.pos;
+    uint16_t prev = e->prev;
+
+    if(e->type != message_batched(m->type) || e->n == UINT8_MAX)
+        return false;
+
+    event_write(&e->b, m, &e->prev);
+    if(e->b.overflow) {
+        e->b.pos      = mark;
+        e->b.overflow = false;
+        e->prev       = prev;
+        return false;
+    }
+    e->n ++;
+    return true;
+}
+
+/* append m to the open batch of c, or of the collisions if c is 0,
+ * false if there is no memory for a new batch
+ */
+static bool batch_event(Client *c, Message *m) {
+    Events **e = c ? &c->events : &server->batch;
+
+    if(*e && !batch_put(*e, m))
+        queue_events_close(c);
+    if(!*e && !(*e = batch_open(m->type)))
+        return false;
+    return batch_put(*e, m);
+}
+
+static bool batches(Client *c, void *p) {
+    return    c->rev >= REVISION_EVENTS
+           && set_contains(server->connected, c->player.id.n);
+}
+
+static bool singles(Client *c, void *p) {
+    return    c->rev < REVISION_EVENTS
+           && set_contains(server->connected, c->player.id.n);
+}
+
+void queue_event(Client *c, Message *m) {
+    counter_set(COUNTER_EVENTS, 1);
+    if(!batches(c, 0) || !batch_event(c, m))
+        queue_unicast(c, m);
+}
+
+void queue_event_multicast(Message *m, bool (*dest)(Client *c, void *p), void *p) {
+    QueuedMessage *qm = 0;
+    Client *c;
+
+    counter_set(COUNTER_EVENTS, 1);
+    clients_foreach(c) {
+        if(!dest(c,p))
+            continue;
+        if(batches(c, 0) && batch_event(c, m))
+            continue;
+        if(!qm && !(qm = qm_create(m)))
+            return;
+        qm_enqueue(c,qm);
+    }
+}
+
+/* the batch of collisions is shared by all clients of REVISION_EVENTS */
+void queue_event_broadcast(Message *m) {
+    Client *c;
+
+    counter_set(COUNTER_EVENTS, 1);
+    clients_foreach(c) {
+        if(singles(c, 0)) {
+            queue_multicast(m, singles, 0);
+            break;
+        }
+    }
+
+    clients_foreach(c) {
+        if(batches(c, 0)) {
+            if(!batch_event(0, m))
+                queue_multicast(m, batches, 0);
+            break;
+        }
+    }
+}
+
+void queue_events_close(Client *c) {
+    Events **e = c ? &c->events : &server->batch;
+    Message m;
+
+    if(!*e) return;
+
+    m.type     = (*e)->type;
+    m.seqno    = 0;
+    m.events.n = (*e)->n;
+    m.events.e = *e;
+    *e = 0;
+
+    if(c) queue_unicast(c, &m);
+    else  queue_multicast(&m, batches, 0);
+}
+
+void queue_forget(Client *c) {
+    Delivery *d, *n;
+    list_for_each_entry_safe(d, Delivery, n, &c->queue, queue)
+        delivery_free(d);
+
+    if(c->events) {
+        pool_free(&server->batches, c->events);
+        c->events = 0;
+    }
+}
+
+/* number of set bits in mask */
+static size_t count_bits(uint32_t mask) {
+    size_t n = 0;
+    for(; mask; mask &= mask - 1)
+        n ++;
+    return n;
+}
+
+/* Clients acknowledge all reliable messages up to ack, and those of
+ * revision REVISION_SACK additionally the ones after a gap, where bit i of
+ * mask stands for seqno ack+2+i.
+ */
+static bool sack_contains(size_t ack, uint32_t mask, size_t seqno) {
+    if(seqno <= ack)
+        return true;
+    return seqno >= ack + 2 && seqno - ack - 2 < 32 && ((mask >> (seqno - ack - 2)) & 1);
+}
+
+/* number of acknowledged messages after the missing one */
+static size_t sack_later(size_t ack, uint32_t mask, size_t seqno) {
+    size_t i = seqno - ack - 1; /* bit of seqno+1 */
+    return i < 32 ? count_bits(mask >> i) : 0;
+}
+
+/* Messages that were sent only once give a sample of the round-trip time.
+ * A message that is still missing while FAST_RETRANSMIT later ones of its
+ * channel have arrived is resent with the next update instead of after
+ * the timeout.
+ */
+void queue_ack(Client *c, size_t channel, size_t ack, uint32_t mask) {
+    Delivery *d, *n;
+
+    list_for_each_entry_safe(d, Delivery, n, &c->queue, queue) {
+        if(!is_reliable(&d->qm->m) || !d->tries || d->channel != channel)
+            continue;
+
+        if(sack_contains(ack, mask, d->seqno)) {
+            if(d->tries == 1)
+                rtt_sample(c, server->cur_clock - d->last_tx_time);
+            delivery_free(d);
+        }
+        else if(   !d->fast
+                && sack_later(ack, mask, d->seqno) >= FAST_RETRANSMIT)
+        {
+            d->fast = true;
+            d->last_tx_time = 0;
+        }
+    }
+}
 
 /*
 void queue_timeout(Client *c) {
@@ -151,30 +413,49 @@ void queue_timeout(Client *c) {
 */
 
 Message *queue_next(cr_t *state, Client *c, size_t *tries) {
-    static QueuedMessage *qm;
+    static Delivery *d, *n;
 
     cr_begin(state);
 
-    queue_foreach(qm) {
-        if(!qm_check_relevant(c, qm))
+    list_for_each_entry_safe(d, Delivery, n, &c->queue, queue) {
+        if(!delivery_check_relevant(c, d))
             continue;
 
         if(tries)
-            *tries = qm_tries(c,qm);
+            *tries = d->tries;
+
+        d->qm->m.seqno = d->seqno;
+        cr_yield(state,&d->qm->m);
 
-        qm->m.seqno = qm_seqno(c,qm);
-        cr_yield(state,&qm->m);
+        d->tries ++;
 
-        qm_tries(c,qm) ++;
+        /* unreliable messages are sent only once */
+        if(!is_reliable(&d->qm->m))
+            delivery_free(d);
     }
 
     cr_return(state,0);
 }
 
+size_t queue_backlog(Client *c) {
+    size_t j, n = 0;
+    for(j=0; j<CHANNELS; j++)
+        n += c->channels[j].next_out - 1 - c->channels[j].last_in_ack;
+    return n;
+}
+
+bool queue_room(size_t n) {
+    return pool_nused(&server->queue) + n <= MAX_QUEUE
+        && pool_nused(&server->deliveries) + n + MAX_CLIENTS <= MAX_DELIVERIES;
+}
+
 /* TODO: these two functions do not really belong here */
 void queue_init() {
     INIT_LIST_HEAD(&server->formats);
     pool_dynamic(&server->queue, QueuedMessage, MAX_QUEUE, qm_ctor, qm_dtor);
+    pool_dynamic(&server->deliveries, Delivery, MAX_DELIVERIES, 0, 0);
+    pool_dynamic(&server->batches, Events, MAX_BATCHES, 0, 0);
+    server->batch = 0;
 }
 
 void queue_cleanup() {
@@ -183,4 +464,6 @@ void queue_cleanup() {
 
 void queue_shutdown() {
     pool_shutdown(&server->queue);
+    pool_shutdown(&server->deliveries);
+    pool_shutdown(&server->batches);
 }
@@ -1,12 +1,39 @@
 #ifndef QUEUE_H
 #define QUEUE_H
 
+#include <stdint.h>
+
 void queue_init();
 void queue_cleanup();
 void queue_shutdown();
 
 void queue_broadcast(Message *m);
 void queue_unicast(Client *c, Message *m);
+void queue_multicast(Message *m, bool (*dest)(Client *c, void *p), void *p);
+
+/* an Add, Remove or Collision message, which is batched with the others
+ * of the same update for clients of REVISION_EVENTS
+ */
+void queue_event(Client *c, Message *m);
+void queue_event_broadcast(Message *m);
+void queue_event_multicast(Message *m, bool (*dest)(Client *c, void *p), void *p);
+
+/* queue the open batch of c, or that of the collisions if c is 0 */
+void queue_events_close(Client *c);
+
+/* whether n more messages fit into the queue */
+bool queue_room(size_t n);
+
+/* number of reliable messages that c has not acknowledged */
+size_t queue_backlog(Client *c);
+
+/* drop all messages to c */
+void queue_forget(Client *c);
+
+/* the client has received the reliable messages of channel up to ack
+ * and those in mask
+ */
+void queue_ack(Client *c, size_t channel, size_t ack, uint32_t mask);
 
 #include "coroutine.h"
 Message *queue_next(cr_t *state, Client *c, size_t *tries);
@@ -0,0 +1,90 @@
+#include "types.h"
+
+#include "rate.h"
+
+#include "config.h"
+#include "id.h"
+#include "server.h"
+#include "update.h"
+
+#include <string.h>
+
+/* Stats and updates are sent periodically, but not every class needs the
+ * full update rate: each update format has an interval of its own (see
+ * rules.c), and the Stats messages are sent about twice per second, and
+ * then only the pages that changed. Unchanged pages are still resent
+ * every STATS_REFRESH, since they are unreliable, and all of them are sent
+ * when a client joins. The intervals are measured in time rather than in
+ * updates, so they hold however often the server is updated.
+ */
+
+void rate_init() {
+    Rates *r = &server->rates;
+    memset(r, 0, sizeof(Rates));
+    r->stats.interval   = STATS_INTERVAL;
+    r->refresh.interval = STATS_REFRESH;
+}
+
+static void rate_check(Rate *r) {
+    Clock now = server->cur_clock;
+
+    /* updates are not exactly periodic, they may come half an interval early */
+    r->due = now + UPDATE_INTERVAL / 2 >= r->next;
+    if(!r->due)
+        return;
+
+    /* keep the phase, unless updates have been missed */
+    if(r->next + r->interval <= now)
+        r->next = now + r->interval;
+    else
+        r->next += r->interval;
+}
+
+void rate_update() {
+    Rates *r = &server->rates;
+    Format *f;
+
+    formats_foreach(f)
+        rate_check(&f->rate);
+
+    rate_check(&r->stats);
+    if(r->stats.due) {
+        rate_check(&r->refresh);
+        r->refresh.due |= r->reset;
+        r->reset = false;
+    }
+}
+
+/* pings only change by more than STATS_PING, the other fields exactly */
+static bool stats_changed(Message *m0, Message *m1) {
+    size_t i;
+
+    if(m0->stats.n != m1->stats.n)
+        return true;
+
+    for(i=0; i<m0->stats.n; i++) {
+        int dping = (int)m0->stats.info[i].ping - (int)m1->stats.info[i].ping;
+        if(   !id_eq(m0->stats.info[i].player_id, m1->stats.info[i].player_id)
+           || m0->stats.info[i].kills  != m1->stats.info[i].kills
+           || m0->stats.info[i].deaths != m1->stats.info[i].deaths
+           || dping > STATS_PING || dping < -STATS_PING)
+            return true;
+    }
+    return false;
+}
+
+bool rate_stats_page(Message *m, size_t page) {
+    Rates *r = &server->rates;
+
+    if(page >= STATS_PAGES)
+        return true;
+    if(!r->refresh.due && !stats_changed(&r->sent[page], m))
+        return false;
+
+    r->sent[page] = *m;
+    return true;
+}
+
+void rate_stats_reset() {
+    server->rates.reset = true;
+}
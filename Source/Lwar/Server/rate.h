@@ -0,0 +1,35 @@
+#ifndef RATE_H
+#define RATE_H
+
+#include "clock.h"
+#include "config.h"
+#include "message.h"
+#include "types.h"
+
+/* a class of periodic messages, which is sent at most every interval */
+struct Rate {
+    Clock interval; /* ms, 0 for every update */
+    Clock next;     /* time at which the next message is due */
+    bool  due;      /* in the current update */
+};
+
+/* the classes that are not update formats */
+struct Rates {
+    Rate    stats;
+    Rate    refresh;           /* of the Stats pages that did not change */
+    bool    reset;             /* all pages are sent with the next stats */
+    Message sent[STATS_PAGES]; /* the Stats pages that were sent last */
+};
+
+void rate_init();
+
+/* decide which classes are due, once per update */
+void rate_update();
+
+/* whether page of the stats has to be sent, if they are due */
+bool rate_stats_page(Message *m, size_t page);
+
+/* send all pages with the next stats, e.g. to a joining client */
+void rate_stats_reset();
+
+#endif
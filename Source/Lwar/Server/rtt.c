@@ -0,0 +1,46 @@
+#include "types.h"
+
+#include "rtt.h"
+
+#include "client.h"
+#include "config.h"
+
+/* Retransmission timeouts as in RFC 6298: the smoothed round-trip time
+ * and its deviation are updated from every acknowledged message that has
+ * been sent exactly once, and the timeout leaves room for four times the
+ * deviation but at least one update interval, because messages are only
+ * sent that often. Every retransmission of the same message doubles the
+ * timeout, up to RETRANSMIT_BACKOFF times.
+ */
+
+void rtt_reset(Client *c) {
+    c->rtt.srtt   = 0;
+    c->rtt.rttvar = 0;
+    c->rtt.min    = 0;
+    c->rtt.rto    = RETRANSMIT_INTERVAL;
+}
+
+void rtt_sample(Client *c, Clock r) {
+    Clock d;
+
+    if(!c->rtt.min || r < c->rtt.min)
+        c->rtt.min = max(r, (Clock)1);
+
+    if(!c->rtt.srtt) {
+        c->rtt.srtt   = max(r, (Clock)1);
+        c->rtt.rttvar = r / 2;
+    } else {
+        d = r > c->rtt.srtt ? r - c->rtt.srtt : c->rtt.srtt - r;
+        c->rtt.rttvar = (3 * c->rtt.rttvar + d) / 4;
+        c->rtt.srtt   = max((7 * c->rtt.srtt + r) / 8, (Clock)1);
+    }
+
+    c->rtt.rto = c->rtt.srtt + max(4 * c->rtt.rttvar, (Clock)UPDATE_INTERVAL);
+    c->rtt.rto = max(min(c->rtt.rto, (Clock)MAX_RETRANSMIT_INTERVAL), (Clock)MIN_RETRANSMIT_INTERVAL);
+    c->ping    = c->rtt.srtt;
+}
+
+Clock rtt_timeout(Client *c, size_t tries) {
+    size_t n = tries > 0 ? min(tries - 1, (size_t)RETRANSMIT_BACKOFF) : 0;
+    return min(c->rtt.rto << n, (Clock)MAX_RETRANSMIT_INTERVAL);
+}
@@ -0,0 +1,23 @@
+#ifndef RTT_H
+#define RTT_H
+
+#include "clock.h"
+#include "types.h"
+
+/* round-trip time of a client */
+struct Rtt {
+    Clock srtt;   /* smoothed round-trip time, 0 before the first sample */
+    Clock rttvar; /* its mean deviation */
+    Clock min;    /* smallest sample, 0 before the first sample */
+    Clock rto;    /* retransmission timeout */
+};
+
+void rtt_reset(Client *c);
+
+/* a message that was sent once has been acknowledged after r ms */
+void rtt_sample(Client *c, Clock r);
+
+/* time to wait before resending a message that was sent tries times */
+Clock rtt_timeout(Client *c, size_t tries);
+
+#endif
@@ -73,11 +73,12 @@ void rules_init() {
     server->self = client_create_local();
     player_rename(&server->self->player, self_name);
 
-    format_register(&format_ship);
-    format_register(&format_pos);
-    format_register(&format_pos_rot);
-    format_register(&format_ray);
-    format_register(&format_circle);
+    format_register(&format_ship,    SHIP_INTERVAL);
+    format_register(&format_pos,     POS_INTERVAL);
+    format_register(&format_pos_rot, POS_INTERVAL);
+    format_register(&format_body,    BODY_INTERVAL);
+    format_register(&format_ray,     RAY_INTERVAL);
+    format_register(&format_circle,  CIRCLE_INTERVAL);
 
     /* register some entity types */
     templates_register();
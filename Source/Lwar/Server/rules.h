@@ -2,6 +2,7 @@
 // extern Format     format_message;
 extern Format     format_ship;
 extern Format     format_pos;
+extern Format     format_body;
 extern Format     format_pos_rot;
 extern Format     format_ray;
 extern Format     format_circle;
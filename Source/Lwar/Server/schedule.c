@@ -0,0 +1,143 @@
+#include "types.h"
+
+#include "schedule.h"
+
+#include "client.h"
+#include "entity.h"
+#include "interest.h"
+#include "pack.h"
+#include "server.h"
+#include "snapshot.h"
+#include "vector.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Each entity that a client knows about and that has to be sent accumulates
+ * priority in every update in which it is not sent. The entities are then
+ * sent in order of decreasing priority until the budget of the client is
+ * exhausted, after which the priority of the sent entities is reset.
+ * The weights favor the client's own entities, entities close to its ship,
+ * fast entities, and entities that have been hit recently.
+ */
+
+static const Real weight_base     = 1;
+static const Real weight_own      = 8;
+static const Real weight_near     = 4;    /* at distance 0, decreasing linearly to the interest radius */
+static const Real weight_speed    = 1.0f / 500;
+static const Real weight_hit      = 4;
+static const Clock hit_duration   = 1000; /* ms */
+
+typedef struct Candidate Candidate;
+struct Candidate {
+    Entity *e;
+    Real    priority;
+    size_t  len;
+};
+
+static Candidate candidates[MAX_ENTITIES];
+
+#define selected_word(c,n) (c)->schedule.selected[(n) / 32]
+#define selected_bit(n)    ((uint32_t)1 << ((n) % 32))
+
+static Real weight(Client *c, Entity *e) {
+    Real w = weight_base;
+    Real d = len(sub(e->x, c->view));
+
+    if(e->player == &c->player)
+        w += weight_own;
+    if(d < INTEREST_RADIUS)
+        w += weight_near * (1 - d / INTEREST_RADIUS);
+    w += weight_speed * len(e->v);
+    if(e->hit && e->hit + hit_duration > server->cur_clock)
+        w += weight_hit;
+
+    return w;
+}
+
+/* size of the update record of e for c, 0 if there is nothing to send */
+static size_t record_len(Client *c, Entity *e) {
+    char s[64];
+    Delta d;
+    BitStream b;
+    uint16_t prev;
+
+    if(c->rev < REVISION_DELTA)
+        return e->type->format->len;
+    if(!snapshot_delta(c, e, &d))
+        return 0;
+    if(c->rev < REVISION_BITPACK)
+        return delta_pack(s, &d);
+
+    /* assume consecutive ids, which is the common case */
+    prev = e->id.n;
+    bits_init(&b, s, sizeof(s));
+    delta_write(&b, &d, &prev);
+    return bits_bytes(&b);
+}
+
+static int candidate_cmp(const void *p0, const void *p1) {
+    const Candidate *c0 = (const Candidate*)p0;
+    const Candidate *c1 = (const Candidate*)p1;
+    if(c0->priority > c1->priority) return -1;
+    if(c0->priority < c1->priority) return  1;
+    return 0;
+}
+
+void schedule_reset(Client *c) {
+    memset(&c->schedule, 0, sizeof(Schedule));
+    c->schedule.budget = UPDATE_BUDGET;
+}
+
+void schedule_forget(Client *c, Entity *e) {
+    c->schedule.priority[e->id.n] = 0;
+}
+
+void schedule_update(Client *c) {
+    Format *f;
+    Entity *e;
+    size_t i, n = 0, used = 0;
+
+    memset(c->schedule.selected, 0, sizeof(c->schedule.selected));
+
+    /* formats that are not due wait, without gaining priority */
+    formats_foreach(f) {
+        if(!f->rate.due)
+            continue;
+        updates_foreach(f,e) {
+            Candidate *k;
+            size_t len;
+
+            if(!interest_contains(c, e))
+                continue;
+            len = record_len(c, e);
+            if(!len) {
+                schedule_forget(c, e);
+                continue;
+            }
+
+            c->schedule.priority[e->id.n] += weight(c, e);
+
+            k = &candidates[n++];
+            k->e        = e;
+            k->priority = c->schedule.priority[e->id.n];
+            k->len      = len;
+        }
+    }
+
+    qsort(candidates, n, sizeof(Candidate), candidate_cmp);
+
+    /* skip records that do not fit, smaller ones may still do */
+    for(i=0; i<n; i++) {
+        Candidate *k = &candidates[i];
+        if(used + k->len > c->schedule.budget)
+            continue;
+        used += k->len;
+        selected_word(c,k->e->id.n) |= selected_bit(k->e->id.n);
+        schedule_forget(c, k->e);
+    }
+}
+
+bool schedule_contains(Client *c, Entity *e) {
+    return (selected_word(c,e->id.n) & selected_bit(e->id.n)) != 0;
+}
@@ -0,0 +1,25 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "real.h"
+#include "types.h"
+
+/* per-client state of the update scheduler */
+struct Schedule {
+    size_t   budget;                        /* bytes of update records per update */
+    Real     priority[MAX_ENTITIES];        /* accumulated while an entity is not sent */
+    uint32_t selected[MAX_ENTITIES / 32];   /* entities to send in the current update */
+};
+
+void schedule_reset(Client *c);
+void schedule_forget(Client *c, Entity *e);
+
+/* select the entities with the highest priority that fit into the budget of c */
+void schedule_update(Client *c);
+
+bool schedule_contains(Client *c, Entity *e);
+
+#endif
@@ -0,0 +1,292 @@
+/* Wire format of all messages and update records, see network.txt.
+ *
+ * This file has no include guard. It is included several times with
+ * different definitions of the following macros, which generates the
+ * message codec in pack.c and unpack.c and the lengths in message.h:
+ *
+ *   MESSAGE(T, name)           message MESSAGE_T, stored in m->name
+ *   FIELD(name, type, f)       field m->name.f
+ *   ARRAY(name, n, a, max)     array m->name.a of m->name.n elements, at most max
+ *   ITEM(name, a, type, f)     field m->name.a[j].f of the array elements
+ *   ARRAY_END(name, a)
+ *   MESSAGE_END(T, name)
+ *
+ *   RECORD(T)                  update record of message MESSAGE_T
+ *   COLUMN(type, f)            field of an update record
+ *   RECORD_END(T)
+ *
+ * The types are uint8, uint16, uint32, int16, id, enum8 (an enum that is
+ * sent as uint8), str (a uint8 length followed by the characters) and pad
+ * (a uint16 length followed by as many zero bytes, stored as the length).
+ * Array elements and update records must have a fixed length.
+ * Macros that are not defined by the includer are ignored.
+ */
+
+#ifndef MESSAGE
+#define MESSAGE(T, name)
+#endif
+#ifndef FIELD
+#define FIELD(name, type, f)
+#endif
+#ifndef ARRAY
+#define ARRAY(name, n, a, max)
+#endif
+#ifndef ITEM
+#define ITEM(name, a, type, f)
+#endif
+#ifndef ARRAY_END
+#define ARRAY_END(name, a)
+#endif
+#ifndef MESSAGE_END
+#define MESSAGE_END(T, name)
+#endif
+#ifndef RECORD
+#define RECORD(T)
+#endif
+#ifndef COLUMN
+#define COLUMN(type, f)
+#endif
+#ifndef RECORD_END
+#define RECORD_END(T)
+#endif
+
+/* reliable messages */
+
+MESSAGE(CONNECT, connect)
+    FIELD(connect, uint8, rev)
+    FIELD(connect, str,   nick)
+MESSAGE_END(CONNECT, connect)
+
+MESSAGE(JOIN, join)
+    FIELD(join, id,  player_id)
+    FIELD(join, str, nick)
+MESSAGE_END(JOIN, join)
+
+MESSAGE(LEAVE, leave)
+    FIELD(leave, id,    player_id)
+    FIELD(leave, enum8, reason)
+MESSAGE_END(LEAVE, leave)
+
+MESSAGE(CHAT, chat)
+    FIELD(chat, id,  player_id)
+    FIELD(chat, str, msg)
+MESSAGE_END(CHAT, chat)
+
+MESSAGE(ADD, add)
+    FIELD(add, id,    entity_id)
+    FIELD(add, id,    player_id)
+    FIELD(add, id,    parent_id)
+    FIELD(add, uint8, type_id)
+MESSAGE_END(ADD, add)
+
+MESSAGE(REMOVE, remove)
+    FIELD(remove, id, entity_id)
+MESSAGE_END(REMOVE, remove)
+
+MESSAGE(SELECTION, selection)
+    FIELD(selection, id,    player_id)
+    FIELD(selection, uint8, ship_type)
+    FIELD(selection, uint8, weapon_type1)
+    FIELD(selection, uint8, weapon_type2)
+    FIELD(selection, uint8, weapon_type3)
+    FIELD(selection, uint8, weapon_type4)
+MESSAGE_END(SELECTION, selection)
+
+MESSAGE(NAME, name)
+    FIELD(name, id,  player_id)
+    FIELD(name, str, nick)
+MESSAGE_END(NAME, name)
+
+MESSAGE(SYNCED, synced)
+    FIELD(synced, id, player_id)
+MESSAGE_END(SYNCED, synced)
+
+MESSAGE(KILL, kill)
+    FIELD(kill, id, killer_id)
+    FIELD(kill, id, victim_id)
+MESSAGE_END(KILL, kill)
+
+MESSAGE(MTU, mtu)
+    FIELD(mtu, uint16, size)
+MESSAGE_END(MTU, mtu)
+
+/* the bit-packed records follow the message, see stream.c */
+MESSAGE(ADDS, events)
+    FIELD(events, uint8, n)
+MESSAGE_END(ADDS, events)
+
+MESSAGE(REMOVES, events)
+    FIELD(events, uint8, n)
+MESSAGE_END(REMOVES, events)
+
+/* unreliable messages */
+
+MESSAGE(STATS, stats)
+    ARRAY(stats, n, info, MAX_STATS)
+        ITEM(stats, info, id,     player_id)
+        ITEM(stats, info, uint16, kills)
+        ITEM(stats, info, uint16, deaths)
+        ITEM(stats, info, uint16, ping)
+    ARRAY_END(stats, info)
+MESSAGE_END(STATS, stats)
+
+MESSAGE(INPUT, input)
+    FIELD(input, id,     player_id)
+    FIELD(input, uint32, frameno)
+    FIELD(input, uint8,  forwards)
+    FIELD(input, uint8,  backwards)
+    FIELD(input, uint8,  turn_left)
+    FIELD(input, uint8,  turn_right)
+    FIELD(input, uint8,  strafe_left)
+    FIELD(input, uint8,  strafe_right)
+    FIELD(input, uint8,  after_burner)
+    FIELD(input, uint8,  fire1)
+    FIELD(input, uint8,  fire2)
+    FIELD(input, uint8,  fire3)
+    FIELD(input, uint8,  fire4)
+    FIELD(input, int16,  aim_x)
+    FIELD(input, int16,  aim_y)
+MESSAGE_END(INPUT, input)
+
+MESSAGE(COLLISION, collision)
+    FIELD(collision, id,    entity_id[0])
+    FIELD(collision, id,    entity_id[1])
+    FIELD(collision, int16, x)
+    FIELD(collision, int16, y)
+MESSAGE_END(COLLISION, collision)
+
+MESSAGE(DISCONNECT, disconnect)
+MESSAGE_END(DISCONNECT, disconnect)
+
+MESSAGE(REJECT, reject)
+    FIELD(reject, enum8, reason)
+MESSAGE_END(REJECT, reject)
+
+MESSAGE(DELTA_ACK, delta_ack)
+    FIELD(delta_ack, uint32, snapshot)
+MESSAGE_END(DELTA_ACK, delta_ack)
+
+MESSAGE(MTU_ACK, mtu_ack)
+    FIELD(mtu_ack, uint16, size)
+MESSAGE_END(MTU_ACK, mtu_ack)
+
+MESSAGE(MTU_PROBE, mtu_probe)
+    FIELD(mtu_probe, uint16, size)
+    FIELD(mtu_probe, pad,    pad)
+MESSAGE_END(MTU_PROBE, mtu_probe)
+
+MESSAGE(SACK, sack)
+    FIELD(sack, uint32, ack)
+    FIELD(sack, uint32, mask)
+MESSAGE_END(SACK, sack)
+
+MESSAGE(COOKIE, cookie)
+    FIELD(cookie, uint32, value)
+MESSAGE_END(COOKIE, cookie)
+
+MESSAGE(RELAY, relay)
+MESSAGE_END(RELAY, relay)
+
+MESSAGE(COLLISIONS, events)
+    FIELD(events, uint8, n)
+MESSAGE_END(COLLISIONS, events)
+
+MESSAGE(CHANNEL_ACK, channel_ack)
+    FIELD(channel_ack, uint8, channel)
+    FIELD(channel_ack, uint32, ack)
+    FIELD(channel_ack, uint32, mask)
+MESSAGE_END(CHANNEL_ACK, channel_ack)
+
+/* the bytes of the chunk follow the message, see stream.c */
+MESSAGE(CHUNK, chunk)
+    FIELD(chunk, uint16, index)
+    FIELD(chunk, uint16, count)
+    FIELD(chunk, uint16, len)
+MESSAGE_END(CHUNK, chunk)
+
+MESSAGE(CHUNK_ACK, chunk_ack)
+    FIELD(chunk_ack, uint16, next)
+    FIELD(chunk_ack, uint32, mask)
+MESSAGE_END(CHUNK_ACK, chunk_ack)
+
+/* the records follow the message, see stream.c */
+MESSAGE(UPDATE, update)
+    FIELD(update, uint8, n)
+MESSAGE_END(UPDATE, update)
+
+MESSAGE(UPDATE_POS, update)
+    FIELD(update, uint8, n)
+MESSAGE_END(UPDATE_POS, update)
+
+MESSAGE(UPDATE_RAY, update)
+    FIELD(update, uint8, n)
+MESSAGE_END(UPDATE_RAY, update)
+
+MESSAGE(UPDATE_CIRCLE, update)
+    FIELD(update, uint8, n)
+MESSAGE_END(UPDATE_CIRCLE, update)
+
+MESSAGE(UPDATE_SHIP, update)
+    FIELD(update, uint8, n)
+MESSAGE_END(UPDATE_SHIP, update)
+
+MESSAGE(DELTA, delta)
+    FIELD(delta, uint32, snapshot)
+    FIELD(delta, uint8,  part)
+    FIELD(delta, uint8,  format)
+    FIELD(delta, uint8,  n)
+MESSAGE_END(DELTA, delta)
+
+/* update records, packed from the entity by update_*_pack */
+
+RECORD(UPDATE)
+    COLUMN(id,     entity_id)
+    COLUMN(int16,  x)
+    COLUMN(int16,  y)
+    COLUMN(uint16, orientation)
+RECORD_END(UPDATE)
+
+RECORD(UPDATE_POS)
+    COLUMN(id,     entity_id)
+    COLUMN(int16,  x)
+    COLUMN(int16,  y)
+RECORD_END(UPDATE_POS)
+
+RECORD(UPDATE_RAY)
+    COLUMN(id,     entity_id)
+    COLUMN(int16,  x)
+    COLUMN(int16,  y)
+    COLUMN(uint16, orientation)
+    COLUMN(uint16, length)
+    COLUMN(id,     target_id)
+RECORD_END(UPDATE_RAY)
+
+RECORD(UPDATE_CIRCLE)
+    COLUMN(id,     entity_id)
+    COLUMN(int16,  x)
+    COLUMN(int16,  y)
+    COLUMN(uint16, radius)
+RECORD_END(UPDATE_CIRCLE)
+
+RECORD(UPDATE_SHIP)
+    COLUMN(id,     entity_id)
+    COLUMN(int16,  x)
+    COLUMN(int16,  y)
+    COLUMN(uint16, orientation)
+    COLUMN(uint8,  health)
+    COLUMN(uint8,  shield)
+    COLUMN(uint8,  energy1)
+    COLUMN(uint8,  energy2)
+    COLUMN(uint8,  energy3)
+    COLUMN(uint8,  energy4)
+RECORD_END(UPDATE_SHIP)
+
+#undef MESSAGE
+#undef FIELD
+#undef ARRAY
+#undef ITEM
+#undef ARRAY_END
+#undef MESSAGE_END
+#undef RECORD
+#undef COLUMN
+#undef RECORD_END
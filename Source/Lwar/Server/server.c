@@ -3,15 +3,26 @@
 #include "server_export.h"
 #include "server.h"
 
+#include "batch.h"
 #include "debug.h"
 #include "log.h"
 #include "rules.h"
 #include "physics.h"
 #include "protocol.h"
 #include "entity.h"
+#include "ingress.h"
+#include "jitter.h"
+#include "latency.h"
+#include "local.h"
+#include "netem.h"
 #include "client.h"
 #include "queue.h"
+#include "rate.h"
 #include "packet.h"
+#include "shard.h"
+#include "snapshot.h"
+#include "str.h"
+#include "transfer.h"
 
 #include <stdint.h>
 #include <string.h>
@@ -20,16 +31,70 @@ static Server _server;
 
 Server *server=&_server;
 
+static int io_uring; /* see server_io_uring */
+static char emulation[256]; /* see server_emulate */
+static uint8_t revision = CLIENT_REVISION; /* see server_revision */
+static Clock host_clock; /* latest clock passed by the host */
+
+void server_io_uring(int enable) {
+    io_uring = enable;
+}
+
+int server_emulate(const char *spec) {
+    NetemConfig cfg;
+    if(!netem_parse(&cfg, spec) || strlen(spec) >= sizeof(emulation))
+        return 0;
+    strcpy(emulation, spec);
+    return 1;
+}
+
+int server_relay(const char *ip) {
+    return ingress_relay_allow(ip);
+}
+
+int server_revision(unsigned int rev) {
+    if(rev < MIN_REVISION || rev > NETWORK_REVISION)
+        return 0;
+    revision = (uint8_t)rev;
+    return 1;
+}
+
 int server_init(unsigned short port) {
+    return server_init_sharded(port, 1);
+}
+
+int server_init_sharded(unsigned short port, unsigned int shards) {
     /* initialize static server struct */
     memset(server, 0, sizeof(Server));
     memset(assert_handler, 0, sizeof(jmp_buf));
+    host_clock = 0;
+    server->revision = revision;
+
+    ingress_init();
+    rate_init();
 
     if(!conn_init(&server->conn_clients)) return 0;
-    if(!conn_bind(&server->conn_clients, port)) return 0;
+    if(!shards_init(&server->conn_clients, shards, port)) return 0;
+
+    /* the shards receive on the socket of the server */
+    if(io_uring && !shards_active() && conn_uring(&server->conn_clients))
+        log_info("Using io_uring.");
+
+    /* the shards receive on sockets of their own */
+    if(emulation[0]) {
+        if(!shards_active() && conn_emulate(&server->conn_clients, emulation))
+            log_info("Emulating network conditions %s.", emulation);
+        else
+            log_warn("Network emulation is not supported with shards.");
+    }
 
+    arena_dynamic(&server->scratch, MAX_SCRATCH);
+    str_init();
     queue_init();
+    transfer_init();
     physics_init();
+    snapshots_init();
+    log_info("Packing update records with %s.", batch_name(batch_selected()));
 
     entities_init();
     clients_init();
@@ -57,6 +122,8 @@ static void server_update_internal(Clock time, int force) {
     */
 
     protocol_recv();
+    jitters_update();
+    latencies_update();
 
     players_update();
     entities_update();
@@ -78,6 +145,7 @@ int server_update(Clock time, int force) {
     if(!server->running)
         return 0;
 
+    host_clock = max(time, host_clock);
     if(setjmp(assert_handler)) {
         log_die("assertion failed %s:%zu '%s'",
                 failed_assertion.file, failed_assertion.line,
@@ -89,7 +157,83 @@ int server_update(Clock time, int force) {
     }
 }
 
+int server_receive(Clock time) {
+    Clock clock;
+
+    if(!server->running)
+        return 0;
+
+    /* the packets are handled at the time they arrive, which matters for
+     * the round-trip times, but the simulation must not notice it
+     */
+    clock = server->cur_clock;
+    server->cur_clock = max(time, clock);
+    host_clock = max(time, host_clock);
+
+    if(setjmp(assert_handler)) {
+        log_die("assertion failed %s:%zu '%s'",
+                failed_assertion.file, failed_assertion.line,
+                failed_assertion.what);
+        return -1;
+    }
+
+    protocol_recv();
+    server->cur_clock = clock;
+    return 1;
+}
+
+Clock server_deadline() {
+    Clock deadline = protocol_deadline();
+    uint64_t wait;
+
+    /* emulated datagrams are released when the connection is used */
+    if(conn_due(&server->conn_clients, &wait)) {
+        Clock due = host_clock + (Clock)(wait + 999) / 1000;
+        if(!deadline || due < deadline)
+            deadline = due;
+    }
+    return deadline;
+}
+
+int server_fd() {
+    if(shards_active())
+        return -1;
+    return conn_fd(&server->conn_clients);
+}
+
+int server_local_open() {
+    if(!server->running)
+        return 0;
+    return local_open();
+}
+
+int server_local_send(const char *buf, unsigned int size) {
+    return local_client_send(buf, size);
+}
+
+int server_local_recv(char *buf, unsigned int size) {
+    return local_client_recv(buf, size);
+}
+
+int server_pace(Clock time) {
+    if(!server->running)
+        return 0;
+
+    host_clock = max(time, host_clock);
+    if(setjmp(assert_handler)) {
+        log_die("assertion failed %s:%zu '%s'",
+                failed_assertion.file, failed_assertion.line,
+                failed_assertion.what);
+        return -1;
+    }
+
+    protocol_pace(time);
+    return 1;
+}
+
 void server_shutdown() {
+    local_shutdown();
+    shards_shutdown();
 	conn_shutdown(&server->conn_clients);
 
     rules_shutdown();
@@ -97,8 +241,12 @@ void server_shutdown() {
     entities_shutdown();
     clients_shutdown();
 
+    snapshots_shutdown();
     physics_shutdown();
+    transfer_shutdown();
     queue_shutdown();
+    str_shutdown();
+    arena_shutdown(&server->scratch);
 
     log_info("Terminated\n");
 }
@@ -1,36 +1,52 @@
 #ifndef STATE_H
 #define STATE_H
 
+#include "arena.h"
 #include "array.h"
 #include "bitset.h"
 #include "client.h"
 #include "clock.h"
 #include "connection.h"
+#include "ingress.h"
 #include "list.h"
 #include "pool.h"
 #include "pq.h"
+#include "rate.h"
+#include "shard.h"
+
+#include <stdint.h>
 
 typedef struct Server Server;
 
 extern Server *server;
 
 struct Connection {
-	char _[8];
+	uint64_t _[4];
 };
 
 struct Server {
     bool       running;
     Client    *self;
+    uint8_t    revision; /* newest revision that is accepted, see server_revision */
 
     Pool       clients;
     BitSet     connected;
+    Client    *addresses[CLIENT_TABLE_SIZE]; /* see client.c */
 
     Pool       entities;
     Pool       queue;
+    Pool       deliveries; /* see queue.c */
+    Pool       batches;
+    Events    *batch;      /* open batch of collisions */
+    Pool       transfers;  /* see transfer.c */
     Array      types;
     List       formats;
     PrioQueue  collisions;
-    Pool       strings;
+    Pool       strings;  /* see str.c */
+    Arena      scratch;  /* decoded data of the current tick */
+
+    Array      history;  /* see snapshot.c */
+    uint32_t   snapshot;
 
     Clock      cur_clock;
     Clock      prev_clock;
@@ -38,6 +54,9 @@ struct Server {
 	Clock      discovery_periodic;
 
 	Connection conn_clients;
+	Shards     shards;
+	Ingress    ingress;  /* see ingress.c */
+	Rates      rates;    /* see rate.c */
 };
 
 #define clients_foreach(c)       pool_foreach(&server->clients, c, Client)
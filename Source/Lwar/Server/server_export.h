@@ -40,6 +40,42 @@ extern "C" {
      */
 	EXPORT int  server_init(unsigned short port);
 
+    /* like server_init, but the port is opened by several
+     * sockets that are received from by their own threads
+     * (where supported), which spreads the receive system
+     * calls over several cores
+     */
+	EXPORT int  server_init_sharded(unsigned short port, unsigned int shards);
+
+    /* use io_uring instead of socket calls where the
+     * kernel supports it, to be called before server_init,
+     * not used with more than one shard
+     */
+	EXPORT void server_io_uring(int enable);
+
+    /* emulate the latency, jitter, loss, duplication, reordering
+     * and rate of a network path on the server port, for tests,
+     * to be called before server_init, see netem.h for spec,
+     * not used with more than one shard
+     * return > 0 if spec is valid
+     */
+	EXPORT int  server_emulate(const char *spec);
+
+    /* allow a spectator relay to connect from ip (IPv6 or
+     * IPv4), relays from other addresses are rejected,
+     * may be called for up to four addresses
+     * return > 0 if ip is valid and there is room for it
+     */
+	EXPORT int  server_relay(const char *ip);
+
+    /* accept clients up to revision rev, by default only up to
+     * the revision of the released client, since the newer ones
+     * are only implemented by the test tools so far,
+     * to be called before server_init
+     * return > 0 if the server implements rev
+     */
+	EXPORT int  server_revision(unsigned int rev);
+
     /* should be called periodically
      * clock is a monotonic counter in millisecs
      *       that MUST start with 0
@@ -52,6 +88,58 @@ extern "C" {
      */
     EXPORT int  server_update(unsigned long long clock, int force);
 
+    /* may be called between the calls to server_update
+     * to send the packets that wait for the send rate
+     * of their client, which spreads them over the
+     * update interval
+     * clock is the same counter as for server_update
+     * return > 0 on success, as server_update otherwise
+     */
+    EXPORT int  server_pace(unsigned long long clock);
+
+    /* may be called between the calls to server_update
+     * to handle the packets that have arrived right away,
+     * their effects are simulated by the next server_update
+     * return > 0 on success, as server_update otherwise
+     */
+    EXPORT int  server_receive(unsigned long long clock);
+
+    /* the clock at which server_pace has work next, 0 if none,
+     * the host may sleep until then, its next frame
+     * or until packets arrive
+     */
+    EXPORT unsigned long long server_deadline();
+
+    /* a descriptor that becomes readable when packets arrive,
+     * for poll or epoll, < 0 if there is none
+     */
+    EXPORT int  server_fd();
+
+    /* in-process transport for a client in the same process,
+     * which exchanges its packets through two rings in memory
+     * instead of a socket, to be called after server_init,
+     * the client is then known by a reserved address
+     * return > 0 on success
+     */
+    EXPORT int  server_local_open();
+
+    /* may be called by the thread of the local client
+     * to hand a packet to the server
+     * return > 0 if it was queued
+     * return = 0 if the queue is full and the packet is lost
+     * return < 0 if the transport is closed
+     */
+    EXPORT int  server_local_send(const char *buf, unsigned int size);
+
+    /* may be called by the thread of the local client
+     * to take the next packet for it from the server,
+     * which is truncated to size bytes
+     * return > 0 the size of the packet
+     * return = 0 if there is none
+     * return < 0 if the transport is closed
+     */
+    EXPORT int  server_local_recv(char *buf, unsigned int size);
+
     /* free data structures
      * shutdown network connection
      */
@@ -0,0 +1,217 @@
+#include "types.h"
+
+#include "shard.h"
+
+#include "config.h"
+#include "connection.h"
+#include "debug.h"
+#include "log.h"
+#include "packet.h"
+#include "performance.h"
+#include "server.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* The server port can be opened by several sockets with SO_REUSEPORT,
+ * each of which is drained by its own thread into a ring of datagrams.
+ * The kernel steers the datagrams by a hash of the sender address, so all
+ * packets of a client arrive at the same shard and stay in order. The
+ * simulation is still run by a single thread, which takes the datagrams
+ * from the rings in turn (shards_recv) and decodes them; the receive
+ * system calls and the kernel work of the socket are spread over the
+ * cores. Packets are sent on the first socket.
+ *
+ * A ring has a single producer (the shard thread) and a single consumer
+ * (the server), head and tail only grow. Datagrams that do not fit into
+ * a full ring are dropped, just like the kernel drops them when the
+ * socket buffer is full.
+ */
+
+typedef struct Datagram Datagram;
+
+struct Datagram {
+    Address adr;
+    uint64_t stamp;
+    size_t  size;
+    char    buf[MAX_PACKET_LENGTH];
+};
+
+#ifdef __unix__
+#include <pthread.h>
+
+#define load(p)    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store(p,v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+struct Shard {
+    Connection  own;  /* unused by the first shard */
+    Connection *conn;
+    pthread_t   thread;
+    bool        running;
+
+    size_t head, tail; /* written by the shard and the server */
+    size_t dropped;    /* written by the shard */
+    size_t reported;   /* part of dropped that has been counted */
+
+    Datagram ring[SHARD_QUEUE];
+};
+
+static void *shard_run(void *p) {
+    Shard *s = (Shard*)p;
+    Datagram overrun;
+
+    while(load(&s->running)) {
+        if(!conn_wait(s->conn, SHARD_WAIT))
+            continue;
+
+        for(;;) {
+            size_t head = s->head;
+            bool full = head - load(&s->tail) == SHARD_QUEUE;
+            Datagram *d = full ? &overrun : &s->ring[head % SHARD_QUEUE];
+
+            d->size = sizeof(d->buf);
+            if(!conn_recv(s->conn, d->buf, &d->size, &d->adr) || d->size == 0)
+                break;
+            d->stamp = conn_stamp(s->conn);
+
+            if(full) store(&s->dropped, s->dropped + 1);
+            else     store(&s->head, head + 1);
+        }
+    }
+
+    return 0;
+}
+
+static void shard_stop(Shard *s) {
+    store(&s->running, false);
+    pthread_join(s->thread, 0);
+    if(s->conn == &s->own)
+        conn_shutdown(&s->own);
+}
+
+bool shards_init(Connection *conn, size_t n, unsigned short port) {
+    Shards *sh = &server->shards;
+    size_t i;
+
+    memset(sh, 0, sizeof(Shards));
+    if(n <= 1)
+        return conn_bind(conn, port);
+
+    if(n > MAX_SHARDS) {
+        log_warn("Using %d instead of %zu shards.", MAX_SHARDS, n);
+        n = MAX_SHARDS;
+    }
+
+    if(!conn_share(conn)) return false;
+
+    sh->shard = (Shard*)calloc(n, sizeof(Shard));
+    if(!sh->shard) return false;
+
+    for(i=0; i<n; i++) {
+        Shard *s = &sh->shard[i];
+
+        if(i == 0) {
+            s->conn = conn;
+        } else {
+            s->conn = &s->own;
+            if(!conn_init(s->conn)) break;
+            if(!conn_share(s->conn)) { conn_shutdown(s->conn); break; }
+        }
+        if(!conn_bind(s->conn, port)) break;
+
+        s->running = true;
+        if(pthread_create(&s->thread, 0, shard_run, s) != 0) {
+            log_error("Unable to start shard %zu.", i);
+            if(i > 0) conn_shutdown(s->conn);
+            break;
+        }
+        sh->n ++;
+    }
+
+    if(sh->n < n) {
+        shards_shutdown();
+        return false;
+    }
+
+    log_info("Receiving with %zu shards.", n);
+    return true;
+}
+
+void shards_shutdown() {
+    Shards *sh = &server->shards;
+    size_t i;
+
+    for(i=0; i<sh->n; i++)
+        shard_stop(&sh->shard[i]);
+
+    free(sh->shard);
+    memset(sh, 0, sizeof(Shards));
+}
+
+bool shards_active() {
+    return server->shards.n > 0;
+}
+
+bool shards_recv(char *buf, size_t *size, Address *adr) {
+    Shards *sh = &server->shards;
+    size_t i;
+
+    for(i=0; i<sh->n; i++) {
+        Shard *s = &sh->shard[(sh->next + i) % sh->n];
+        size_t tail = s->tail;
+        size_t dropped = load(&s->dropped);
+
+        if(dropped != s->reported) {
+            counter_set(COUNTER_OVERRUN, (unsigned int)(dropped - s->reported));
+            s->reported = dropped;
+        }
+
+        if(tail != load(&s->head)) {
+            Datagram *d = &s->ring[tail % SHARD_QUEUE];
+            assert(d->size <= *size);
+            memcpy(buf, d->buf, d->size);
+            *size = d->size;
+            *adr  = d->adr;
+            sh->stamp = d->stamp;
+            store(&s->tail, tail + 1);
+
+            sh->next = (sh->next + i + 1) % sh->n;
+            return true;
+        }
+    }
+
+    *size = 0;
+    return true;
+}
+
+uint64_t shards_stamp() {
+    return server->shards.stamp;
+}
+
+#else
+
+/* shards need threads, all datagrams are received by conn */
+
+bool shards_init(Connection *conn, size_t n, unsigned short port) {
+    memset(&server->shards, 0, sizeof(Shards));
+    if(n > 1)
+        log_warn("Shards are not supported, receiving on a single socket.");
+    return conn_bind(conn, port);
+}
+
+void shards_shutdown() {}
+
+bool shards_active() {
+    return false;
+}
+
+bool shards_recv(char *buf, size_t *size, Address *adr) {
+    *size = 0;
+    return true;
+}
+
+uint64_t shards_stamp() {
+    return 0;
+}
+
+#endif
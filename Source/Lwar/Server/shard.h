@@ -0,0 +1,33 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "address.h"
+#include "types.h"
+
+/* receive threads of the server port, see shard.c */
+struct Shards {
+    size_t n;    /* number of shards, none if at most one */
+    size_t next; /* shard to receive from first */
+    uint64_t stamp; /* see shards_stamp */
+    Shard *shard;
+};
+
+/* bind n sockets to port and start their threads,
+ * the first socket is conn, which must not be bound yet
+ */
+bool shards_init(Connection *conn, size_t n, unsigned short port);
+void shards_shutdown();
+
+/* whether datagrams are received by the shards instead of conn */
+bool shards_active();
+
+/* next datagram of any shard, *size = 0 if there is none */
+bool shards_recv(char *buf, size_t *size, Address *adr);
+
+/* receive time of the datagram that shards_recv returned last, see conn_stamp */
+uint64_t shards_stamp();
+
+#endif
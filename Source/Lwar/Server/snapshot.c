@@ -0,0 +1,197 @@
+#include "types.h"
+
+#include "snapshot.h"
+
+#include "client.h"
+#include "debug.h"
+#include "entity.h"
+#include "real.h"
+#include "server.h"
+
+#include <limits.h>
+#include <string.h>
+
+/* The server keeps the quantized states of the last MAX_SNAPSHOTS snapshots.
+ * Each client acknowledges complete snapshots, which become the baselines
+ * that further updates of an entity are delta-compressed against.
+ * Note that a baseline is only valid as long as its snapshot is still in history.
+ */
+
+static State *history_at(uint32_t snapshot, size_t n) {
+    return &array_at(&server->history, State, (snapshot % MAX_SNAPSHOTS) * MAX_ENTITIES + n);
+}
+
+/* state of e in the given snapshot, or 0 if not available anymore */
+static State *state_at(uint32_t snapshot, Entity *e) {
+    State *s;
+
+    if(!snapshot || server->snapshot - snapshot >= MAX_SNAPSHOTS)
+        return 0;
+
+    s = history_at(snapshot, e->id.n);
+    if(!id_eq(s->id, e->id))
+        return 0;
+    return s;
+}
+
+static void state_capture(State *s, Entity *e, unsigned fields) {
+    Id none = { 0, USHRT_MAX };
+    size_t i;
+
+    memset(s, 0, sizeof(State));
+    s->id = e->id;
+
+    if(fields & STATE_X)      s->x      = (int16_t)e->x.x;
+    if(fields & STATE_Y)      s->y      = (int16_t)e->x.y;
+    if(fields & STATE_PHI)    s->phi    = deg100(e->phi);
+    if(fields & STATE_LEN)    s->len    = (uint16_t)e->len;
+    if(fields & STATE_TARGET) s->target = !e->target ? none : e->target->id;
+    if(fields & STATE_RADIUS) s->radius = (uint16_t)e->radius;
+
+    if(fields & STATE_HEALTH) {
+        s->health = 100 * e->health / e->type->init_health;
+        s->shield = 100 * e->health / e->type->init_health; /* TODO: actually use some shield */
+    }
+
+    if(fields & STATE_ENERGY) {
+        if(e->player) {
+            Slot *sl;
+            SlotType *st;
+            i = 0;
+            slots_foreach(e->player,sl,st) {
+                Entity *r = sl->entity;
+                s->energy[i++] = r ? 100 * r->energy / r->type->init_energy : 0;
+            }
+        } else {
+            for(i=0; i<NUM_SLOTS; i++)
+                s->energy[i] = 100;
+        }
+    }
+}
+
+static unsigned state_diff(State *s0, State *s1, unsigned fields) {
+    unsigned mask = 0;
+    if(s0->x      != s1->x)             mask |= STATE_X;
+    if(s0->y      != s1->y)             mask |= STATE_Y;
+    if(s0->phi    != s1->phi)           mask |= STATE_PHI;
+    if(s0->len    != s1->len)           mask |= STATE_LEN;
+    if(!id_eq(s0->target, s1->target))  mask |= STATE_TARGET;
+    if(s0->radius != s1->radius)        mask |= STATE_RADIUS;
+    if(   s0->health != s1->health
+       || s0->shield != s1->shield)     mask |= STATE_HEALTH;
+    if(memcmp(s0->energy, s1->energy, sizeof(s0->energy)))
+                                        mask |= STATE_ENERGY;
+    return mask & fields;
+}
+
+void snapshot_capture() {
+    Format *f;
+    Entity *e;
+
+    server->snapshot ++;
+
+    formats_foreach(f) {
+        updates_foreach(f,e) {
+            state_capture(history_at(server->snapshot, e->id.n), e, f->fields);
+        }
+    }
+}
+
+void snapshot_reset(Client *c) {
+    memset(c->baselines, 0, sizeof(c->baselines));
+}
+
+/* the client has removed e, the next update must be absolute */
+void snapshot_forget(Client *c, Entity *e) {
+    memset(&c->baselines[e->id.n], 0, sizeof(Baseline));
+}
+
+void snapshot_ack(Client *c, uint32_t snapshot) {
+    Format *f;
+    Entity *e;
+
+    if(!snapshot || server->snapshot - snapshot >= MAX_SNAPSHOTS)
+        return;
+
+    c->last_in_snapshot = max(c->last_in_snapshot, snapshot);
+
+    formats_foreach(f) {
+        updates_foreach(f,e) {
+            Baseline *b = &c->baselines[e->id.n];
+            uint32_t  d = b->sent - snapshot;
+
+            if(b->sent < snapshot || d >= MAX_SNAPSHOTS)
+                continue;
+            if((b->mask >> d) & 1)
+                b->acked = max(b->acked, snapshot);
+        }
+    }
+}
+
+static uint8_t delta_groups(unsigned mask) {
+    uint8_t head = 0;
+    if(mask & (STATE_X | STATE_Y)) head |= DELTA_POS;
+    if(mask &  STATE_PHI)          head |= DELTA_PHI;
+    if(mask & ~(STATE_X | STATE_Y | STATE_PHI))
+                                   head |= DELTA_EXTRA;
+    return head;
+}
+
+bool snapshot_delta(Client *c, Entity *e, Delta *d) {
+    Baseline *b      = &c->baselines[e->id.n];
+    unsigned  fields = e->type->format->fields;
+    State    *cur    = history_at(server->snapshot, e->id.n);
+    State    *base   = state_at(b->acked, e);
+    State    *sent;
+    unsigned  mask;
+
+    assert(id_eq(cur->id, e->id));
+
+    d->state  = *cur;
+    d->fields = fields;
+    d->base   = base;
+    if(base) {
+        mask = state_diff(base, cur, fields);
+        d->head = delta_groups(mask) | (server->snapshot - b->acked);
+    } else {
+        mask = fields;
+        d->head = delta_groups(mask);
+    }
+
+    if(mask == 0) {
+        /* the client may still receive a newer state that is in flight,
+         * in which case the current state has to be confirmed */
+        if(b->sent <= b->acked)
+            return false;
+        sent = state_at(b->sent, e);
+        if(sent && !state_diff(sent, cur, fields))
+            return false;
+    }
+
+    return true;
+}
+
+void snapshot_sent(Client *c, Entity *e) {
+    Baseline *b = &c->baselines[e->id.n];
+    uint32_t  d = server->snapshot - b->sent;
+
+    b->mask = (b->sent && d < MAX_SNAPSHOTS ? b->mask << d : 0) | 1;
+    b->sent = server->snapshot;
+}
+
+void snapshots_init() {
+    array_init(&server->history, 0, MAX_SNAPSHOTS * MAX_ENTITIES, sizeof(State));
+    server->snapshot = 0;
+}
+
+void snapshots_shutdown() {
+    array_shutdown(&server->history);
+}
+
+uint32_t angle_quantize(uint16_t phi) {
+    return ((uint32_t)phi * (1u << ANGLE_BITS) + 18000) / 36000 % (1u << ANGLE_BITS);
+}
+
+uint16_t angle_restore(uint32_t q) {
+    return (uint16_t)((q * 36000 + (1u << (ANGLE_BITS - 1))) >> ANGLE_BITS);
+}
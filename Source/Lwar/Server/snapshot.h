@@ -0,0 +1,79 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "config.h"
+#include "id.h"
+#include "types.h"
+
+typedef enum StateField StateField;
+
+/* fields of a State */
+enum StateField {
+    STATE_X         = 0x01,
+    STATE_Y         = 0x02,
+    STATE_PHI       = 0x04,
+    STATE_LEN       = 0x08,
+    STATE_TARGET    = 0x10,
+    STATE_RADIUS    = 0x20,
+    STATE_HEALTH    = 0x40, /* health and shield */
+    STATE_ENERGY    = 0x80,
+};
+
+/* quantized entity state, as it is sent over the network */
+struct State {
+    Id       id;
+    int16_t  x, y;
+    uint16_t phi;
+    uint16_t len;
+    Id       target;
+    uint16_t radius;
+    uint8_t  health, shield;
+    uint8_t  energy[NUM_SLOTS];
+};
+
+/* groups of fields that are present in a Delta */
+enum {
+    DELTA_BASE      = 0x1f, /* age of the baseline in snapshots, 0 if absolute */
+    DELTA_POS       = 0x20, /* x, y */
+    DELTA_PHI       = 0x40,
+    DELTA_EXTRA     = 0x80, /* all remaining fields of the format */
+};
+
+/* update record of an entity relative to a baseline */
+struct Delta {
+    uint8_t  head;   /* DELTA_* */
+    unsigned fields; /* STATE_* of the format */
+    State    state;
+    const State *base; /* required if the age in head is not 0 */
+};
+
+/* what a client knows about a particular entity */
+struct Baseline {
+    uint32_t acked; /* last snapshot acknowledged by the client, 0 if none */
+    uint32_t sent;  /* last snapshot the entity was sent in */
+    uint32_t mask;  /* bit i is set if the entity was also sent in snapshot sent - i */
+};
+
+void snapshots_init();
+void snapshots_shutdown();
+
+/* record the state of all entities that have an update format */
+void snapshot_capture();
+
+void snapshot_reset(Client *c);
+void snapshot_ack(Client *c, uint32_t snapshot);
+void snapshot_forget(Client *c, Entity *e);
+
+/* compute the update record of e for c in the current snapshot,
+ * return false if c is already up-to-date
+ */
+bool snapshot_delta(Client *c, Entity *e, Delta *d);
+void snapshot_sent(Client *c, Entity *e);
+
+/* angles of bit-packed records, in ANGLE_BITS */
+uint32_t angle_quantize(uint16_t phi);
+uint16_t angle_restore(uint32_t q);
+
+#endif
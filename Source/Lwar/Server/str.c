@@ -1,5 +1,85 @@
+#include "types.h"
+
 #include "str.h"
-#include "uint.h"
 
+#include "config.h"
+#include "debug.h"
+#include "pool.h"
+#include "server.h"
+
+#include <stdint.h>
 #include <string.h>
 
+typedef struct Interned Interned;
+
+/* Player names and the strings of queued messages are copied into a
+ * bounded pool. Equal strings share an entry, which is freed when the
+ * last reference is released, so the memory of the server does not grow
+ * with the names and chat messages it has seen.
+ */
+struct Interned {
+    List   _l;
+    size_t refs;
+    unsigned char n;
+    char   s[UINT8_MAX];
+};
+
+static Interned *str_entry(Str s) {
+    Pool *pool = &server->strings;
+    Interned *in;
+
+    /* already interned */
+    if(s.s >= pool->mem && s.s < pool->mem + pool->n * pool->size)
+        return pool_at(pool, Interned, (size_t)(s.s - pool->mem) / pool->size);
+
+    pool_foreach(pool, in, Interned) {
+        if(in->n == s.n && !memcmp(in->s, s.s, s.n))
+            return in;
+    }
+    return 0;
+}
+
+bool str_intern(Str *s) {
+    Interned *in;
+
+    /* empty strings need no storage */
+    if(!s->n) {
+        s->s = "";
+        return true;
+    }
+
+    in = str_entry(*s);
+    if(!in) {
+        in = pool_new(&server->strings, Interned);
+        if(!in) return false;
+        in->refs = 0;
+        in->n = s->n;
+        memcpy(in->s, s->s, s->n);
+    }
+
+    in->refs ++;
+    s->s = in->s;
+    return true;
+}
+
+/* strings that have not been interned are ignored */
+void str_release(Str s) {
+    Pool *pool = &server->strings;
+    Interned *in;
+
+    if(!s.s || s.s < pool->mem || s.s >= pool->mem + pool->n * pool->size)
+        return;
+
+    in = str_entry(s);
+    assert(in->refs > 0);
+    if(-- in->refs == 0)
+        pool_free(pool, in);
+}
+
+void str_init() {
+    pool_dynamic(&server->strings, Interned, MAX_STRINGS, 0, 0);
+}
+
+void str_shutdown() {
+    pool_shutdown(&server->strings);
+}
@@ -1,6 +1,7 @@
 #ifndef STR_H
 #define STR_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 typedef struct Str Str;
@@ -12,4 +13,16 @@ struct Str {
 
 #define STR_ARG(id) (id).n, (id).s
 
+/* Decoded strings live in the arena of the current tick, strings that
+ * are kept longer are interned in server->strings, see str.c
+ */
+void str_init();
+void str_shutdown();
+
+/* point s to an interned copy and take a reference,
+ * false if the pool is full
+ */
+bool str_intern(Str *s);
+void str_release(Str s);
+
 #endif
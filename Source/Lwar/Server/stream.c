@@ -2,14 +2,22 @@
 
 #include "stream.h"
 
+#include "batch.h"
 #include "debug.h"
+#include "ingress.h"
 #include "message.h"
 #include "packet.h"
 #include "pack.h"
+#include "pacing.h"
 #include "performance.h"
+#include "schedule.h"
 #include "server.h"
+#include "snapshot.h"
 #include "unpack.h"
 
+#include <stdint.h>
+#include <string.h>
+
 /*
 static struct {
     size_t nsend,nresend,nrecv;
@@ -20,10 +28,27 @@ static bool packet_scan_header(Packet *p, Header *h) {
     int ok = packet_get(p, header_unpack, h);
     if(!ok) return false;
 
-    if((uint32_t)(h->app_id) != APP_ID)
+    if(   (uint32_t)(h->app_id) != APP_ID
+       && (uint32_t)(h->app_id) != APP_ID_COMPACT)
         return false;
 
     h->adr = p->adr;
+    h->stamp = p->stamp;
+    h->cookie = false;
+    h->relay = false;
+    return true;
+}
+
+/* the next message of p, whose header is h */
+static bool message_get(Packet *p, Header *h, Message *m) {
+    size_t n;
+
+    if(p->start == p->end)
+        return false;
+    n = message_unpack_in(p->p + p->start, p->end - p->start, m, h);
+    if(!n || p->start + n > p->end)
+        return false;
+    p->start += n;
     return true;
 }
 
@@ -38,10 +63,13 @@ bool stream_recv(cr_t *state, Header *h, Message *m) {
         if(p.end == 0) /* EAGAIN */
             cr_yield(state, false);
 
+        if(!ingress_admit(p.p, p.end, &p.adr))
+            continue;
+
         ok = packet_scan_header(&p, h);
         if(!ok) continue;
 
-        while(packet_get(&p, message_unpack, m)) {
+        while(message_get(&p, h, m)) {
             cr_yield(state, true);
         }
     }
@@ -49,57 +77,212 @@ bool stream_recv(cr_t *state, Header *h, Message *m) {
     cr_return(state, false);
 }
 
+/* m and len more bytes, if they fit; counts the messages and the
+ * bytes of their headers, see performance.h
+ */
+static bool message_put(Packet *p, Header *h, Message *m, size_t len) {
+    uint32_t prev = h->prev;
+    size_t i = message_header_pack(p->p + p->end, m, h);
+    size_t n = i + message_body_pack(p->p + p->end + i, m);
+
+    if(p->end + n + len > p->mtu) {
+        h->prev = prev;
+        return false;
+    }
+    p->end += n;
+    counter_set(COUNTER_PACKED, 1);
+    counter_set(COUNTER_HEADER_BYTES, i);
+    return true;
+}
+
+/* all unreliable messages of a compact packet share its frame */
 static void packet_init_send_header(Packet *p, Header *h) {
     packet_init_send(p, &h->adr);
-    packet_put(p, header_pack, h);
+    p->mtu = h->mtu;
+    if(h->app_id == APP_ID_COMPACT)
+        h->frame = (uint32_t)h->c->next_out_unreliable_seqno ++;
+    packet_put_header(p, h);
+    counter_set(COUNTER_HEADER_BYTES, p->end);
 }
 
-static bool packet_flush(Packet *p) {
+/* packets to a client are paced, see pacing.c */
+static bool stream_packet_send(Packet *p, Header *h) {
+    if(h->c)
+        return pacing_send(h->c, p);
+    return packet_send(p);
+}
+
+static bool packet_flush(Packet *p, Header *h) {
     if(packet_hasdata(p))
-        return packet_send(p);
+        return stream_packet_send(p, h);
     return true;
 }
 
 static bool send_message(Packet *p, Header *h, Message *m) {
-    while(!packet_put(p, message_pack, m)) {
-        if(!packet_send(p))
+    while(!message_put(p, h, m, 0)) {
+        if(!stream_packet_send(p, h))
+            return false;
+        packet_init_send_header(p, h);
+    }
+    return true;
+}
+
+/* m followed by len bytes of s in the same packet: the records of a
+ * batched message, which were bit-packed when it was queued, or the
+ * bytes of a chunk of the world, see transfer.c
+ */
+static bool send_payload_message(Packet *p, Header *h, Message *m, const char *s, size_t len) {
+    while(!message_put(p, h, m, len)) {
+        if(!stream_packet_send(p, h))
             return false;
         packet_init_send_header(p, h);
     }
+
+    memcpy(p->p + p->end, s, len);
+    p->end += len;
     return true;
 }
 
+/* the records are packed in batches, all k records of a message fit */
 static bool send_update_message(Packet *p, Header *h, Message *m) {
-    Entity *e;
+    Entity *e, *batch[BATCH_SIZE];
     Format *f = m->update.f;
+    Client *c = m->update.c;
     size_t k = 0;
-    size_t n = f->n;
+    size_t n = 0;
+    size_t b = 0;
+
+    updates_foreach(f,e) {
+        if(schedule_contains(c, e))
+            n ++;
+    }
 
     updates_foreach(f,e) {
         assert(!e->dead);
+        if(!schedule_contains(c, e))
+            continue;
     retry:
         if(!k) {
             k = min(n, packet_update_n(p,f->len));
             if(k) {
                 m->update.n = k;
-                packet_put(p, message_pack, m);
+                message_put(p, h, m, 0);
             } else {
-                if(!packet_send(p))
+                if(!stream_packet_send(p, h))
                     return false;
                 packet_init_send_header(p, h);
             }
             goto retry;
         } else {
-            packet_put(p, f->pack, e);
+            batch[b++] = e;
             k --;
             n --;
+            if(b == BATCH_SIZE || !k) {
+                p->end += update_batch_pack(p->p + p->end, f, batch, b);
+                assert(p->end <= p->mtu);
+                b = 0;
+            }
         }
     }
+    assert(b == 0);
     assert(k == 0);
     assert(n == 0);
     return true;
 }
 
+/* write the final record count of the delta message at pos,
+ * its header does not change since it is unreliable
+ */
+static void delta_close(Packet *p, Header *h, Message *m, size_t pos) {
+    if(m->delta.n || (m->delta.part & DELTA_LAST))
+        message_body_pack(p->p + pos + message_header_pack(p->p + pos, m, h), m);
+    else
+        p->end = pos; /* drop empty part */
+}
+
+/* split the delta-compressed snapshot for m->delta.c into parts,
+ * each of which is a separate unreliable message for a single format
+ */
+/* append d to the open delta message, whose records start at b->s */
+static bool delta_put(Packet *p, Client *c, Delta *d, BitStream *b, uint16_t *prev) {
+    size_t mark = b->pos;
+
+    if(c->rev < REVISION_BITPACK)
+        return packet_put(p, delta_pack, d);
+
+    /* the records of a message form a single bit stream */
+    delta_write(b, d, prev);
+    if(b->overflow) {
+        b->pos      = mark;
+        b->overflow = false;
+        return false;
+    }
+    p->end = (size_t)(b->s - p->p) + bits_bytes(b);
+    return true;
+}
+
+static bool send_delta_message(Packet *p, Header *h, Message *m) {
+    Client *c = m->delta.c;
+    Format *f;
+    Entity *e;
+    Delta d;
+    BitStream b;
+    uint16_t prev = 0;
+    size_t pos = 0;
+    bool open = false;
+
+    formats_foreach(f) {
+        updates_foreach(f,e) {
+            assert(!e->dead);
+            if(!schedule_contains(c, e))
+                continue;
+            if(!snapshot_delta(c, e, &d))
+                continue;
+        retry:
+            if(open && m->delta.format != f->type) {
+                if(m->delta.part == DELTA_LAST - 1)
+                    goto last;
+                delta_close(p, h, m, pos);
+                if(m->delta.n) m->delta.part ++;
+                open = false;
+            }
+            if(!open) {
+                m->delta.format = f->type;
+                m->delta.n = 0;
+                m->seqno   = c->next_out_unreliable_seqno ++;
+                pos  = p->end;
+                open = message_put(p, h, m, 0);
+                prev = 0;
+                bits_init(&b, p->p + p->end, open ? p->mtu - p->end : 0);
+            }
+            if(open && m->delta.n < UINT8_MAX && delta_put(p, c, &d, &b, &prev)) {
+                m->delta.n ++;
+                snapshot_sent(c, e);
+                continue;
+            }
+            if(open) {
+                /* the rest will be sent with the next snapshot */
+                if(m->delta.part == DELTA_LAST - 1)
+                    goto last;
+                delta_close(p, h, m, pos);
+                if(m->delta.n) m->delta.part ++;
+                open = false;
+            }
+            if(!stream_packet_send(p, h))
+                return false;
+            packet_init_send_header(p, h);
+            goto retry;
+        }
+    }
+
+last:
+    if(open) {
+        m->delta.part |= DELTA_LAST;
+        delta_close(p, h, m, pos);
+    }
+    return true;
+}
+
 bool stream_send(cr_t *state, Header *h, Message *m) {
     static Packet p;
     bool ok = true;
@@ -111,6 +294,12 @@ bool stream_send(cr_t *state, Header *h, Message *m) {
     while(m && ok) {
         if(is_update(m)) {
             ok = send_update_message(&p, h, m);
+        } else if(m->type == MESSAGE_DELTA) {
+            ok = send_delta_message(&p, h, m);
+        } else if(is_batched(m)) {
+            ok = send_payload_message(&p, h, m, m->events.e->s, bits_bytes(&m->events.e->b));
+        } else if(m->type == MESSAGE_CHUNK) {
+            ok = send_payload_message(&p, h, m, m->chunk.s, m->chunk.len);
         } else {
             ok = send_message(&p, h, m);
         }
@@ -118,14 +307,27 @@ bool stream_send(cr_t *state, Header *h, Message *m) {
         cr_yield(state, ok);
     }
 
-    ok = packet_flush(&p);
+    ok = packet_flush(&p, h);
 
     cr_return(state, ok);
 }
 
+/* send m padded to a packet of m->mtu_probe.size bytes */
+bool stream_send_probe(Header *h, Message *m) {
+    Packet p;
+    packet_init_send_header(&p, h);
+    p.mtu = m->mtu_probe.size;
+    m->mtu_probe.pad = (uint16_t)(p.mtu - p.end - MESSAGE_LENGTH_MTU_PROBE);
+    if(h->app_id == APP_ID_COMPACT)
+        m->mtu_probe.pad += MESSAGE_HEADER_LENGTH - COMPACT_MESSAGE_HEADER_LENGTH;
+    message_put(&p, h, m, 0);
+    assert(p.end == p.mtu);
+    return stream_packet_send(&p, h);
+}
+
 bool stream_send_flush(Header *h, Message *m) {
     Packet p;
     packet_init_send_header(&p, h);
-    packet_put(&p, message_pack, m);
+    message_put(&p, h, m, 0);
     return packet_send(&p);
 }
@@ -4,8 +4,9 @@
 #include "coroutine.h"
 bool stream_recv(cr_t *state, Header *h, Message *m); /* TODO: needs to evaluate ack */
 bool stream_send(cr_t *state, Header *h, Message *m); /* Note: keep h constant for a set of updates! */
-#define stream_flush(state) stream_send(state, 0, 0);
+#define stream_flush(state,h) stream_send(state, h, 0);
 
 bool stream_send_flush(Header *h, Message *m);
+bool stream_send_probe(Header *h, Message *m);
 
 #endif
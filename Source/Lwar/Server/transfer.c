@@ -0,0 +1,193 @@
+#include "types.h"
+
+#include "transfer.h"
+
+#include "client.h"
+#include "interest.h"
+#include "message.h"
+#include "pack.h"
+#include "real.h"
+#include "rtt.h"
+#include "server.h"
+
+#include <limits.h>
+#include <string.h>
+
+/* A joining client needs a Join for every player and an Add for every
+ * entity around it before the game makes sense. Queued one by one, these
+ * are as many reliable messages, which are acknowledged and resent one by
+ * one and occupy the queue until they are.
+ *
+ * Clients of REVISION_TRANSFER receive them as a single stream instead:
+ * the Joins, the Adds in batches of bit-packed records (as in an Adds
+ * message) and the final Synced are serialized once when the client
+ * connects, with seqnos of their own. The stream is cut into chunks of TRANSFER_CHUNK bytes, which
+ * are sent as unreliable Chunk messages at the rate of the client, at
+ * most TRANSFER_WINDOW after the first one that has not been acknowledged.
+ * The client acknowledges the chunks it has with a ChunkAck, chunks that
+ * are not acknowledged within the retransmission timeout are sent again.
+ *
+ * Until all chunks have been acknowledged, the client receives no updates,
+ * and the reliable messages that are queued for it wait, so that they
+ * apply to the world it has received. At most MAX_TRANSFERS clients join
+ * this way at the same time, the others, and those whose world does not
+ * fit into TRANSFER_LENGTH, join message by message.
+ */
+
+#define acked_word(t,i) (t)->acked[(i) / 32]
+#define acked_bit(i)    ((uint32_t)1 << ((i) % 32))
+
+static bool is_acked(Transfer *t, size_t i) {
+    return (acked_word(t,i) & acked_bit(i)) != 0;
+}
+
+void transfer_init() {
+    pool_dynamic(&server->transfers, Transfer, MAX_TRANSFERS, 0, 0);
+}
+
+void transfer_shutdown() {
+    pool_shutdown(&server->transfers);
+}
+
+/* append m, false if it might not fit */
+static bool put_message(Transfer *t, Message *m) {
+    if(t->len + message_length(m->type) + LENGTH_uint8 + MAX_NAME_LENGTH > TRANSFER_LENGTH)
+        return false;
+    m->seqno = ++ t->n;
+    t->len  += message_pack(t->s + t->len, m);
+    return true;
+}
+
+/* append Adds messages for the entities, each followed by its records */
+static bool put_adds(Transfer *t, Entity **es, size_t n) {
+    BitStream b;
+    Message m;
+    size_t i, j, k, start;
+    uint16_t prev;
+
+    for(i=0; i<n; i+=k) {
+        k     = min(n - i, (size_t)UINT8_MAX);
+        start = t->len + MESSAGE_LENGTH_ADDS;
+        if(start > TRANSFER_LENGTH)
+            return false;
+
+        bits_init(&b, t->s + start, TRANSFER_LENGTH - start);
+        for(j=0, prev=0; j<k; j++) {
+            message_add(&m, es[i+j]);
+            event_write(&b, &m, &prev);
+        }
+        if(b.overflow)
+            return false;
+
+        m.type     = MESSAGE_ADDS;
+        m.seqno    = ++ t->n;
+        m.events.n = (uint8_t)k;
+        m.events.e = 0;
+        message_pack(t->s + t->len, &m);
+        t->len = start + bits_bytes(&b);
+    }
+    return true;
+}
+
+/* the messages that queue_gamestate_for would queue */
+static bool put_world(Transfer *t, Client *cn) {
+    static Entity *es[MAX_ENTITIES];
+    Message m;
+    Client *c;
+    size_t n;
+
+    clients_foreach(c) {
+        if(c->dead || c->relay || c == cn)
+            continue;
+        message_join(&m, c);
+        if(!put_message(t, &m))
+            return false;
+    }
+
+    n = interest_join(cn, es, MAX_ENTITIES);
+    if(!put_adds(t, es, n))
+        return false;
+
+    message_synced(&m, &cn->player);
+    return put_message(t, &m);
+}
+
+bool transfer_start(Client *c) {
+    Transfer *t = pool_new(&server->transfers, Transfer);
+    if(!t)
+        return false;
+
+    t->len   = 0;
+    t->n     = 0;
+    t->first = 0;
+    memset(t->acked, 0, sizeof(t->acked));
+    memset(t->tries, 0, sizeof(t->tries));
+
+    if(!put_world(t, c)) {
+        /* the client has not been told about any entity yet */
+        interest_reset(c);
+        pool_free(&server->transfers, t);
+        return false;
+    }
+
+    t->count    = (t->len + TRANSFER_CHUNK - 1) / TRANSFER_CHUNK;
+    c->transfer = t;
+    return true;
+}
+
+bool transfer_next(Client *c, Message *m, size_t *tries) {
+    Transfer *t = c->transfer;
+    size_t i, end;
+
+    if(!t)
+        return false;
+
+    end = min(t->first + TRANSFER_WINDOW, t->count);
+    for(i=t->first; i<end; i++) {
+        if(is_acked(t, i))
+            continue;
+        if(   t->tries[i] > 0
+           && t->sent[i] + rtt_timeout(c, t->tries[i]) >= server->cur_clock)
+            continue;
+
+        *tries = t->tries[i] ++;
+        t->sent[i] = server->cur_clock;
+
+        m->type        = MESSAGE_CHUNK;
+        m->chunk.index = (uint16_t)i;
+        m->chunk.count = (uint16_t)t->count;
+        m->chunk.len   = (uint16_t)min(t->len - i * TRANSFER_CHUNK, (size_t)TRANSFER_CHUNK);
+        m->chunk.s     = t->s + i * TRANSFER_CHUNK;
+        return true;
+    }
+    return false;
+}
+
+void transfer_ack(Client *c, size_t next, uint32_t mask) {
+    Transfer *t = c->transfer;
+    size_t i;
+
+    /* a late ack of a finished transfer */
+    if(!t)
+        return;
+
+    for(i=t->first; i<next && i<t->count; i++)
+        acked_word(t,i) |= acked_bit(i);
+    for(i=0; i<32 && next+1+i < t->count; i++) {
+        if(mask & ((uint32_t)1 << i))
+            acked_word(t,next+1+i) |= acked_bit(next+1+i);
+    }
+
+    while(t->first < t->count && is_acked(t, t->first))
+        t->first ++;
+
+    if(t->first == t->count)
+        transfer_forget(c);
+}
+
+void transfer_forget(Client *c) {
+    if(!c->transfer)
+        return;
+    pool_free(&server->transfers, c->transfer);
+    c->transfer = 0;
+}
@@ -0,0 +1,43 @@
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <stdint.h>
+
+#include "clock.h"
+#include "config.h"
+#include "list.h"
+#include "types.h"
+
+/* the world as a joining client receives it, see transfer.c */
+struct Transfer {
+    List     _l;
+    size_t   len;   /* bytes of the stream */
+    size_t   n;     /* messages of the stream, which are numbered from one */
+    size_t   count; /* chunks */
+    size_t   first; /* first chunk that has not been acknowledged */
+    uint32_t acked[(TRANSFER_CHUNKS + 31) / 32];
+    Clock    sent[TRANSFER_CHUNKS];
+    size_t   tries[TRANSFER_CHUNKS];
+    char     s[TRANSFER_LENGTH];
+};
+
+void transfer_init();
+void transfer_shutdown();
+
+/* stream the world to a joining client of REVISION_TRANSFER, false if
+ * there is no room for it, then it has to join message by message
+ */
+bool transfer_start(Client *c);
+
+/* the next chunk that is due for c, tries is the number of times it has
+ * been sent before, false if none is due
+ */
+bool transfer_next(Client *c, Message *m, size_t *tries);
+
+/* the client has received the chunks before next and those in mask */
+void transfer_ack(Client *c, size_t next, uint32_t mask);
+
+/* drop the transfer to c */
+void transfer_forget(Client *c);
+
+#endif
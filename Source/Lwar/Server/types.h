@@ -3,23 +3,48 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "list.h"
 
+typedef struct Baseline Baseline;
+typedef struct Bucket Bucket;
+typedef struct Channel Channel;
 typedef struct Client Client;
 typedef struct Collision Collision;
 typedef struct Connection Connection;
+typedef struct Delta Delta;
 typedef struct Discovery Discovery;
+typedef struct Events Events;
 typedef struct Entity Entity;
 typedef struct EntityType EntityType;
+typedef struct InputFrame InputFrame;
+typedef struct Interest Interest;
+typedef struct Jitter Jitter;
+typedef struct Latency Latency;
 typedef struct Format Format;
 typedef struct Header Header;
+typedef struct Ingress Ingress;
 typedef struct Message Message;
+typedef struct Mtu Mtu;
+typedef struct Netem Netem;
+typedef struct NetemConfig NetemConfig;
+typedef struct Pacer Pacer;
 typedef struct Player Player;
+typedef struct Rate Rate;
+typedef struct Rates Rates;
+typedef struct Rtt Rtt;
+typedef struct Schedule Schedule;
+typedef struct Shard Shard;
+typedef struct Shards Shards;
+typedef struct Source Source;
 typedef struct Slot Slot;
 typedef struct SlotType SlotType;
+typedef struct State State;
+typedef struct Transfer Transfer;
 
 typedef size_t (Pack)(char *, void *);
-typedef size_t (Unpack)(const char *, void *);
+typedef size_t (Unpack)(const char *, size_t, void *);
+typedef size_t (Gather)(uint16_t *, void *);
 
 #endif
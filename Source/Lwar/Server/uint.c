@@ -39,3 +39,50 @@ size_t uint32_unpack(const char *in,uint32_t *out) {
            |   (uint32_t)(unsigned char)in[3];
     return 4;
 }
+
+/* zigzag encoding, 7 bits per byte, the most significant bit marks continuation */
+size_t int16_varpack(char *out,int16_t in) {
+    uint16_t u = ((uint16_t)in << 1) ^ (uint16_t)(in < 0 ? 0xffff : 0);
+    size_t i = 0;
+    while(u >= 0x80) {
+        out[i++] = (u & 0x7f) | 0x80;
+        u >>= 7;
+    }
+    out[i++] = u;
+    return i;
+}
+
+size_t int16_varunpack(const char *in,int16_t *out) {
+    uint16_t u = 0;
+    size_t i = 0;
+    unsigned shift = 0;
+    do {
+        u |= (uint16_t)((unsigned char)in[i] & 0x7f) << shift;
+        shift += 7;
+    } while(((unsigned char)in[i++] & 0x80) && i < 3);
+    *out = (int16_t)((u >> 1) ^ (uint16_t)(-(int16_t)(u & 1)));
+    return i;
+}
+
+/* 7 bits per byte, least significant first, the most significant bit marks continuation */
+size_t uint32_varpack(char *out,uint32_t u) {
+    size_t i = 0;
+    while(u >= 0x80) {
+        out[i++] = (u & 0x7f) | 0x80;
+        u >>= 7;
+    }
+    out[i++] = u;
+    return i;
+}
+
+size_t uint32_varunpack(const char *in,uint32_t *out) {
+    uint32_t u = 0;
+    size_t i = 0;
+    unsigned shift = 0;
+    do {
+        u |= (uint32_t)((unsigned char)in[i] & 0x7f) << shift;
+        shift += 7;
+    } while(((unsigned char)in[i++] & 0x80) && i < 5);
+    *out = u;
+    return i;
+}
@@ -13,6 +13,14 @@ size_t uint16_unpack(const char *s, uint16_t *u);
 size_t uint32_pack(char *s, uint32_t u);
 size_t uint32_unpack(const char *s, uint32_t *u);
 
+/* variable length encoding of small signed values, 1-3 bytes */
+size_t int16_varpack(char *s, int16_t u);
+size_t int16_varunpack(const char *s, int16_t *u);
+
+/* variable length encoding of unsigned values, 1-5 bytes */
+size_t uint32_varpack(char *s, uint32_t u);
+size_t uint32_varunpack(const char *s, uint32_t *u);
+
 /* TODO: check whether that works, actually. */
 #define int16_pack(s,u)   uint16_pack(s,u)
 #define int16_unpack(s,u) uint16_unpack(s,(uint16_t*)u)
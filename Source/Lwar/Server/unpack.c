@@ -4,138 +4,326 @@
 
 #include "debug.h"
 #include "message.h"
+#include "server.h"
+#include "snapshot.h"
 #include "uint.h"
 
+#include <limits.h>
 #include <string.h>
 
-#ifdef _MSC_VER
-	#define strndup(s, n) _strdup(s)
-#endif
-
 size_t id_unpack(const char *out, Id *id) {
     uint16_unpack(out,   &id->gen);
     uint16_unpack(out+2, &id->n);
     return 4;
 }
 
+/* the string is valid until the arena is reset by the next protocol_recv,
+ * it is empty if the arena is exhausted
+ */
 size_t str_unpack(const char *in, Str *out) {
-    size_t i=0;
+    size_t i=0, n;
     i += uint8_unpack(in+i, &out->n);
-    out->s = strndup(in+i, out->n);
-    return i + out->n;
+    n = out->n;
+    out->s = (char*)arena_alloc(&server->scratch, n + 1);
+    if(out->s) {
+        memcpy(out->s, in+i, n);
+        out->s[n] = 0;
+    } else {
+        out->s = "";
+        out->n = 0;
+    }
+    return i + n;
 }
 
-size_t header_unpack(const char *s, void *p) {
+/* see header_pack, the variable-length fields may be read beyond len,
+ * which is caught by packet_get
+ */
+size_t header_unpack(const char *s, size_t len, void *p) {
     Header *h = (Header*)p;
     size_t i=0;
+    if(len < COMPACT_HEADER_LENGTH)
+        return 0;
     i += uint32_unpack(s+i, &h->app_id);
-    i += uint32_unpack(s+i, &h->ack);
-    // i += uint32_unpack(s+i, &h->time);
+    if(h->app_id != APP_ID_COMPACT) {
+        if(len < HEADER_LENGTH)
+            return 0;
+        i += uint32_unpack(s+i, &h->ack);
+        h->frame = 0;
+        h->time  = 0;
+    } else {
+        i += uint32_varunpack(s+i, &h->ack);
+        i += uint32_varunpack(s+i, &h->frame);
+        i += uint32_varunpack(s+i, &h->time);
+    }
+    h->prev = 0;
     return i;
 }
 
-size_t message_unpack(const char *s, void *p) {
+#define enum8_unpack(s, e) (*(e) = (uint8_t)*(s), LENGTH_enum8)
+
+static size_t pad_unpack(const char *s, uint16_t *n) {
+    uint16_unpack(s, n);
+    return LENGTH_pad + *n;
+}
+
+/* bounds checks for fields of variable length, the fixed part of
+ * the message has already been checked against its length
+ */
+#define CHECK_uint8
+#define CHECK_uint16
+#define CHECK_uint32
+#define CHECK_int16
+#define CHECK_id
+#define CHECK_enum8
+#define CHECK_str   need += (uint8_t)s[i]; if(len < need) return 0;
+#define CHECK_pad   { uint16_t n; uint16_unpack(s+i, &n); need += n; if(len < need) return 0; }
+
+static size_t message_body_unpack(const char *s, size_t len, Message *m, size_t i);
+
+/* returns 0 if the message is incomplete or of unknown type */
+size_t message_unpack(const char *s, size_t len, void *p) {
     Message *m = (Message*)p;
     size_t i=0;
-    int j;
     uint8_t _type;
+    uint32_t _seqno;
+
+    if(len < MESSAGE_HEADER_LENGTH)
+        return 0;
+
+    i += uint8_unpack(s+i, &_type);
+    m->type = (MessageType)_type;
+
+    i += uint32_unpack(s+i, &_seqno);
+    m->seqno = _seqno;
+
+    if(!_seqno)
+        return 0;
+    return message_body_unpack(s, len, m, i);
+}
+
+size_t message_unpack_in(const char *s, size_t len, Message *m, Header *h) {
+    size_t i=0;
+    uint8_t _type;
+    uint32_t _diff;
+
+    if(h->app_id != APP_ID_COMPACT)
+        return message_unpack(s, len, m);
+
+    if(len < COMPACT_MESSAGE_HEADER_LENGTH)
+        return 0;
+
     i += uint8_unpack(s+i, &_type);
     m->type = (MessageType)_type;
 
-	uint32_t _seqno;
-	i += uint32_unpack(s+i, &_seqno);
-	assert(_seqno);
-	m->seqno = _seqno;
+    if(is_reliable(m)) {
+        i += uint32_varunpack(s+i, &_diff);
+        if(i > len)
+            return 0;
+        h->prev += (uint32_t)unzigzag(_diff);
+        m->seqno = h->prev;
+    } else {
+        m->seqno = h->frame;
+    }
+
+    return message_body_unpack(s, len, m, i);
+}
+
+/* the fields of m at s+i, after a header of i bytes, returns the length
+ * of the whole message
+ */
+static size_t message_body_unpack(const char *s, size_t len, Message *m, size_t i) {
+    size_t need;
+    int j;
+
+    need = message_length(m->type);
+    if(!need)
+        return 0;
+    need = need - MESSAGE_HEADER_LENGTH + i;
+    if(len < need)
+        return 0;
+
+    switch(m->type) {
+#define MESSAGE(T, name)        case MESSAGE_##T:
+#define FIELD(name, type, f)        CHECK_##type i += type##_unpack(s+i, &m->name.f);
+#define ARRAY(name, n, a, max)      i += uint8_unpack(s+i, &m->name.n); \
+                                    if(m->name.n > max) return 0; \
+                                    need += m->name.n * ITEM_LENGTH_##name; \
+                                    if(len < need) return 0; \
+                                    for(j=0; j<m->name.n; j++) {
+#define ITEM(name, a, type, f)          i += type##_unpack(s+i, &m->name.a[j].f);
+#define ARRAY_END(name, a)          }
+#define MESSAGE_END(T, name)        break;
+#include "schema.h"
+    default:
+        return 0;
+    }
+    return i;
+}
+
+/* d->fields must be set to the fields of the format of the message,
+ * fields that are not present are left untouched; differences are
+ * applied to d->base if available, otherwise they are stored as they are;
+ * may read beyond len, which is caught by packet_get
+ */
+size_t delta_unpack(const char *s, size_t len, void *p) {
+    Delta *d = (Delta*)p;
+    State *st = &d->state;
+    size_t i=0, j;
+    i += id_unpack(s+i, &st->id);
+    i += uint8_unpack(s+i, &d->head);
+    if(d->head & DELTA_POS) {
+        if(d->head & DELTA_BASE) {
+            i += int16_varunpack(s+i, &st->x);
+            i += int16_varunpack(s+i, &st->y);
+            if(d->base) {
+                st->x += d->base->x;
+                st->y += d->base->y;
+            }
+        } else {
+            i += int16_unpack(s+i, &st->x);
+            i += int16_unpack(s+i, &st->y);
+        }
+    }
+    if(d->head & DELTA_PHI) {
+        if(d->head & DELTA_BASE) {
+            i += int16_varunpack(s+i, (int16_t*)&st->phi);
+            if(d->base)
+                st->phi += d->base->phi;
+        } else
+            i += uint16_unpack(s+i, &st->phi);
+    }
+    if(d->head & DELTA_EXTRA) {
+        if(d->fields & STATE_LEN)    i += uint16_unpack(s+i, &st->len);
+        if(d->fields & STATE_TARGET) i += id_unpack(s+i, &st->target);
+        if(d->fields & STATE_RADIUS) i += uint16_unpack(s+i, &st->radius);
+        if(d->fields & STATE_HEALTH) {
+            i += uint8_unpack(s+i, &st->health);
+            i += uint8_unpack(s+i, &st->shield);
+        }
+        if(d->fields & STATE_ENERGY) {
+            for(j=0; j<NUM_SLOTS; j++)
+                i += uint8_unpack(s+i, &st->energy[j]);
+        }
+    }
+    return i;
+}
+
+static int16_t coord_read(BitStream *b, const int16_t *base) {
+    int32_t q;
+    if(base) {
+        q = unzigzag(bits_get_golomb(b, 3)) + (*base >> POSITION_SHIFT);
+    } else {
+        /* sign extension */
+        q = (int32_t)(bits_get(b, 16 - POSITION_SHIFT) << (16 + POSITION_SHIFT)) >> (16 + POSITION_SHIFT);
+    }
+    return (int16_t)(q * (1 << POSITION_SHIFT));
+}
+
+/* counterpart of delta_write, with the same conventions as delta_unpack */
+void delta_read(BitStream *b, Delta *d, uint16_t *prev) {
+    State *st = &d->state;
+    const State *base;
+    size_t j;
+
+    d->head  = (uint8_t)bits_get(b, 8);
+    base     = (d->head & DELTA_BASE) ? d->base : 0;
+    st->id.n = (uint16_t)(*prev + unzigzag(bits_get_golomb(b, 2)));
+    if(!(d->head & DELTA_BASE))
+        st->id.gen = (uint16_t)bits_get(b, 8);
+    else if(base)
+        st->id.gen = base->id.gen;
+    *prev = st->id.n;
+
+    if(d->head & DELTA_POS) {
+        if(!base && (d->head & DELTA_BASE)) {
+            st->x = (int16_t)unzigzag(bits_get_golomb(b, 3));
+            st->y = (int16_t)unzigzag(bits_get_golomb(b, 3));
+        } else {
+            st->x = coord_read(b, base ? &base->x : 0);
+            st->y = coord_read(b, base ? &base->y : 0);
+        }
+    }
+    if(d->head & DELTA_PHI) {
+        if(d->head & DELTA_BASE) {
+            int32_t a = unzigzag(bits_get_golomb(b, 3));
+            st->phi = base ? angle_restore((angle_quantize(base->phi) + a) % (1u << ANGLE_BITS)) : (uint16_t)a;
+        } else {
+            st->phi = angle_restore(bits_get(b, ANGLE_BITS));
+        }
+    }
+    if(d->head & DELTA_EXTRA) {
+        if(d->fields & STATE_LEN) st->len = (uint16_t)bits_get_golomb(b, 6);
+        if(d->fields & STATE_TARGET) {
+            st->target.n   = USHRT_MAX;
+            st->target.gen = 0;
+            if(bits_get(b, 1)) {
+                st->target.n   = (uint16_t)bits_get(b, 16);
+                st->target.gen = (uint16_t)bits_get(b, 8);
+            }
+        }
+        if(d->fields & STATE_RADIUS) st->radius = (uint16_t)bits_get_golomb(b, 6);
+        if(d->fields & STATE_HEALTH) {
+            st->health = (uint8_t)bits_get(b, 7);
+            st->shield = (uint8_t)bits_get(b, 7);
+        }
+        if(d->fields & STATE_ENERGY) {
+            for(j=0; j<NUM_SLOTS; j++)
+                st->energy[j] = (uint8_t)bits_get(b, 7);
+        }
+    }
+}
+
+static Id event_id_read(BitStream *b, uint16_t *prev) {
+    Id id;
+    id.n   = (uint16_t)(*prev + unzigzag(bits_get_golomb(b, 2)));
+    id.gen = (uint16_t)bits_get_golomb(b, 2);
+    *prev  = id.n;
+    return id;
+}
+
+void event_read(BitStream *b, MessageType type, Message *m, uint16_t *prev) {
+    Id none = { 0, USHRT_MAX };
+    uint16_t n;
+
+    memset(m, 0, sizeof(Message));
+    m->type = message_single(type);
 
     switch(m->type) {
-    case MESSAGE_CONNECT:
-		i += uint8_unpack(s+i, &m->connect.rev);
-		i += str_unpack(s+i, &m->connect.nick);
-        break;
-    case MESSAGE_DISCONNECT:
-        break;
-    case MESSAGE_JOIN:
-        i += id_unpack(s+i, &m->join.player_id);
-		i += str_unpack(s+i, &m->join.nick);
-        break;
-    case MESSAGE_LEAVE:
-        i += id_unpack(s+i, &m->leave.player_id);
-		i += uint8_unpack(s+i, (uint8_t*)&m->leave.reason);
-        break;
-    case MESSAGE_CHAT:
-        i += id_unpack(s+i, &m->chat.player_id);
-        i += str_unpack(s+i, &m->chat.msg);
-        break;
     case MESSAGE_ADD:
-        i += id_unpack(s+i, &m->add.entity_id);
-        i += id_unpack(s+i, &m->add.player_id);
-		i += id_unpack(s+i, &m->add.parent_id);
-        i += uint8_unpack(s+i, &m->add.type_id);
+        m->add.entity_id = event_id_read(b, prev);
+        n = 0;
+        m->add.player_id = event_id_read(b, &n);
+        m->add.parent_id = none;
+        if(bits_get(b, 1)) {
+            n = *prev;
+            m->add.parent_id = event_id_read(b, &n);
+        }
+        m->add.type_id = (uint8_t)bits_get_golomb(b, 2);
         break;
     case MESSAGE_REMOVE:
-        i += id_unpack(s+i, &m->remove.entity_id);
-        break;
-    case MESSAGE_SELECTION:
-        i += id_unpack(s+i, &m->selection.player_id);
-        i += uint8_unpack(s+i, &m->selection.ship_type);
-        i += uint8_unpack(s+i, &m->selection.weapon_type1);
-        i += uint8_unpack(s+i, &m->selection.weapon_type2);
-        i += uint8_unpack(s+i, &m->selection.weapon_type3);
-        i += uint8_unpack(s+i, &m->selection.weapon_type4);
-        break;
-    case MESSAGE_NAME:
-        i += id_unpack(s+i, &m->name.player_id);
-        i += str_unpack(s+i, &m->name.nick);
-        break;
-	case MESSAGE_KILL:
-		i += id_unpack(s+i, &m->kill.killer_id);
-		i += id_unpack(s+i, &m->kill.victim_id);
-		break;
-    case MESSAGE_SYNCED:
-		i += id_unpack(s+i, &m->synced.player_id);
-        break;
-   case MESSAGE_REJECT:
-		i += uint8_unpack(s+i, (uint8_t*)&m->reject.reason);
-        break;
-    case MESSAGE_STATS:
-        i += uint8_unpack(s+i, &m->stats.n);
-		for (j = 0; j < m->stats.n; ++j) {
-			i += id_unpack(s+i, &m->stats.info[j].player_id);
-			i += uint16_unpack(s+i, &m->stats.info[j].kills);
-			i += uint16_unpack(s+i, &m->stats.info[j].deaths);
-			i += uint16_unpack(s+i, &m->stats.info[j].ping);
-		}
-        break;
-    case MESSAGE_UPDATE:
-    case MESSAGE_UPDATE_POS:
-    case MESSAGE_UPDATE_RAY:
-    case MESSAGE_UPDATE_CIRCLE:
-    case MESSAGE_UPDATE_SHIP:
-        i += uint8_unpack(s+i, &m->update.n);
-        break;
-    case MESSAGE_INPUT:
-        i += id_unpack(s+i, &m->input.player_id);
-        i += uint32_unpack(s+i, &m->input.frameno);
-        i += uint8_unpack(s+i, &m->input.forwards);
-        i += uint8_unpack(s+i, &m->input.backwards);
-        i += uint8_unpack(s+i, &m->input.turn_left);
-        i += uint8_unpack(s+i, &m->input.turn_right);
-        i += uint8_unpack(s+i, &m->input.strafe_left);
-        i += uint8_unpack(s+i, &m->input.strafe_right);
-		i += uint8_unpack(s+i, &m->input.after_burner);
-        i += uint8_unpack(s+i, &m->input.fire1);
-        i += uint8_unpack(s+i, &m->input.fire2);
-        i += uint8_unpack(s+i, &m->input.fire3);
-        i += uint8_unpack(s+i, &m->input.fire4);
-        i += int16_unpack(s+i, &m->input.aim_x);
-        i += int16_unpack(s+i, &m->input.aim_y);
+        m->remove.entity_id = event_id_read(b, prev);
         break;
     case MESSAGE_COLLISION:
-        i += id_unpack(s+i, &m->collision.entity_id[0]);
-        i += id_unpack(s+i, &m->collision.entity_id[1]);
-        i += int16_unpack(s+i, &m->collision.x);
-        i += int16_unpack(s+i, &m->collision.y);
+        m->collision.entity_id[0] = event_id_read(b, prev);
+        m->collision.entity_id[1] = event_id_read(b, prev);
+        m->collision.x = (int16_t)bits_get(b, 16);
+        m->collision.y = (int16_t)bits_get(b, 16);
+        break;
+    default:
+        b->overflow = true;
         break;
     }
-    return i;
+}
+
+bool events_unpack(const char *s, size_t len, Message *m, Message *out, size_t *size) {
+    BitStream b;
+    uint16_t prev = 0;
+    size_t i;
+
+    bits_init(&b, (char*)s, len);
+    for(i=0; i<m->events.n && !b.overflow; i++)
+        event_read(&b, m->type, &out[i], &prev);
+
+    *size = bits_bytes(&b);
+    return !b.overflow;
 }
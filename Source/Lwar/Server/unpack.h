@@ -1,13 +1,31 @@
 #ifndef UNPACK_H
 #define UNPACK_H
 
+#include "bitstream.h"
 #include "id.h"
+#include "message.h"
 #include "str.h"
 
 size_t id_unpack(const char *out, Id *id);
 size_t str_unpack(const char *in, Str *out);
 
-size_t header_unpack(const char *s, void *p);
-size_t message_unpack(const char *s, void *p);
+size_t header_unpack(const char *s, size_t len, void *p);
+size_t message_unpack(const char *s, size_t len, void *p);
+
+/* counterpart of message_header_pack and message_body_pack for a message
+ * in a packet with header h, 0 if it is incomplete or of unknown type
+ */
+size_t message_unpack_in(const char *s, size_t len, Message *m, Header *h);
+
+size_t delta_unpack(const char *s, size_t len, void *p);
+void   delta_read(BitStream *b, Delta *d, uint16_t *prev);
+
+/* counterpart of event_write, m becomes a single message of the given batched type */
+void   event_read(BitStream *b, MessageType type, Message *m, uint16_t *prev);
+
+/* the m->events.n single messages of the batched message m from the records
+ * at s, out has room for UINT8_MAX, *size is the length of the records, false if they are invalid
+ */
+bool   events_unpack(const char *s, size_t len, Message *m, Message *out, size_t *size);
 
 #endif
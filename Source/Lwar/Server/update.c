@@ -9,27 +9,22 @@
 #include "message.h"
 #include "real.h"
 #include "server.h"
+#include "snapshot.h"
 #include "uint.h"
 
-Format format_pos_rot = { {0,0}, MESSAGE_UPDATE,        update_pos_rotation_pack, 0 };
-Format format_pos     = { {0,0}, MESSAGE_UPDATE_POS,    update_pos_pack,          0 };
-Format format_ray     = { {0,0}, MESSAGE_UPDATE_RAY,    update_ray_pack,          0 };
-Format format_circle  = { {0,0}, MESSAGE_UPDATE_CIRCLE, update_circle_pack,       0 };
-Format format_ship    = { {0,0}, MESSAGE_UPDATE_SHIP,   update_ship_pack,         0 };
+Format format_pos_rot = { {0,0}, MESSAGE_UPDATE,        update_pos_rotation_pack, 0, STATE_X | STATE_Y | STATE_PHI, RECORD_LENGTH_UPDATE,        update_pos_rotation_gather };
+Format format_pos     = { {0,0}, MESSAGE_UPDATE_POS,    update_pos_pack,          0, STATE_X | STATE_Y, RECORD_LENGTH_UPDATE_POS,    update_pos_gather };
+Format format_body    = { {0,0}, MESSAGE_UPDATE_POS,    update_pos_pack,          0, STATE_X | STATE_Y, RECORD_LENGTH_UPDATE_POS,    update_pos_gather };
+Format format_ray     = { {0,0}, MESSAGE_UPDATE_RAY,    update_ray_pack,          0, STATE_X | STATE_Y | STATE_PHI | STATE_LEN | STATE_TARGET, RECORD_LENGTH_UPDATE_RAY,    update_ray_gather };
+Format format_circle  = { {0,0}, MESSAGE_UPDATE_CIRCLE, update_circle_pack,       0, STATE_X | STATE_Y | STATE_RADIUS, RECORD_LENGTH_UPDATE_CIRCLE, update_circle_gather };
+Format format_ship    = { {0,0}, MESSAGE_UPDATE_SHIP,   update_ship_pack,         0, STATE_X | STATE_Y | STATE_PHI | STATE_HEALTH | STATE_ENERGY, RECORD_LENGTH_UPDATE_SHIP,   update_ship_gather };
 
-void format_register(Format *f) {
+void format_register(Format *f, Clock interval) {
     INIT_LIST_HEAD(&f->all);
 
-    f->len = 0;
-    f->n   = 0;
-
-    if(1) {
-        char s[64];
-        Entity e = {};
-        EntityType t = {};
-        e.type = &t;
-        f->len = f->pack(s,&e);
-    }
+    f->n = 0;
+    f->rate.interval = interval;
+    f->rate.next     = 0;
 
     list_add_tail(&f->_l, &server->formats);
 }
@@ -4,6 +4,7 @@
 #include "types.h"
 #include "list.h"
 #include "message.h"
+#include "rate.h"
 
 struct Format {
     List _l;
@@ -11,11 +12,22 @@ struct Format {
 
     Pack *pack;
     Unpack *unpack;
+    unsigned fields; /* STATE_* of delta-compressed updates */
+    size_t len;      /* RECORD_LENGTH_* of the message */
+    Gather *gather;  /* words of a record for update_batch_pack */
+    Rate   rate;     /* see rate.c */
     List  all;
-    size_t len;
     size_t n;
 };
 
-void format_register(Format *f);
+extern Format format_pos_rot;
+extern Format format_pos;
+extern Format format_body; /* as format_pos, for planets and suns */
+extern Format format_ray;
+extern Format format_circle;
+extern Format format_ship;
+
+/* records of the format are sent at most every interval ms */
+void format_register(Format *f, Clock interval);
 
 #endif
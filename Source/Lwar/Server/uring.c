@@ -0,0 +1,355 @@
+#include "types.h"
+
+#include "uring.h"
+
+#ifdef __linux__
+
+#include "config.h"
+#include "log.h"
+#include "packet.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* The io_uring backend keeps a multishot recvmsg posted on the socket,
+ * which takes its buffers from a ring of URING_BUFFERS provided buffers,
+ * so datagrams are received while the server is busy and a whole burst is
+ * reaped with a single system call. Sends are copied into one of
+ * URING_SEND slots and submitted together by uring_flush, after each
+ * update and pacing step, or earlier when the slots run out.
+ *
+ * Completions arrive in order: those of the receive are kept in a FIFO of
+ * buffer ids until uring_recv takes them, those of the sends free their
+ * slot. A provided buffer holds a struct io_uring_recvmsg_out, the sender
+ * address and the payload, and is given back to the kernel when its
+ * datagram has been copied out.
+ */
+
+enum {
+    URING_GROUP = 0,            /* id of the provided buffers */
+    URING_RECV  = URING_SEND,   /* user data of the receive */
+};
+
+typedef struct Outgoing Outgoing;
+typedef struct Received Received;
+
+struct Outgoing {
+    struct msghdr msg;
+    struct iovec  iov;
+    struct sockaddr_storage to;
+    char   buf[MAX_PACKET_LENGTH];
+};
+
+struct Received {
+    unsigned short bid;
+    size_t len;
+};
+
+struct Uring {
+    int fd, socket;
+    unsigned *syscalls; /* of the connection */
+
+    /* submission queue */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned pending; /* written but not yet submitted */
+
+    /* completion queue */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void  *ring;
+    size_t ring_len, sqes_len;
+
+    /* receive */
+    struct msghdr msg;
+    bool   armed;
+    struct io_uring_buf_ring *br;
+    size_t br_len;
+    char  *bufs;
+    Received received[URING_BUFFERS];
+    size_t first, n;
+
+    /* send */
+    Outgoing slots[URING_SEND];
+    size_t free[URING_SEND], nfree;
+};
+
+#define load(p)    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store(p,v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+static int enter(Uring *u, unsigned submit, unsigned wait) {
+    int r = (int)syscall(__NR_io_uring_enter, u->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, 0, 0);
+    __atomic_fetch_add(u->syscalls, 1, __ATOMIC_RELAXED);
+    if(r > 0)
+        u->pending -= (unsigned)r;
+    else if(r < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        log_error("io_uring_enter failed: %s", strerror(errno));
+    return r;
+}
+
+static struct io_uring_sqe *sqe_get(Uring *u) {
+    unsigned tail = *u->sq_tail;
+    unsigned idx;
+    struct io_uring_sqe *sqe;
+
+    /* submission queue is full */
+    if(tail - load(u->sq_head) > *u->sq_mask)
+        enter(u, u->pending, 0);
+    if(tail - load(u->sq_head) > *u->sq_mask)
+        return 0;
+
+    idx = tail & *u->sq_mask;
+    sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    return sqe;
+}
+
+static void sqe_push(Uring *u) {
+    store(u->sq_tail, *u->sq_tail + 1);
+    u->pending ++;
+}
+
+static void buffer_give(Uring *u, unsigned short bid) {
+    unsigned short tail = u->br->tail;
+    struct io_uring_buf *b = &u->br->bufs[tail & (URING_BUFFERS - 1)];
+    b->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * URING_BUFFER_SIZE);
+    b->len  = URING_BUFFER_SIZE;
+    b->bid  = bid;
+    store(&u->br->tail, (unsigned short)(tail + 1));
+}
+
+static void arm(Uring *u) {
+    struct io_uring_sqe *sqe = sqe_get(u);
+    if(!sqe) return;
+
+    sqe->opcode    = IORING_OP_RECVMSG;
+    sqe->fd        = u->socket;
+    sqe->addr      = (uint64_t)(uintptr_t)&u->msg;
+    sqe->len       = 1;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_GROUP;
+    sqe->user_data = URING_RECV;
+    sqe_push(u);
+    u->armed = true;
+}
+
+static void reap(Uring *u) {
+    unsigned head = *u->cq_head;
+
+    while(head != load(u->cq_tail)) {
+        struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+
+        if(cqe->user_data == URING_RECV) {
+            if(!(cqe->flags & IORING_CQE_F_MORE))
+                u->armed = false;
+
+            if(cqe->res >= 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                Received *r = &u->received[(u->first + u->n) % URING_BUFFERS];
+                r->bid = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                r->len = (size_t)cqe->res;
+                u->n ++;
+            } else if(cqe->res < 0 && cqe->res != -ENOBUFS) {
+                log_error("Receiving failed: %s", strerror(-cqe->res));
+            }
+        } else {
+            u->free[u->nfree++] = (size_t)cqe->user_data;
+            if(cqe->res < 0)
+                log_error("Sending failed: %s", strerror(-cqe->res));
+        }
+
+        head ++;
+    }
+
+    store(u->cq_head, head);
+}
+
+bool uring_recv(Uring *u, char *buf, size_t *size, struct sockaddr_storage *from, uint64_t *stamp) {
+    for(;;) {
+        Received *r;
+        struct io_uring_recvmsg_out *out;
+        struct msghdr control;
+        char *p;
+        size_t offset;
+        bool ok;
+
+        if(u->n == 0) {
+            if(!u->armed)
+                arm(u);
+            enter(u, u->pending, 0);
+            reap(u);
+        }
+        if(u->n == 0) {
+            *size = 0;
+            return true;
+        }
+
+        r = &u->received[u->first];
+        p = u->bufs + (size_t)r->bid * URING_BUFFER_SIZE;
+        out = (struct io_uring_recvmsg_out*)p;
+        offset = sizeof(*out) + u->msg.msg_namelen + u->msg.msg_controllen;
+
+        /* datagrams that are larger than any valid packet are skipped */
+        ok = r->len >= offset
+          && !(out->flags & MSG_TRUNC)
+          && out->payloadlen <= *size;
+        if(ok) {
+            memset(from, 0, sizeof(*from));
+            memcpy(from, p + sizeof(*out), out->namelen < sizeof(*from) ? out->namelen : sizeof(*from));
+            memcpy(buf, p + offset, out->payloadlen);
+            *size = out->payloadlen;
+
+            /* the control messages follow the address */
+            memset(&control, 0, sizeof(control));
+            control.msg_control    = p + sizeof(*out) + u->msg.msg_namelen;
+            control.msg_controllen = out->controllen;
+            *stamp = conn_cmsg_stamp(&control);
+        }
+
+        u->first = (u->first + 1) % URING_BUFFERS;
+        u->n --;
+        buffer_give(u, r->bid);
+
+        if(ok)
+            return true;
+    }
+}
+
+bool uring_send(Uring *u, const char *buf, size_t size, const struct sockaddr *to, socklen_t len) {
+    struct io_uring_sqe *sqe;
+    Outgoing *s;
+    size_t i;
+
+    if(size > sizeof(s->buf) || len > sizeof(s->to))
+        return false;
+
+    /* wait for a slot */
+    while(u->nfree == 0) {
+        if(enter(u, u->pending, 1) < 0 && errno != EINTR)
+            return false;
+        reap(u);
+    }
+
+    sqe = sqe_get(u);
+    if(!sqe) return false;
+
+    i = u->free[--u->nfree];
+    s = &u->slots[i];
+    memcpy(s->buf, buf, size);
+    memcpy(&s->to, to, len);
+    memset(&s->msg, 0, sizeof(s->msg));
+    s->iov.iov_base    = s->buf;
+    s->iov.iov_len     = size;
+    s->msg.msg_name    = &s->to;
+    s->msg.msg_namelen = len;
+    s->msg.msg_iov     = &s->iov;
+    s->msg.msg_iovlen  = 1;
+
+    sqe->opcode    = IORING_OP_SENDMSG;
+    sqe->fd        = u->socket;
+    sqe->addr      = (uint64_t)(uintptr_t)&s->msg;
+    sqe->len       = 1;
+    sqe->user_data = i;
+    sqe_push(u);
+
+    return true;
+}
+
+void uring_flush(Uring *u) {
+    if(u->pending)
+        enter(u, u->pending, 0);
+    reap(u);
+}
+
+Uring *uring_create(int socket, unsigned *syscalls) {
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    Uring *u;
+    size_t i;
+
+    u = (Uring*)calloc(1, sizeof(Uring));
+    if(!u) return 0;
+    u->socket   = socket;
+    u->syscalls = syscalls;
+    u->fd       = -1;
+
+    memset(&p, 0, sizeof(p));
+    p.flags      = IORING_SETUP_CQSIZE;
+    p.cq_entries = 2 * (URING_BUFFERS + URING_SEND);
+    u->fd = (int)syscall(__NR_io_uring_setup, URING_SEND + 8, &p);
+    if(u->fd < 0 || !(p.features & IORING_FEAT_SINGLE_MMAP))
+        goto fail;
+
+    u->ring_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    if(u->ring_len < p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe))
+        u->ring_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->ring = mmap(0, u->ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if(u->ring == MAP_FAILED) { u->ring = 0; goto fail; }
+
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = (struct io_uring_sqe*)mmap(0, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if(u->sqes == MAP_FAILED) { u->sqes = 0; goto fail; }
+
+    u->sq_head  = (unsigned*)((char*)u->ring + p.sq_off.head);
+    u->sq_tail  = (unsigned*)((char*)u->ring + p.sq_off.tail);
+    u->sq_mask  = (unsigned*)((char*)u->ring + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*)((char*)u->ring + p.sq_off.array);
+    u->cq_head  = (unsigned*)((char*)u->ring + p.cq_off.head);
+    u->cq_tail  = (unsigned*)((char*)u->ring + p.cq_off.tail);
+    u->cq_mask  = (unsigned*)((char*)u->ring + p.cq_off.ring_mask);
+    u->cqes     = (struct io_uring_cqe*)((char*)u->ring + p.cq_off.cqes);
+
+    /* provided buffers, the ring has to be page aligned */
+    u->br_len = URING_BUFFERS * sizeof(struct io_uring_buf);
+    u->br = (struct io_uring_buf_ring*)mmap(0, u->br_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(u->br == MAP_FAILED) { u->br = 0; goto fail; }
+    u->bufs = (char*)malloc((size_t)URING_BUFFERS * URING_BUFFER_SIZE);
+    if(!u->bufs) goto fail;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)u->br;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid         = URING_GROUP;
+    if(syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        goto fail;
+
+    u->br->tail = 0;
+    for(i=0; i<URING_BUFFERS; i++)
+        buffer_give(u, (unsigned short)i);
+
+    u->msg.msg_namelen    = sizeof(struct sockaddr_storage);
+    u->msg.msg_controllen = CMSG_SPACE(sizeof(struct timespec));
+    for(i=0; i<URING_SEND; i++)
+        u->free[u->nfree++] = URING_SEND - 1 - i;
+
+    arm(u);
+    if(enter(u, u->pending, 0) < 0)
+        goto fail;
+
+    return u;
+
+fail:
+    log_info("io_uring is not supported (%s), using sockets.", strerror(errno));
+    uring_destroy(u);
+    return 0;
+}
+
+void uring_destroy(Uring *u) {
+    if(u->fd >= 0) close(u->fd);
+    if(u->sqes)    munmap(u->sqes, u->sqes_len);
+    if(u->ring)    munmap(u->ring, u->ring_len);
+    if(u->br)      munmap(u->br, u->br_len);
+    free(u->bufs);
+    free(u);
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef URING_H
+#define URING_H
+
+#ifdef __linux__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include "types.h"
+
+typedef struct Uring Uring;
+
+/* io_uring backend of a connection, see uring.c, which counts
+ * its system calls in *syscalls, returns 0 if the kernel does
+ * not support it
+ */
+Uring *uring_create(int socket, unsigned *syscalls);
+void   uring_destroy(Uring *u);
+
+/* like recvmsg on a non-blocking socket, *size = 0 if nothing arrived,
+ * *stamp is the receive time as in conn_stamp
+ */
+bool uring_recv(Uring *u, char *buf, size_t *size, struct sockaddr_storage *from, uint64_t *stamp);
+
+/* queue a datagram, it is sent with the next uring_flush at the latest */
+bool uring_send(Uring *u, const char *buf, size_t size, const struct sockaddr *to, socklen_t len);
+void uring_flush(Uring *u);
+
+/* receive time in the control messages of a datagram, see connection.c */
+uint64_t conn_cmsg_stamp(struct msghdr *msg);
+
+#endif
+
+#endif
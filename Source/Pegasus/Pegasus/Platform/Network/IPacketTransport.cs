@@ -0,0 +1,24 @@
+﻿namespace Pegasus.Platform.Network
+{
+	using System;
+
+	/// <summary>
+	///     Transports the packets of a channel to a peer in the same process, without a socket.
+	/// </summary>
+	public interface IPacketTransport : IDisposable
+	{
+		/// <summary>
+		///     Sends the given packet to the peer. Like a UDP packet, the packet might get lost.
+		/// </summary>
+		/// <param name="buffer">The buffer that contains the data that should be sent.</param>
+		/// <param name="size">The number of bytes that should be sent.</param>
+		void Send(byte[] buffer, int size);
+
+		/// <summary>
+		///     Tries to receive a packet sent by the peer. Returns true if a packet has been received, false otherwise.
+		/// </summary>
+		/// <param name="buffer">The buffer the received data should be written to.</param>
+		/// <param name="size">Returns the number of bytes that have been received.</param>
+		bool TryReceive(byte[] buffer, out int size);
+	}
+}
\ No newline at end of file
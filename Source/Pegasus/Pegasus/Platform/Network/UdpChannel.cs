@@ -47,6 +47,11 @@
 		/// </summary>
 		private UdpSocket _socket;
 
+		/// <summary>
+		///     The transport that is used instead of the socket to communicate with a peer in the same process.
+		/// </summary>
+		private IPacketTransport _transport;
+
 		/// <summary>
 		///     Gets a value indicating whether the channel to the remote peer is faulted and can no longer be used.
 		/// </summary>
@@ -85,6 +90,28 @@
 			}
 		}
 
+		/// <summary>
+		///     Initializes a new instance that communicates with a peer in the same process.
+		/// </summary>
+		/// <param name="allocator">The allocator that should be used to allocate objects.</param>
+		/// <param name="remoteEndPoint">The remote endpoint of the channel.</param>
+		/// <param name="transport">The transport that is used instead of a socket. The channel takes ownership of it.</param>
+		/// <param name="maxPacketSize">The maximum supported packet size.</param>
+		public static UdpChannel Create(PoolAllocator allocator, IPEndPoint remoteEndPoint, IPacketTransport transport, int maxPacketSize)
+		{
+			Assert.ArgumentNotNull(allocator);
+			Assert.ArgumentNotNull(transport);
+
+			var channel = allocator.Allocate<UdpChannel>();
+			channel.RemoteEndPoint = remoteEndPoint;
+			channel._transport = transport;
+			channel._maxPacketSize = maxPacketSize;
+			channel._isBound = true;
+			channel._receiveFromSocket = true;
+			channel._allocator = allocator;
+			return channel;
+		}
+
 		/// <summary>
 		///     Initializes a new instance.
 		/// </summary>
@@ -120,6 +147,20 @@
 			Assert.NotPooled(this);
 			Assert.That(!IsFaulted, "The channel is faulted and can no longer be used.");
 
+			if (_transport != null)
+			{
+				try
+				{
+					_transport.Send(packet.Buffer, size);
+					return;
+				}
+				catch (NetworkException)
+				{
+					IsFaulted = true;
+					throw;
+				}
+			}
+
 			try
 			{
 				_socket.Send(packet.Buffer, size, RemoteEndPoint);
@@ -156,6 +197,18 @@
 			try
 			{
 				allocatedPacket = IncomingUdpPacket.Allocate(_allocator, _maxPacketSize);
+				if (_transport != null)
+				{
+					int size;
+					if (!_transport.TryReceive(allocatedPacket.Buffer, out size))
+						return false;
+
+					packet = allocatedPacket;
+					packet.Size = size;
+					allocatedPacket = null;
+					return true;
+				}
+
 				while (true)
 				{
 					IPEndPoint sender;
@@ -180,6 +233,11 @@
 				IsFaulted = true;
 				throw;
 			}
+			catch (NetworkException)
+			{
+				IsFaulted = true;
+				throw;
+			}
 			finally
 			{
 				allocatedPacket.SafeDispose();
@@ -201,13 +259,16 @@
 		/// </summary>
 		protected override void OnReturning()
 		{
-			if (_listener == null)
+			if (_transport != null)
+				_transport.SafeDispose();
+			else if (_listener == null)
 				_socket.SafeDispose();
 			else
 				_listener.Remove(this);
 
 			_packets.SafeDisposeAll();
 			_socket = null;
+			_transport = null;
 			_listener = null;
 			_isBound = false;
 			IsFaulted = false;
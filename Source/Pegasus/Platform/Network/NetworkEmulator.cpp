@@ -0,0 +1,140 @@
+#include "Prelude.hpp"
+
+std::unique_ptr<NetworkEmulator> NetworkEmulator::FromEnvironment()
+{
+	auto conditions = SDL_getenv("PG_NETEM");
+	if (conditions == nullptr || *conditions == '\0')
+		return nullptr;
+
+	std::unique_ptr<NetworkEmulator> emulator(new NetworkEmulator);
+	if (!emulator->Parse(conditions))
+	{
+		PG_ERROR("Ignoring invalid network conditions '%s'.", conditions);
+		return nullptr;
+	}
+
+	PG_INFO("Emulating network conditions '%s'.", conditions);
+	return emulator;
+}
+
+bool NetworkEmulator::Parse(const std::string& conditions)
+{
+	std::istringstream stream(conditions);
+	std::string item;
+
+	while (std::getline(stream, item, ','))
+	{
+		auto separator = item.find('=');
+		if (separator == std::string::npos)
+			return false;
+
+		auto key = item.substr(0, separator);
+		char* end = nullptr;
+		auto value = strtod(item.c_str() + separator + 1, &end);
+		if (*end != '\0' || value < 0)
+			return false;
+
+		if (key == "latency")
+			_latency = static_cast<uint64>(value * 1000);
+		else if (key == "jitter")
+			_jitter = static_cast<uint64>(value * 1000);
+		else if (key == "loss")
+			_loss = value / 100;
+		else if (key == "duplicate")
+			_duplicate = value / 100;
+		else if (key == "reorder")
+			_reorder = value / 100;
+		else if (key == "rate")
+			_rate = static_cast<uint64>(value);
+		else if (key == "seed")
+			_random = static_cast<uint64>(value) + 1;
+		else
+			return false;
+	}
+
+	return _loss <= 1 && _duplicate <= 1 && _reorder <= 1;
+}
+
+float64 NetworkEmulator::NextRandom()
+{
+	// xorshift64*, like the emulator of the server
+	_random ^= _random >> 12;
+	_random ^= _random << 25;
+	_random ^= _random >> 27;
+	return static_cast<float64>((_random * 2685821657736338717ull) >> 11) / static_cast<float64>(1ull << 53);
+}
+
+uint64 NetworkEmulator::GetTime()
+{
+	static auto frequency = SDL_GetPerformanceFrequency();
+	auto ticks = SDL_GetPerformanceCounter();
+	return ticks / frequency * 1000000 + ticks % frequency * 1000000 / frequency;
+}
+
+void NetworkEmulator::Put(Direction direction, const byte* buffer, int32 sizeInBytes, const IPEndPoint& endPoint)
+{
+	PG_ASSERT_NOT_NULL(buffer);
+
+	auto& path = _paths[static_cast<int32>(direction)];
+	auto now = GetTime();
+
+	if (NextRandom() < _loss)
+		return;
+
+	Enqueue(path, buffer, sizeInBytes, endPoint, now);
+	if (NextRandom() < _duplicate)
+		Enqueue(path, buffer, sizeInBytes, endPoint, now);
+}
+
+void NetworkEmulator::Enqueue(Path& path, const byte* buffer, int32 sizeInBytes, const IPEndPoint& endPoint, uint64 now)
+{
+	if (path.Packets.size() >= MaxPackets)
+		return;
+
+	// The rate limit serializes the packets, the latency and jitter are added afterwards
+	auto sent = now;
+	if (_rate != 0)
+	{
+		sent = std::max(now, path.Busy) + static_cast<uint64>(sizeInBytes) * 1000000 / _rate;
+		path.Busy = sent;
+	}
+
+	auto delay = _latency;
+	if (_jitter != 0)
+	{
+		auto offset = static_cast<int64>((NextRandom() * 2 - 1) * static_cast<float64>(_jitter));
+		delay = static_cast<uint64>(std::max(static_cast<int64>(delay) + offset, static_cast<int64>(0)));
+	}
+
+	// A reordered packet overtakes the packets that are on the path already
+	if (NextRandom() < _reorder)
+		delay = 0;
+
+	Packet packet;
+	packet.Due = sent + delay;
+	packet.EndPoint = endPoint;
+	packet.Data.assign(buffer, buffer + sizeInBytes);
+	path.Packets.push_back(std::move(packet));
+}
+
+bool NetworkEmulator::TryGet(Direction direction, byte* buffer, int32 capacityInBytes, IPEndPoint* endPoint, int32* sizeInBytes)
+{
+	PG_ASSERT_NOT_NULL(buffer);
+	PG_ASSERT_NOT_NULL(endPoint);
+	PG_ASSERT_NOT_NULL(sizeInBytes);
+
+	auto& packets = _paths[static_cast<int32>(direction)].Packets;
+	if (packets.empty())
+		return false;
+
+	auto next = std::min_element(packets.begin(), packets.end(), [](const Packet& a, const Packet& b) { return a.Due < b.Due; });
+	if (next->Due > GetTime())
+		return false;
+
+	// Like a datagram socket, a packet that is too large for the buffer is truncated
+	*sizeInBytes = std::min(static_cast<int32>(next->Data.size()), capacityInBytes);
+	Memory::CopyArray(buffer, next->Data.data(), static_cast<uint32>(*sizeInBytes));
+	*endPoint = next->EndPoint;
+	packets.erase(next);
+	return true;
+}
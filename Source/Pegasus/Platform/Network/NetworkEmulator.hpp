@@ -0,0 +1,59 @@
+#pragma once
+
+struct IPEndPoint;
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------
+// Emulates the conditions of a network path for the packets sent and received by a UDP socket: latency, jitter, loss,
+// duplication, reordering and a rate limit. The conditions use the syntax of the server's -netem option, for instance
+// "latency=50,jitter=10,loss=2,duplicate=1,reorder=5,rate=64000,seed=7", where times are in milliseconds, probabilities in
+// percent and the rate in bytes per second. Both directions are emulated independently with the same conditions.
+//-------------------------------------------------------------------------------------------------------------------------------------------------------
+class NetworkEmulator
+{
+public:
+	enum class Direction
+	{
+		Outgoing,
+		Incoming
+	};
+
+	// Creates an emulator for the conditions in the PG_NETEM environment variable, or returns null if it is not set.
+	static std::unique_ptr<NetworkEmulator> FromEnvironment();
+
+	// Puts a packet onto the path of the given direction, unless it is lost.
+	void Put(Direction direction, const byte* buffer, int32 sizeInBytes, const IPEndPoint& endPoint);
+
+	// Takes the next packet that has left the path of the given direction, if any.
+	bool TryGet(Direction direction, byte* buffer, int32 capacityInBytes, IPEndPoint* endPoint, int32* sizeInBytes);
+
+private:
+	struct Packet
+	{
+		uint64 Due;
+		IPEndPoint EndPoint;
+		std::vector<byte> Data;
+	};
+
+	struct Path
+	{
+		std::vector<Packet> Packets;
+		uint64 Busy = 0;
+	};
+
+	// The maximum number of packets on a path, further ones are dropped like by a full router queue.
+	static const size_t MaxPackets = 64;
+
+	uint64 _latency = 0;
+	uint64 _jitter = 0;
+	float64 _loss = 0;
+	float64 _duplicate = 0;
+	float64 _reorder = 0;
+	uint64 _rate = 0;
+	uint64 _random = 1;
+	Path _paths[2];
+
+	bool Parse(const std::string& conditions);
+	float64 NextRandom();
+	void Enqueue(Path& path, const byte* buffer, int32 sizeInBytes, const IPEndPoint& endPoint, uint64 now);
+	static uint64 GetTime();
+};
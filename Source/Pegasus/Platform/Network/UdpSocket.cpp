@@ -48,6 +48,11 @@ bool UdpSocket::Initialize()
 		if (setsockopt(_socket, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char*>(&ipv6only), sizeof(ipv6only)) != 0)
 			throw NetworkException("Unable to switch UDP socket to dual-stack mode.");
 
+		// The emulated packets are copied through a buffer that holds the largest UDP payload
+		_emulator = NetworkEmulator::FromEnvironment();
+		if (_emulator != nullptr)
+			_emulatorBuffer.resize(65507);
+
 		return true;
 	}
 	catch (const NetworkException& e)
@@ -62,12 +67,68 @@ bool UdpSocket::Send(byte* buffer, int32 sizeInBytes, IPEndPoint* remoteEndPoint
 	PG_ASSERT_NOT_NULL(buffer);
 	PG_ASSERT_NOT_NULL(remoteEndPoint);
 
+	if (_emulator == nullptr)
+		return SendTo(buffer, sizeInBytes, *remoteEndPoint);
+
+	_emulator->Put(NetworkEmulator::Direction::Outgoing, buffer, sizeInBytes, *remoteEndPoint);
+	return ReleaseEmulated();
+}
+
+ReceiveStatus UdpSocket::TryReceive(byte* buffer, int32 capacityInBytes, IPEndPoint* remoteEndPoint, int32* receivedBytes)
+{
+	PG_ASSERT_NOT_NULL(buffer);
+	PG_ASSERT_NOT_NULL(remoteEndPoint);
+	PG_ASSERT_NOT_NULL(receivedBytes);
+
+	if (_emulator == nullptr)
+		return ReceiveFrom(buffer, capacityInBytes, remoteEndPoint, receivedBytes);
+
+	// Outgoing packets are sent once they have left their path; all packets that have arrived enter the incoming path
+	if (!ReleaseEmulated())
+		return ReceiveStatus::Error;
+
+	for (;;)
+	{
+		auto status = ReceiveFrom(buffer, capacityInBytes, remoteEndPoint, receivedBytes);
+		if (status == ReceiveStatus::Error)
+			return status;
+
+		if (status == ReceiveStatus::NoPacketAvailable)
+			break;
+
+		_emulator->Put(NetworkEmulator::Direction::Incoming, buffer, *receivedBytes, *remoteEndPoint);
+	}
+
+	if (_emulator->TryGet(NetworkEmulator::Direction::Incoming, buffer, capacityInBytes, remoteEndPoint, receivedBytes))
+		return ReceiveStatus::PacketReceived;
+
+	return ReceiveStatus::NoPacketAvailable;
+}
+
+bool UdpSocket::ReleaseEmulated()
+{
+	auto buffer = _emulatorBuffer.data();
+	auto capacity = static_cast<int32>(_emulatorBuffer.size());
+	IPEndPoint endPoint;
+	int32 size;
+
+	while (_emulator->TryGet(NetworkEmulator::Direction::Outgoing, buffer, capacity, &endPoint, &size))
+	{
+		if (!SendTo(buffer, size, endPoint))
+			return false;
+	}
+
+	return true;
+}
+
+bool UdpSocket::SendTo(const byte* buffer, int32 sizeInBytes, const IPEndPoint& remoteEndPoint)
+{
 	try
 	{
 		sockaddr_in6 ipv6 = {};
 		ipv6.sin6_family = AF_INET6;
-		ipv6.sin6_port = htons(remoteEndPoint->GetPort());
-		Memory::CopyArray(reinterpret_cast<byte*>(&ipv6.sin6_addr), remoteEndPoint->GetAddress().GetIPv6Address(), sizeof(ipv6.sin6_addr));
+		ipv6.sin6_port = htons(remoteEndPoint.GetPort());
+		Memory::CopyArray(reinterpret_cast<byte*>(&ipv6.sin6_addr), remoteEndPoint.GetAddress().GetIPv6Address(), sizeof(ipv6.sin6_addr));
 
 		auto sent = sendto(_socket, reinterpret_cast<const char*>(buffer), sizeInBytes, 0, reinterpret_cast<sockaddr*>(&ipv6), sizeof(sockaddr_in6));
 		if (IsSocketError(sent))
@@ -85,12 +146,8 @@ bool UdpSocket::Send(byte* buffer, int32 sizeInBytes, IPEndPoint* remoteEndPoint
 	}
 }
 
-ReceiveStatus UdpSocket::TryReceive(byte* buffer, int32 capacityInBytes, IPEndPoint* remoteEndPoint, int32* receivedBytes)
+ReceiveStatus UdpSocket::ReceiveFrom(byte* buffer, int32 capacityInBytes, IPEndPoint* remoteEndPoint, int32* receivedBytes)
 {
-	PG_ASSERT_NOT_NULL(buffer);
-	PG_ASSERT_NOT_NULL(remoteEndPoint);
-	PG_ASSERT_NOT_NULL(receivedBytes);
-
 	try
 	{
 		sockaddr_storage from;
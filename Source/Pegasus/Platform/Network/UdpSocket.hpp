@@ -18,4 +18,10 @@ private:
 	PG_LINUX_ONLY(int _socket = 0);
 
 	std::string _errorMessage;
+	std::unique_ptr<NetworkEmulator> _emulator;
+	std::vector<byte> _emulatorBuffer;
+
+	bool SendTo(const byte* buffer, int32 sizeInBytes, const IPEndPoint& remoteEndPoint);
+	ReceiveStatus ReceiveFrom(byte* buffer, int32 capacityInBytes, IPEndPoint* remoteEndPoint, int32* receivedBytes);
+	bool ReleaseEmulated();
 };
@@ -235,4 +235,5 @@ PG_ENABLE_WARNING(4668)
 #include "Network/IPAddress.hpp"
 #include "Network/IPEndPoint.hpp"
 #include "Network/NetworkException.hpp"
+#include "Network/NetworkEmulator.hpp"
 #include "Network/UdpSocket.hpp"
\ No newline at end of file